@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include "session.h"
+#include "../led/trace.h"
 
 static int execute_fully_off(void *context);
 static int execute_fully_on(void *context);
@@ -146,7 +147,9 @@ static int broker_schedule(void)
 
 	while ((node = broker_pop()) != NULL) {
 		if (node->base) {
+			TRACE_BEGIN("execute");
 			node->base->execute(node->extra);
+			TRACE_END("execute");
 		}
 
 		session_del(node);
@@ -195,6 +198,7 @@ session_t *session_new(const char *exp)
     	return NULL;
     }
 
+    TRACE_MARK("session_new");
     link = get_link(exp);
     if (!link) {
     	fprintf(stderr, "[SESSION] unrecognized exp - %s\n", exp);
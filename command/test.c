@@ -1,4 +1,5 @@
 #include "session.h"
+#include "../led/trace.h"
 #include <stdio.h>
 
 static void session_test(void)
@@ -21,6 +22,10 @@ static void session_test(void)
 	}
 
 	broker->schedule();
+
+#ifdef LED_TRACE
+	tr_dump("session.json");
+#endif
 }
 
 int main(int argc, char *argv[])
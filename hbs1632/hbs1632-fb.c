@@ -13,6 +13,7 @@
 #include <linux/module.h>
 #include <linux/platform_device.h>
 #include <linux/mutex.h>
+#include <linux/workqueue.h>
 #ifdef CONFIG_OF
 #include <linux/of.h>
 #include <linux/of_gpio.h>
@@ -24,6 +25,7 @@
 
 #include <asm/uaccess.h>
 #include "hbs1632-fb.h"
+#include "hbs1632-flush.h"
 
 #define TE_PERIOD 		(60 * HZ)
 
@@ -39,7 +41,12 @@ struct hbs1632_device {
 	int brightness;
 	int blink;
 
-	struct timer_list te_timer;
+	/* what the chip RAM holds, only differences get written */
+	struct mutex flush_lock;
+	u8 shadow[HBS1632_RAM_SIZE];
+	bool shadow_valid;
+
+	struct delayed_work te_work;
 };
 
 #define to_smem_len(info) (info->var.xres_virtual * info->var.yres_virtual / 8)
@@ -93,15 +100,39 @@ static int hbs1632_start_engine(struct hbs1632_chip *chip)
 
 static int hbs1632_easy_flush(struct hbs1632_device *hdev)
 {
-#define TEMP_SIZE	128
-	u8 temp[TEMP_SIZE+1] = {0};
-	u8 size = to_smem_len(hdev->info);
+	struct hbs1632_span spans[HBS1632_SPANS_MAX];
+	u8 temp[HBS1632_RAM_SIZE + 1];
+	int size = to_smem_len(hdev->info);
+	int i, n, len, ret = 0;
+
+	size = size > HBS1632_RAM_SIZE ? HBS1632_RAM_SIZE : size;
+
+	mutex_lock(&hdev->flush_lock);
+	if (hdev->shadow_valid) {
+		n = hbs1632_diff(hdev->shadow, hdev->video_mem, size,
+				spans, HBS1632_SPANS_MAX);
+	} else {
+		spans[0].addr = 0;
+		spans[0].len = size;
+		n = 1;
+	}
 
-	size = size > TEMP_SIZE ? TEMP_SIZE : size;
-	/* temp[0] fixed 0x00 */
-	memcpy(temp+1, hdev->video_mem, size);
+	for (i = 0; i < n; i++) {
+		len = hbs1632_encode(hdev->video_mem, &spans[i], temp);
+		/* returns the number of NACKed bytes, not an errno */
+		ret = hbs1632_write(hdev->chip, temp, len);
+		if (ret)
+			break;
+		/* video_mem is mmapped, keep what was actually sent */
+		memcpy(hdev->shadow + spans[i].addr, temp + 1, spans[i].len);
+	}
+	/* chip RAM unknown after a failed write, resend everything next time */
+	hdev->shadow_valid = !ret;
+	mutex_unlock(&hdev->flush_lock);
 
-	return hbs1632_write(hdev->chip, temp, size+1);
+	dev_dbg(hdev->dev, "flush %d spans, %d bytes\n", i,
+		hbs1632_wire_bytes(spans, i));
+	return ret > 0 ? -EIO : ret;
 }
 
 static struct fb_fix_screeninfo hbs1632_default_fix __initdata = {
@@ -118,15 +149,24 @@ static struct fb_var_screeninfo hbs1632_default_var __initdata = {
 	.bits_per_pixel = 1,
 };
 
-static void hbs1632_te_callback(unsigned long arg)
+/*
+ * Picks up mmap writes that were not followed by a pan, and resends the
+ * whole RAM so a chip that lost its contents without a NACK recovers.
+ * Runs from a workqueue since the bit-banged bus sleeps on its mutex.
+ */
+static void hbs1632_te_work(struct work_struct *work)
 {
-	struct hbs1632_device *hdev = (struct hbs1632_device *)arg;
+	struct hbs1632_device *hdev = container_of(to_delayed_work(work),
+					struct hbs1632_device, te_work);
 
 	dev_dbg(hdev->dev, "TE timer\n");
 
+	mutex_lock(&hdev->flush_lock);
+	hdev->shadow_valid = false;
+	mutex_unlock(&hdev->flush_lock);
 	hbs1632_easy_flush(hdev);
 
-    mod_timer(&hdev->te_timer, jiffies + TE_PERIOD);
+	schedule_delayed_work(&hdev->te_work, TE_PERIOD);
 }
 
 static int hbs1632_fb_check_var(struct fb_var_screeninfo *var,
@@ -310,9 +350,8 @@ static struct hbs1632_device *hbs1632_device_alloc(struct platform_device *pdev)
 	info->fix.smem_start = hdev->video_mem_phys;
 	info->fix.smem_len = hdev->video_mem_size;
 
-	init_timer(&hdev->te_timer);
-	hdev->te_timer.function = hbs1632_te_callback;
-	hdev->te_timer.data = (unsigned long)hdev;
+	mutex_init(&hdev->flush_lock);
+	INIT_DELAYED_WORK(&hdev->te_work, hbs1632_te_work);
 
 	hdev->chip = chip;
 	hdev->info = info;
@@ -360,7 +399,7 @@ static int hbs1632_fb_probe(struct platform_device *pdev)
 	}
 #endif
 
-	mod_timer(&hdev->te_timer, jiffies + TE_PERIOD);
+	schedule_delayed_work(&hdev->te_work, TE_PERIOD);
 	return 0;
 }
 
@@ -368,6 +407,7 @@ static int hbs1632_fb_remove(struct platform_device *pdev)
 {
 	struct hbs1632_device *hdev = platform_get_drvdata(pdev);
 
+	cancel_delayed_work_sync(&hdev->te_work);
 	hbs1632_device_release(hdev);
 	return 0;
 }
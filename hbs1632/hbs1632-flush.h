@@ -0,0 +1,88 @@
+/*
+ * Winrise HBS1632 display RAM update encoding
+ *
+ * Kept free of driver state so it builds in user space as well, the
+ * led test program includes it directly.
+ *
+ * A RAM write is one bus transaction: device address, start address in
+ * display RAM, then data bytes while the chip auto-increments the address.
+ * The driver keeps a shadow of what the chip holds and only writes the
+ * address ranges that differ from it.
+ */
+
+#ifndef _HBS1632_FLUSH_H_
+#define _HBS1632_FLUSH_H_
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#include <linux/string.h>
+#else
+#include <stdint.h>
+#include <string.h>
+typedef uint8_t u8;
+#endif
+
+#define HBS1632_RAM_SIZE	128
+/* device address and RAM address sent ahead of the data of every span */
+#define HBS1632_SPAN_OVERHEAD	2
+#define HBS1632_SPANS_MAX	8
+
+struct hbs1632_span {
+	u8 addr;
+	u8 len;
+};
+
+/*
+ * Collect the ranges where @mem differs from @shadow in the first @size
+ * bytes. Ranges separated by no more unchanged bytes than a new
+ * transaction would cost are merged; once @max spans are used the last
+ * one grows to cover the remaining changes. Returns the number of spans.
+ */
+static inline int hbs1632_diff(const u8 *shadow, const u8 *mem, int size,
+			struct hbs1632_span *spans, int max)
+{
+	int i, n = 0, end = 0;
+
+	for (i = 0; i < size; i++) {
+		if (shadow[i] == mem[i])
+			continue;
+
+		if (n && (i - end <= HBS1632_SPAN_OVERHEAD || n == max)) {
+			spans[n - 1].len = i + 1 - spans[n - 1].addr;
+		} else {
+			spans[n].addr = i;
+			spans[n].len = 1;
+			n++;
+		}
+		end = i + 1;
+	}
+
+	return n;
+}
+
+/*
+ * Build the payload of one RAM write for @span into @buf, which must hold
+ * span->len + 1 bytes: the start address followed by the data.
+ * Returns the payload length.
+ */
+static inline int hbs1632_encode(const u8 *mem, const struct hbs1632_span *span,
+			u8 *buf)
+{
+	buf[0] = span->addr;
+	memcpy(buf + 1, mem + span->addr, span->len);
+
+	return span->len + 1;
+}
+
+/* bytes clocked out on the bus for @n spans, device addresses included */
+static inline int hbs1632_wire_bytes(const struct hbs1632_span *spans, int n)
+{
+	int i, bytes = 0;
+
+	for (i = 0; i < n; i++)
+		bytes += HBS1632_SPAN_OVERHEAD + spans[i].len;
+
+	return bytes;
+}
+
+#endif  /* ifndef _HBS1632_FLUSH_H_ */
@@ -0,0 +1,543 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/utsname.h>
+#include "render.h"
+#include "service.h"
+#include "spectrum.h"
+#include "tracker.h"
+#include "filterbank.h"
+#include "view.h"
+#include "player.h"
+#include "playlist.h"
+#include "image.h"
+
+// 热路径基准, 主机上编译运行: make bench CROSS_COMPILE=
+// 输出都写到 LR_NULL_NODE (/dev/null), 测的是编码和计算, 不含总线
+//
+//  ./bench [-r 轮数] [-w 基线文件] [-c 基线文件] [名字前缀]
+//
+// 每项先把单轮次数调到至少 BENCH_MIN_NS, 再跑若干轮, 报每次操作的中位数和 p99
+// -w 把中位数写成基线, -c 与基线比较, 中位数慢 BENCH_SLACK% 以上算回退, 退出码为 1
+// 仓库里的 bench.baseline 是开发机上的, 第一行注释记着机器; 换了机器先 -w 重写一份
+#define BENCH_REPS      51
+#define BENCH_MIN_NS    200000
+#define BENCH_SLACK     10
+#define BENCH_MAX       64
+
+#define RATE            44100
+
+typedef struct bench_case {
+    const char* name;
+    int arg;
+    int (*setup)(int arg);
+    void (*run)(int n);
+    void (*teardown)(void);
+} bench_case;
+
+static led_render* lr;
+static spectrum_ctx* sc;
+static band_tracker* bt;
+static filter_bank* fb;
+static led_view view;
+static effect_player ep;
+static playlist pl;
+static ws_amp_t amps[8192 / 2 + 1];
+static ws_amp_t bands[SHARED_BANDS];
+static int levels[VIEW_COLS_MAX];
+static short pcm[8192];
+static int64_t now;
+static const band_layout layout = { SHARED_BANDS, BAND_FMIN, BAND_FMAX };
+static volatile int sink;
+
+static double elapsed_ns(struct timespec* t0, struct timespec* t1)
+{
+    return (t1->tv_sec - t0->tv_sec) * 1e9 + (t1->tv_nsec - t0->tv_nsec);
+}
+
+static void fill_input(void)
+{
+    int i;
+
+    srand(1);
+    for (i = 0; i < sizeof(pcm) / sizeof(pcm[0]); i++)
+        pcm[i] = rand() % 20000 - 10000;
+    for (i = 0; i < sizeof(amps) / sizeof(amps[0]); i++)
+        amps[i] = rand() % 100;
+    for (i = 0; i < SHARED_BANDS; i++)
+        bands[i] = rand() % 128;
+    for (i = 0; i < VIEW_COLS_MAX; i++)
+        levels[i] = rand() % 16;
+}
+
+static int setup_render(int degree)
+{
+    lr = lr_create(LR_NULL_NODE, 16, 16);
+    if (!lr)
+        return -1;
+
+    return lr_orient(lr, degree, degree != 0);
+}
+
+static void teardown_render(void)
+{
+    lr_destroy(lr);
+    lr = NULL;
+}
+
+static void run_sram(int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+        lr_sram(lr, i & 15, (i >> 4) & 15, (i >> 8) & 1);
+}
+
+static void run_fill(int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+        lr_fill(lr, i & 15, (i >> 4) & 15, (i >> 8) & 1);
+}
+
+static void run_flush(int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+        lr->data[i & 31] ^= 1;
+        lr_flush(lr);
+    }
+}
+
+// 每帧只变一个字节, 走按地址写
+static void run_update(int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+        lr->data[i & 31] ^= 1;
+        sink += lr_update(lr);
+    }
+}
+
+// 整条命令路径: 解析 + 持锁执行, 设备线程在后台空转
+static int setup_ctrl(int arg)
+{
+    return uni_hal_led_register(LR_NULL_NODE);
+}
+
+static void teardown_ctrl(void)
+{
+    uni_hal_led_unregister(LR_NULL_NODE);
+}
+
+static void run_ctrl(int n)
+{
+    int i, fd, null;
+
+    // 服务打开了 DEBUG, 计时期间把 stdout 丢掉
+    fflush(stdout);
+    fd = dup(1);
+    null = open("/dev/null", O_WRONLY);
+    dup2(null, 1);
+    close(null);
+    for (i = 0; i < n; i++)
+        sink += uni_hal_led_ctrl(LR_NULL_NODE, "Wave Decay 1");
+    fflush(stdout);
+    dup2(fd, 1);
+    close(fd);
+}
+
+static int setup_spectrum(int nfft)
+{
+    spectrum_config conf = {
+        RATE, nfft, 0, 0, SHARED_BANDS, BAND_FMIN, BAND_FMAX, WS_WINDOW_HANN
+    };
+
+    sc = sc_create(&conf);
+    return sc ? 0 : -1;
+}
+
+static void teardown_spectrum(void)
+{
+    sc_destroy(sc);
+    sc = NULL;
+}
+
+// 每次喂一个帧移, 正好出一帧频谱
+static void run_spectrum(int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+        sink += sc_feed(sc, pcm, sc->conf.hop, UNI_HAL_LED_S16, 1);
+}
+
+static int setup_reduce(int nfft)
+{
+    return setup_spectrum(nfft);
+}
+
+static void run_reduce(int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+        bm_reduce(sc->bm, amps, sc->bands);
+}
+
+static int setup_tracker(int block)
+{
+    bt = bt_create(RATE, block, SHARED_BANDS, BAND_FMIN, BAND_FMAX);
+    return bt ? 0 : -1;
+}
+
+static void teardown_tracker(void)
+{
+    bt_destroy(bt);
+    bt = NULL;
+}
+
+static void run_tracker(int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+        sink += bt_feed(bt, pcm, bt->block, UNI_HAL_LED_S16, 1);
+}
+
+static int setup_filter(int block)
+{
+    fb = fb_create(RATE, block, SHARED_BANDS, BAND_FMIN, BAND_FMAX, 60);
+    return fb ? 0 : -1;
+}
+
+static void teardown_filter(void)
+{
+    fb_destroy(fb);
+    fb = NULL;
+}
+
+static void run_filter(int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+        sink += fb_feed(fb, pcm, fb->block, UNI_HAL_LED_S16, 1);
+}
+
+static int setup_view(int style)
+{
+    static const char* styles[] = { "Style Bars", "Style Dots", "Style Peak" };
+
+    if (setup_render(0) < 0)
+        return -1;
+
+    lv_init(&view, &layout, 16);
+    return lv_ctrl(&view, styles[style]);
+}
+
+// 频段映射到柱 + 画进显存, 不刷新
+static void run_view(int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+        bands[i % SHARED_BANDS] = (i * 37) & 127;
+        lv_levels(&view, bands, levels);
+        lv_draw(&view, lr, levels);
+    }
+}
+
+static const char* effects[] = { "love", "bars", "clock" };
+
+static int setup_effect(int arg)
+{
+    memset(&ep, 0, sizeof(ep));
+    now = ep_now();
+    return ep_start(&ep, effects[arg], 16, 16, NULL);
+}
+
+static void teardown_effect(void)
+{
+    ep_stop(&ep);
+}
+
+// 每次都推进一秒, 保证到期重画
+static void run_effect(int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+        levels[i & 15] ^= 7;
+        now += 1000000000LL;
+        if (ep.ops->fps == 0)
+            ep_event(&ep, LED_EFFECT_CTRL, NULL);
+        sink += ep_frame(&ep, now, levels, 16);
+    }
+}
+
+// 两项各 1 秒, 过渡各占一半, 按合成帧率推进
+static int setup_playlist(int arg)
+{
+    pl_init(&pl, 16, 16);
+    if (pl_add(&pl, "bars 1 Dissolve 500") < 0 || pl_add(&pl, "clock 1 Wipe 500") < 0)
+        return -1;
+
+    now = ep_now();
+    return pl_start(&pl, now);
+}
+
+static void teardown_playlist(void)
+{
+    pl_stop(&pl);
+}
+
+static void run_playlist(int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+        levels[i & 15] ^= 7;
+        now += 1000000000LL / PL_FPS;
+        sink += pl_frame(&pl, now, levels, 16);
+    }
+}
+
+// 320x240 灰度帧缩到 16x16 再抖动, 不含解码
+#define IMAGE_W     320
+#define IMAGE_H     240
+
+static unsigned char* image;
+static uint32_t image_acc[IMAGE_W];
+static im_dither_t image_mode;
+
+static int setup_image(int arg)
+{
+    int i;
+
+    image = malloc(IMAGE_W * IMAGE_H);
+    if (!image)
+        return -1;
+    for (i = 0; i < IMAGE_W * IMAGE_H; i++)
+        image[i] = i * 7 + (i / IMAGE_W) * 13;
+    image_mode = arg;
+
+    return 0;
+}
+
+static void teardown_image(void)
+{
+    free(image);
+    image = NULL;
+}
+
+static void run_image(int n)
+{
+    unsigned char small[16 * 16], bits[32];
+    int i;
+
+    for (i = 0; i < n; i++) {
+        image[i % (IMAGE_W * IMAGE_H)]++;
+        im_downscale(image, IMAGE_W, IMAGE_H, IMAGE_W, small, 16, 16, image_acc);
+        im_dither(small, 16, 16, image_mode, 128, bits, 2);
+        sink += bits[i & 31];
+    }
+}
+
+static const bench_case cases[] = {
+    { "lr_sram",            0,    setup_render,   run_sram,     teardown_render },
+    { "lr_fill",            0,    setup_render,   run_fill,     teardown_render },
+    { "lr_flush",           0,    setup_render,   run_flush,    teardown_render },
+    { "lr_flush/rot90",     90,   setup_render,   run_flush,    teardown_render },
+    { "lr_update/1byte",    0,    setup_render,   run_update,   teardown_render },
+    { "ctrl/wave_decay",    0,    setup_ctrl,     run_ctrl,     teardown_ctrl },
+    { "spectrum/256",       256,  setup_spectrum, run_spectrum, teardown_spectrum },
+    { "spectrum/512",       512,  setup_spectrum, run_spectrum, teardown_spectrum },
+    { "spectrum/1024",      1024, setup_spectrum, run_spectrum, teardown_spectrum },
+    { "spectrum/2048",      2048, setup_spectrum, run_spectrum, teardown_spectrum },
+    { "bm_reduce/512",      512,  setup_reduce,   run_reduce,   teardown_spectrum },
+    { "bm_reduce/2048",     2048, setup_reduce,   run_reduce,   teardown_spectrum },
+    { "goertzel/256",       256,  setup_tracker,  run_tracker,  teardown_tracker },
+    { "filter/64",          64,   setup_filter,   run_filter,   teardown_filter },
+    { "scene/bars",         0,    setup_view,     run_view,     teardown_render },
+    { "scene/dots",         1,    setup_view,     run_view,     teardown_render },
+    { "scene/peak",         2,    setup_view,     run_view,     teardown_render },
+    { "scene/love",         0,    setup_effect,   run_effect,   teardown_effect },
+    { "scene/bars_effect",  1,    setup_effect,   run_effect,   teardown_effect },
+    { "scene/clock",        2,    setup_effect,   run_effect,   teardown_effect },
+    { "scene/playlist",     0,    setup_playlist, run_playlist, teardown_playlist },
+    { "image/threshold",    IM_THRESHOLD, setup_image, run_image, teardown_image },
+    { "image/floyd",        IM_FLOYD,     setup_image, run_image, teardown_image },
+    { "image/ordered",      IM_ORDERED,   setup_image, run_image, teardown_image },
+};
+#define CASE_COUNT (sizeof(cases) / sizeof(cases[0]))
+
+static int cmp_double(const void* a, const void* b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static double time_batch(const bench_case* bc, int n)
+{
+    struct timespec t0, t1;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    bc->run(n);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    return elapsed_ns(&t0, &t1);
+}
+
+// 结果按 ns/op 写到 median 和 p99, 返回单轮次数, 失败返回 -1
+static int run_case(const bench_case* bc, int reps, double* median, double* p99)
+{
+    double t[1024];
+    int n = 1, i;
+
+    if (bc->setup && bc->setup(bc->arg) < 0) {
+        fprintf(stderr, "error: [BENCH] setup %s\n", bc->name);
+        return -1;
+    }
+
+    // 先热身, 同时把单轮次数调到足够长
+    while (time_batch(bc, n) < BENCH_MIN_NS && n < (1 << 24))
+        n *= 2;
+
+    for (i = 0; i < reps; i++)
+        t[i] = time_batch(bc, n) / n;
+
+    if (bc->teardown)
+        bc->teardown();
+
+    qsort(t, reps, sizeof(t[0]), cmp_double);
+    *median = t[reps / 2];
+    *p99 = t[(reps * 99) / 100];
+
+    return n;
+}
+
+typedef struct baseline {
+    char name[32];
+    double median;
+} baseline;
+
+static int load_baseline(const char* path, baseline* base)
+{
+    char line[128];
+    FILE* f;
+    int n = 0;
+
+    f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "error: [BENCH] open %s\n", path);
+        return -1;
+    }
+
+    // '#' 开头的是记录机器的注释行
+    while (n < BENCH_MAX && fgets(line, sizeof(line), f)) {
+        if (line[0] != '#' && sscanf(line, "%31s %lf", base[n].name, &base[n].median) == 2)
+            n++;
+    }
+
+    fclose(f);
+    return n;
+}
+
+static const baseline* find_baseline(const baseline* base, int nr, const char* name)
+{
+    int i;
+
+    for (i = 0; i < nr; i++) {
+        if (strcmp(base[i].name, name) == 0)
+            return &base[i];
+    }
+
+    return NULL;
+}
+
+int main(int argc, char* argv[])
+{
+    baseline base[BENCH_MAX], out[BENCH_MAX];
+    const char* write_path = NULL;
+    const char* filter = NULL;
+    const baseline* b;
+    double median, p99;
+    int reps = BENCH_REPS;
+    int nr_base = 0, nr_out = 0, regress = 0;
+    int i, n, opt;
+
+    while ((opt = getopt(argc, argv, "r:w:c:")) != -1) {
+        switch (opt) {
+        case 'r':
+            reps = atoi(optarg);
+            break;
+        case 'w':
+            write_path = optarg;
+            break;
+        case 'c':
+            nr_base = load_baseline(optarg, base);
+            if (nr_base < 0)
+                return 2;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-r reps] [-w baseline] [-c baseline] [prefix]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (optind < argc)
+        filter = argv[optind];
+    if (reps < 1 || reps > 1024)
+        reps = BENCH_REPS;
+
+    fill_input();
+
+    printf("%-20s %10s %10s %10s %8s\n", "case", "batch", "median", "p99", "base");
+    for (i = 0; i < CASE_COUNT; i++) {
+        if (filter && strncmp(cases[i].name, filter, strlen(filter)))
+            continue;
+
+        n = run_case(&cases[i], reps, &median, &p99);
+        if (n < 0)
+            continue;
+
+        printf("%-20s %10d %10.1f %10.1f", cases[i].name, n, median, p99);
+        b = find_baseline(base, nr_base, cases[i].name);
+        if (b) {
+            double delta = (median - b->median) * 100 / b->median;
+
+            printf(" %+7.1f%%%s", delta, delta > BENCH_SLACK ? " REGRESSION" : "");
+            regress |= delta > BENCH_SLACK;
+        }
+        printf("\n");
+
+        strncpy(out[nr_out].name, cases[i].name, sizeof(out[0].name));
+        out[nr_out++].median = median;
+    }
+
+    if (write_path) {
+        FILE* f = fopen(write_path, "w");
+        struct utsname host;
+
+        if (!f) {
+            fprintf(stderr, "error: [BENCH] open %s\n", write_path);
+            return 2;
+        }
+        // 基线只在同一台机器上可比, 记下是在哪跑的
+        if (uname(&host) == 0)
+            fprintf(f, "# %s %s %s\n", host.nodename, host.machine, host.release);
+        for (i = 0; i < nr_out; i++)
+            fprintf(f, "%s %.1f\n", out[i].name, out[i].median);
+        fclose(f);
+    }
+
+    return regress;
+}
@@ -0,0 +1,233 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <pthread.h>
+#include "clock.h"
+
+#define LC_SLEEPERS 16
+
+// 虚拟时钟上睡着的线程, due 由 lc_advance 置位, 由睡眠者自己释放
+typedef struct lc_sleeper {
+    bool used;
+    bool due;
+    int64_t deadline;       // 单调时间
+} lc_sleeper;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t tick = PTHREAD_COND_INITIALIZER;     // 有睡眠者到期
+static pthread_cond_t idle = PTHREAD_COND_INITIALIZER;     // running 变成 0
+// 系统时钟下可以被 lc_kick 打断的睡眠, 分别按 CLOCK_MONOTONIC 和 CLOCK_REALTIME 计时
+static pthread_once_t kick_once = PTHREAD_ONCE_INIT;
+static pthread_cond_t kick[2];
+static volatile bool virtual_clock;
+static int64_t vnow;
+static int64_t voffset;     // 墙上时间 - 单调时间
+static lc_sleeper sleepers[LC_SLEEPERS];
+// 已唤醒 (或已创建) 还没再睡下的线程数, lc_advance 等它归零再前进
+static int running;
+static int attaching;
+static __thread bool counted;
+
+int64_t lc_now(clockid_t clock)
+{
+    struct timespec ts;
+    int64_t ns;
+
+    if (!virtual_clock) {
+        clock_gettime(clock, &ts);
+        return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    }
+
+    pthread_mutex_lock(&lock);
+    ns = vnow + (clock == CLOCK_REALTIME ? voffset : 0);
+    pthread_mutex_unlock(&lock);
+
+    return ns;
+}
+
+time_t lc_time(void)
+{
+    return virtual_clock ? lc_now(CLOCK_REALTIME) / 1000000000LL : time(NULL);
+}
+
+// 持锁调用, 本线程不再算作运行中
+static void release(void)
+{
+    if (counted) {
+        counted = false;
+        running--;
+    }
+    else if (attaching > 0) {
+        attaching--;
+        running--;
+    }
+    else {
+        return;
+    }
+
+    if (!running)
+        pthread_cond_broadcast(&idle);
+}
+
+static void kick_init(void)
+{
+    pthread_condattr_t attr;
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&kick[0], &attr);
+    pthread_condattr_setclock(&attr, CLOCK_REALTIME);
+    pthread_cond_init(&kick[1], &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+void lc_sleep_until(clockid_t clock, int64_t ns)
+{
+    lc_sleep_until_stop(clock, ns, NULL);
+}
+
+void lc_sleep_until_stop(clockid_t clock, int64_t ns, const volatile bool* stop)
+{
+    struct timespec ts;
+    lc_sleeper* s;
+
+    if (!virtual_clock) {
+        ts.tv_sec = ns / 1000000000LL;
+        ts.tv_nsec = ns % 1000000000LL;
+        if (!stop) {
+            while (clock_nanosleep(clock, TIMER_ABSTIME, &ts, NULL) == EINTR)
+                ;
+            return;
+        }
+
+        pthread_once(&kick_once, kick_init);
+        pthread_mutex_lock(&lock);
+        while (!*stop) {
+            if (pthread_cond_timedwait(&kick[clock == CLOCK_REALTIME], &lock, &ts) == ETIMEDOUT)
+                break;
+        }
+        pthread_mutex_unlock(&lock);
+        return;
+    }
+
+    pthread_mutex_lock(&lock);
+    if (clock == CLOCK_REALTIME)
+        ns -= voffset;
+    // 已经到期或要退出就直接返回, 仍然算运行中
+    if (ns <= vnow || (stop && *stop)) {
+        pthread_mutex_unlock(&lock);
+        return;
+    }
+
+    for (s = sleepers; s < sleepers + LC_SLEEPERS && s->used; s++)
+        ;
+    if (s == sleepers + LC_SLEEPERS) {
+        pthread_mutex_unlock(&lock);
+        fprintf(stderr, "error: [LC] too many sleepers\n");
+        return;
+    }
+
+    release();
+    s->used = true;
+    s->due = false;
+    s->deadline = ns;
+    while (!s->due && !(stop && *stop))
+        pthread_cond_wait(&tick, &lock);
+    // lc_advance 唤醒时已经替本线程计了数, 被 lc_kick 叫醒的自己计
+    if (!s->due)
+        running++;
+    s->used = false;
+    counted = true;
+    pthread_mutex_unlock(&lock);
+}
+
+void lc_kick(void)
+{
+    pthread_once(&kick_once, kick_init);
+    pthread_mutex_lock(&lock);
+    pthread_cond_broadcast(&tick);
+    pthread_cond_broadcast(&kick[0]);
+    pthread_cond_broadcast(&kick[1]);
+    pthread_mutex_unlock(&lock);
+}
+
+void lc_attach(void)
+{
+    pthread_mutex_lock(&lock);
+    attaching++;
+    running++;
+    pthread_mutex_unlock(&lock);
+}
+
+void lc_detach(void)
+{
+    pthread_mutex_lock(&lock);
+    if (attaching > 0) {
+        attaching--;
+        if (!--running)
+            pthread_cond_broadcast(&idle);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+void lc_exit(void)
+{
+    pthread_mutex_lock(&lock);
+    release();
+    pthread_mutex_unlock(&lock);
+}
+
+void lc_virtual(int64_t realtime_ns)
+{
+    pthread_mutex_lock(&lock);
+    vnow = LC_VIRTUAL_BASE;
+    voffset = realtime_ns - vnow;
+    virtual_clock = true;
+    pthread_mutex_unlock(&lock);
+}
+
+void lc_system(void)
+{
+    virtual_clock = false;
+}
+
+int64_t lc_advance(int64_t ns)
+{
+    int64_t target, next;
+    lc_sleeper* s;
+    int woke;
+
+    if (!virtual_clock)
+        return -1;
+
+    pthread_mutex_lock(&lock);
+    target = vnow + ns;
+    do {
+        while (running > 0)
+            pthread_cond_wait(&idle, &lock);
+
+        next = target;
+        for (s = sleepers; s < sleepers + LC_SLEEPERS; s++) {
+            if (s->used && !s->due && s->deadline < next)
+                next = s->deadline;
+        }
+        vnow = next;
+
+        woke = 0;
+        for (s = sleepers; s < sleepers + LC_SLEEPERS; s++) {
+            if (s->used && !s->due && s->deadline <= vnow) {
+                s->due = true;
+                running++;
+                woke++;
+            }
+        }
+        if (woke)
+            pthread_cond_broadcast(&tick);
+    } while (vnow < target);
+
+    while (running > 0)
+        pthread_cond_wait(&idle, &lock);
+    pthread_mutex_unlock(&lock);
+
+    return target;
+}
@@ -0,0 +1,34 @@
+#ifndef _CLOCK_H_
+#define _CLOCK_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+// 服务里所有取时和定时睡眠的入口, 默认就是系统时钟
+// 换成虚拟时钟后时间只在 lc_advance 时前进, 设备线程按到期顺序逐个唤醒,
+// 几小时的场景调度可以在几秒内确定地跑完
+// clock 只支持 CLOCK_MONOTONIC 和 CLOCK_REALTIME
+int64_t lc_now(clockid_t clock);
+time_t lc_time(void);
+void lc_sleep_until(clockid_t clock, int64_t ns);
+// 同上, 另外 *stop 置位并调用 lc_kick 后提前返回, 用来让要退出的线程马上醒来
+void lc_sleep_until_stop(clockid_t clock, int64_t ns, const volatile bool* stop);
+void lc_kick(void);
+// 创建会在 lc_sleep_until 里睡的线程之前调用 lc_attach, 创建失败再 lc_detach
+// 这样 lc_advance 会等新线程第一次睡下, 线程退出前调用 lc_exit
+void lc_attach(void);
+void lc_detach(void);
+void lc_exit(void);
+
+// 切到虚拟时钟, 墙上时间从 realtime_ns 开始; 要在注册设备之前调用
+// 已经在系统时钟上睡着的线程不受影响
+#define LC_VIRTUAL_BASE 1000000000LL
+void lc_virtual(int64_t realtime_ns);
+void lc_system(void);
+
+// 虚拟时间前进 ns, 返回前进后的单调时间; 途中每到一个睡眠线程的到期时刻
+// 就唤醒它, 等所有被唤醒的线程重新睡下或退出后再继续, 系统时钟下返回 -1
+int64_t lc_advance(int64_t ns);
+
+#endif
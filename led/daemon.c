@@ -0,0 +1,251 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "daemon.h"
+
+static size_t shared_size(size_t extra)
+{
+    // 调用者的数据按 8 字节对齐放在后面
+    return ((sizeof(ld_shared) + 7) & ~7) + extra;
+}
+
+static int alive(int pid)
+{
+    return pid > 0 && (kill(pid, 0) == 0 || errno == EPERM);
+}
+
+static ld_shared* map(int fd, size_t size)
+{
+    void* p;
+
+    p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        fprintf(stderr, "error: [LD] mmap %d\n", errno);
+        return NULL;
+    }
+
+    return (ld_shared*)p;
+}
+
+ld_shared* ld_create(size_t extra)
+{
+    size_t size = shared_size(extra);
+    struct stat st;
+    ld_shared* ld;
+    int fd, i;
+
+    fd = shm_open(LD_SHM_NAME, O_RDWR | O_CREAT, LD_SHM_MODE);
+    if (fd < 0) {
+        fprintf(stderr, "error: [LD] shm_open %s %d\n", LD_SHM_NAME, errno);
+        return NULL;
+    }
+    // 旧版本留下的共享区可能更宽
+    if (fchmod(fd, LD_SHM_MODE) < 0) {
+        fprintf(stderr, "error: [LD] fchmod %s %d\n", LD_SHM_NAME, errno);
+        close(fd);
+        return NULL;
+    }
+
+    // 上一个守护进程异常退出留下的共享区直接重建
+    if (fstat(fd, &st) == 0 && st.st_size >= sizeof(ld_shared)) {
+        ld = map(dup(fd), sizeof(ld_shared));
+        if (ld) {
+            int busy = ld->magic == LD_MAGIC && alive(ld->pid);
+
+            munmap(ld, sizeof(ld_shared));
+            if (busy) {
+                fprintf(stderr, "error: [LD] daemon already running\n");
+                close(fd);
+                return NULL;
+            }
+        }
+    }
+
+    if (ftruncate(fd, 0) < 0 || ftruncate(fd, size) < 0) {
+        fprintf(stderr, "error: [LD] ftruncate %d\n", errno);
+        close(fd);
+        return NULL;
+    }
+
+    ld = map(fd, size);
+    if (!ld)
+        return NULL;
+
+    if (sem_init(&ld->ready, 1, 0) < 0) {
+        fprintf(stderr, "error: [LD] sem_init %d\n", errno);
+        ld_destroy(ld);
+        return NULL;
+    }
+    for (i = 0; i < LD_CMD_SLOTS; i++)
+        ld->cmds[i].seq = i;
+    ld->size = size;
+    ld->pid = getpid();
+    // magic 最后写, 客户端看到它时其余字段都已就绪
+    __sync_synchronize();
+    ld->magic = LD_MAGIC;
+
+    return ld;
+}
+
+ld_shared* ld_attach(size_t extra)
+{
+    size_t size = shared_size(extra);
+    struct stat st;
+    ld_shared* ld;
+    int fd;
+
+    fd = shm_open(LD_SHM_NAME, O_RDWR, 0);
+    if (fd < 0)
+        return NULL;
+
+    if (fstat(fd, &st) < 0 || st.st_size < sizeof(ld_shared)
+        || (extra && st.st_size != size)) {
+        close(fd);
+        return NULL;
+    }
+
+    size = st.st_size;
+    ld = map(fd, size);
+    if (!ld)
+        return NULL;
+
+    if (ld->magic != LD_MAGIC || ld->size != size || !alive(ld->pid)) {
+        munmap(ld, size);
+        return NULL;
+    }
+
+    return ld;
+}
+
+void ld_detach(ld_shared* ld)
+{
+    if (ld)
+        munmap(ld, ld->size);
+}
+
+int ld_alive(const ld_shared* ld)
+{
+    return ld && ld->magic == LD_MAGIC && alive(ld->pid);
+}
+
+void ld_destroy(ld_shared* ld)
+{
+    if (ld) {
+        ld->magic = 0;
+        sem_destroy(&ld->ready);
+        munmap(ld, ld->size);
+        shm_unlink(LD_SHM_NAME);
+    }
+}
+
+void* ld_extra(ld_shared* ld)
+{
+    return (char*)ld + ((sizeof(ld_shared) + 7) & ~7);
+}
+
+int ld_add_device(ld_shared* ld, const char* name)
+{
+    int i;
+
+    for (i = 0; i < LD_DEVS; i++) {
+        if (!ld->devices[i][0]) {
+            strncpy(ld->devices[i], name, LD_NAME_SIZE - 1);
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+int ld_has_device(const ld_shared* ld, const char* name)
+{
+    int i;
+
+    for (i = 0; i < LD_DEVS; i++) {
+        if (ld->devices[i][0] && strncmp(ld->devices[i], name, LD_NAME_SIZE) == 0)
+            return 1;
+    }
+
+    return 0;
+}
+
+// 每格的 seq: 等于领号时可写, 等于领号 + 1 时可读, 读完加上 LD_CMD_SLOTS 留给下一圈
+int ld_push(ld_shared* ld, const char* name, const char* cmd)
+{
+    unsigned int pos;
+    ld_cmd* c;
+    int dif;
+
+    for (;;) {
+        pos = ld->head;
+        c = &ld->cmds[pos % LD_CMD_SLOTS];
+        dif = (int)(c->seq - pos);
+        if (dif == 0) {
+            if (__sync_bool_compare_and_swap(&ld->head, pos, pos + 1))
+                break;
+        }
+        else if (dif < 0) {
+            return -1;
+        }
+    }
+
+    strncpy(c->name, name, LD_NAME_SIZE - 1);
+    c->name[LD_NAME_SIZE - 1] = 0;
+    strncpy(c->cmd, cmd, LD_CMD_SIZE - 1);
+    c->cmd[LD_CMD_SIZE - 1] = 0;
+    __sync_synchronize();
+    c->seq = pos + 1;
+
+    // 守护进程忙着时不进内核, 只有它准备睡时才叫醒一次
+    __sync_synchronize();
+    if (ld->waiting && __sync_bool_compare_and_swap(&ld->waiting, 1, 0))
+        sem_post(&ld->ready);
+    return 0;
+}
+
+int ld_pop(ld_shared* ld, char* name, char* cmd)
+{
+    unsigned int pos = ld->tail;
+    ld_cmd* c = &ld->cmds[pos % LD_CMD_SLOTS];
+
+    if ((int)(c->seq - (pos + 1)) < 0)
+        return 0;
+
+    __sync_synchronize();
+    memcpy(name, c->name, LD_NAME_SIZE);
+    memcpy(cmd, c->cmd, LD_CMD_SIZE);
+    __sync_synchronize();
+    c->seq = pos + LD_CMD_SLOTS;
+    ld->tail = pos + 1;
+
+    return 1;
+}
+
+// 先声明要睡再检查一次环, 和 ld_push 的先写后查配对, 不会丢唤醒
+// 多出来的 post 只会让下一次等待空转一圈
+void ld_wait(ld_shared* ld)
+{
+    ld_cmd* c = &ld->cmds[ld->tail % LD_CMD_SLOTS];
+
+    ld->waiting = 1;
+    __sync_synchronize();
+    if ((int)(c->seq - (ld->tail + 1)) >= 0) {
+        ld->waiting = 0;
+        return;
+    }
+
+    while (sem_wait(&ld->ready) < 0 && errno == EINTR)
+        ;
+}
+
+void ld_wake(ld_shared* ld)
+{
+    sem_post(&ld->ready);
+}
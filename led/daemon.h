@@ -0,0 +1,61 @@
+#ifndef _DAEMON_H_
+#define _DAEMON_H_
+
+#include <stddef.h>
+#include <semaphore.h>
+
+// 多进程共用设备: 一个守护进程持有设备, 其他进程通过共享内存和它通信
+// 命令走多生产者单消费者的环 (有界, 每格带序号), 写一格就算发出, 不等执行结果
+// 共享区后面跟着调用者自己的数据 (服务放频段快照), 大小由 extra 给出
+#define LD_SHM_NAME     "/uni_led"
+// 能写环的进程就能让守护进程执行命令, 只给同一用户
+#define LD_SHM_MODE     0600
+#define LD_MAGIC        0x4c454431
+#define LD_CMD_SLOTS    64
+#define LD_CMD_SIZE     112
+#define LD_NAME_SIZE    16
+#define LD_DEVS         4
+
+typedef struct ld_cmd {
+    volatile unsigned int seq;
+    char name[LD_NAME_SIZE];
+    char cmd[LD_CMD_SIZE];
+} ld_cmd;
+
+typedef struct ld_shared {
+    unsigned int magic;
+    unsigned int size;
+    int pid;                            // 守护进程, 客户端据此判断是否还活着
+    char devices[LD_DEVS][LD_NAME_SIZE];
+
+    sem_t ready;
+    volatile int waiting;               // 守护进程要睡了, 生产者这时才 post
+    volatile unsigned int head;         // 生产者领号
+    volatile unsigned int tail;         // 只有守护进程改
+    ld_cmd cmds[LD_CMD_SLOTS];
+} ld_shared;
+
+// 守护进程建共享区, 已有活着的守护进程时失败
+ld_shared* ld_create(size_t extra);
+// 客户端接入, 没有守护进程或布局对不上时返回 NULL, extra 为 0 时不比较大小
+ld_shared* ld_attach(size_t extra);
+void ld_detach(ld_shared* ld);
+// 守护进程还在用这块共享区; 它退出 (或异常退出后重启换了一块) 后客户端要重新接入
+int ld_alive(const ld_shared* ld);
+// 守护进程退出时调用, 同时删掉共享区
+void ld_destroy(ld_shared* ld);
+
+void* ld_extra(ld_shared* ld);
+
+int ld_add_device(ld_shared* ld, const char* name);
+int ld_has_device(const ld_shared* ld, const char* name);
+
+// 环满时返回 -1, 命令过长时截断
+int ld_push(ld_shared* ld, const char* name, const char* cmd);
+// 取一条命令, 没有时返回 0; name/cmd 至少 LD_NAME_SIZE/LD_CMD_SIZE
+int ld_pop(ld_shared* ld, char* name, char* cmd);
+// 等到有命令或被 ld_wake 叫醒
+void ld_wait(ld_shared* ld);
+void ld_wake(ld_shared* ld);
+
+#endif
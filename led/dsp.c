@@ -0,0 +1,608 @@
+#include <math.h>
+#include <string.h>
+#include <stdint.h>
+#include "dsp.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define USE_NEON
+#endif
+
+// log2(1 + t), t in [0, 1), 4 阶最小二乘拟合, 误差 < 1.2e-4
+#define LOG2_C1   1.43863803f
+#define LOG2_C2  -0.677743267f
+#define LOG2_C3   0.321879707f
+#define LOG2_C4  -0.0828606983f
+
+static float fast_log2(float x)
+{
+    union { float f; uint32_t u; } v;
+    float e, t;
+
+    v.f = x;
+    e = (float)((int)(v.u >> 23) - 127);
+    v.u = (v.u & 0x007FFFFF) | 0x3F800000;
+    t = v.f - 1.0f;
+
+    return e + t * (LOG2_C1 + t * (LOG2_C2 + t * (LOG2_C3 + t * LOG2_C4)));
+}
+
+static void mag_db_scalar(const float* cpx, int n, float gain,
+                        float* mag, float* db)
+{
+    float p, offset = 2 * log2f(gain);
+    int i;
+
+    for (i = 0; i < n; i++) {
+        p = cpx[2 * i] * cpx[2 * i] + cpx[2 * i + 1] * cpx[2 * i + 1];
+        mag[i] = gain * sqrtf(p);
+        if (db) {
+            p = p > DSP_POWER_FLOOR ? p : DSP_POWER_FLOOR;
+            db[i] = DSP_DB_PER_LOG2 * (fast_log2(p) + offset);
+        }
+    }
+}
+
+#if defined(__AVX2__)
+static __m256 log2_ps(__m256 x)
+{
+    __m256i u = _mm256_castps_si256(x);
+    __m256 e = _mm256_cvtepi32_ps(_mm256_sub_epi32(
+                    _mm256_srli_epi32(u, 23), _mm256_set1_epi32(127)));
+    __m256 t = _mm256_sub_ps(_mm256_castsi256_ps(_mm256_or_si256(
+                    _mm256_and_si256(u, _mm256_set1_epi32(0x007FFFFF)),
+                    _mm256_set1_epi32(0x3F800000))), _mm256_set1_ps(1.0f));
+    __m256 r = _mm256_set1_ps(LOG2_C4);
+
+    r = _mm256_add_ps(_mm256_mul_ps(r, t), _mm256_set1_ps(LOG2_C3));
+    r = _mm256_add_ps(_mm256_mul_ps(r, t), _mm256_set1_ps(LOG2_C2));
+    r = _mm256_add_ps(_mm256_mul_ps(r, t), _mm256_set1_ps(LOG2_C1));
+    return _mm256_add_ps(e, _mm256_mul_ps(r, t));
+}
+
+void dsp_mag_db(const float* cpx, int n, float gain, float* mag, float* db)
+{
+    const __m256 vgain = _mm256_set1_ps(gain);
+    const __m256 vfloor = _mm256_set1_ps(DSP_POWER_FLOOR);
+    const __m256 vscale = _mm256_set1_ps(DSP_DB_PER_LOG2);
+    const __m256 voffset = _mm256_set1_ps(2 * log2f(gain));
+    int i;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        __m256 a = _mm256_loadu_ps(cpx + 2 * i);
+        __m256 b = _mm256_loadu_ps(cpx + 2 * i + 8);
+        // hadd 后 128 位两半交叉, 再按 64 位重排回顺序
+        __m256 p = _mm256_hadd_ps(_mm256_mul_ps(a, a), _mm256_mul_ps(b, b));
+
+        p = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(p),
+                                            _MM_SHUFFLE(3, 1, 2, 0)));
+        _mm256_storeu_ps(mag + i, _mm256_mul_ps(vgain, _mm256_sqrt_ps(p)));
+        if (db) {
+            p = log2_ps(_mm256_max_ps(p, vfloor));
+            _mm256_storeu_ps(db + i, _mm256_mul_ps(vscale, _mm256_add_ps(p, voffset)));
+        }
+    }
+
+    mag_db_scalar(cpx + 2 * i, n - i, gain, mag + i, db ? db + i : NULL);
+}
+#elif defined(__SSE2__)
+static __m128 log2_ps(__m128 x)
+{
+    __m128i u = _mm_castps_si128(x);
+    __m128 e = _mm_cvtepi32_ps(_mm_sub_epi32(
+                    _mm_srli_epi32(u, 23), _mm_set1_epi32(127)));
+    __m128 t = _mm_sub_ps(_mm_castsi128_ps(_mm_or_si128(
+                    _mm_and_si128(u, _mm_set1_epi32(0x007FFFFF)),
+                    _mm_set1_epi32(0x3F800000))), _mm_set1_ps(1.0f));
+    __m128 r = _mm_set1_ps(LOG2_C4);
+
+    r = _mm_add_ps(_mm_mul_ps(r, t), _mm_set1_ps(LOG2_C3));
+    r = _mm_add_ps(_mm_mul_ps(r, t), _mm_set1_ps(LOG2_C2));
+    r = _mm_add_ps(_mm_mul_ps(r, t), _mm_set1_ps(LOG2_C1));
+    return _mm_add_ps(e, _mm_mul_ps(r, t));
+}
+
+void dsp_mag_db(const float* cpx, int n, float gain, float* mag, float* db)
+{
+    const __m128 vgain = _mm_set1_ps(gain);
+    const __m128 vfloor = _mm_set1_ps(DSP_POWER_FLOOR);
+    const __m128 vscale = _mm_set1_ps(DSP_DB_PER_LOG2);
+    const __m128 voffset = _mm_set1_ps(2 * log2f(gain));
+    int i;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        __m128 a = _mm_loadu_ps(cpx + 2 * i);
+        __m128 b = _mm_loadu_ps(cpx + 2 * i + 4);
+        __m128 re = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+        __m128 im = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+        __m128 p = _mm_add_ps(_mm_mul_ps(re, re), _mm_mul_ps(im, im));
+
+        _mm_storeu_ps(mag + i, _mm_mul_ps(vgain, _mm_sqrt_ps(p)));
+        if (db) {
+            p = log2_ps(_mm_max_ps(p, vfloor));
+            _mm_storeu_ps(db + i, _mm_mul_ps(vscale, _mm_add_ps(p, voffset)));
+        }
+    }
+
+    mag_db_scalar(cpx + 2 * i, n - i, gain, mag + i, db ? db + i : NULL);
+}
+#elif defined(USE_NEON)
+static float32x4_t log2_ps(float32x4_t x)
+{
+    uint32x4_t u = vreinterpretq_u32_f32(x);
+    float32x4_t e = vcvtq_f32_s32(vsubq_s32(
+                    vreinterpretq_s32_u32(vshrq_n_u32(u, 23)), vdupq_n_s32(127)));
+    float32x4_t t = vsubq_f32(vreinterpretq_f32_u32(vorrq_u32(
+                    vandq_u32(u, vdupq_n_u32(0x007FFFFF)),
+                    vdupq_n_u32(0x3F800000))), vdupq_n_f32(1.0f));
+    float32x4_t r = vdupq_n_f32(LOG2_C4);
+
+    r = vmlaq_f32(vdupq_n_f32(LOG2_C3), r, t);
+    r = vmlaq_f32(vdupq_n_f32(LOG2_C2), r, t);
+    r = vmlaq_f32(vdupq_n_f32(LOG2_C1), r, t);
+    return vmlaq_f32(e, r, t);
+}
+
+void dsp_mag_db(const float* cpx, int n, float gain, float* mag, float* db)
+{
+    const float32x4_t vfloor = vdupq_n_f32(DSP_POWER_FLOOR);
+    const float32x4_t voffset = vdupq_n_f32(2 * log2f(gain));
+    int i;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        float32x4x2_t v = vld2q_f32(cpx + 2 * i);
+        float32x4_t p = vmlaq_f32(vmulq_f32(v.val[0], v.val[0]), v.val[1], v.val[1]);
+        float32x4_t q = vmaxq_f32(p, vfloor);
+        // ARMv7 NEON 没有 sqrt, 倒数平方根估计加两次牛顿迭代
+        float32x4_t r = vrsqrteq_f32(q);
+
+        r = vmulq_f32(r, vrsqrtsq_f32(vmulq_f32(q, r), r));
+        r = vmulq_f32(r, vrsqrtsq_f32(vmulq_f32(q, r), r));
+        vst1q_f32(mag + i, vmulq_n_f32(vmulq_f32(p, r), gain));
+        if (db) {
+            q = vaddq_f32(log2_ps(q), voffset);
+            vst1q_f32(db + i, vmulq_n_f32(q, DSP_DB_PER_LOG2));
+        }
+    }
+
+    mag_db_scalar(cpx + 2 * i, n - i, gain, mag + i, db ? db + i : NULL);
+}
+#else
+void dsp_mag_db(const float* cpx, int n, float gain, float* mag, float* db)
+{
+    mag_db_scalar(cpx, n, gain, mag, db);
+}
+#endif
+
+void dsp_mag_db_ref(const float* cpx, int n, float gain, float* mag, float* db)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+        mag[i] = gain * hypotf(cpx[2 * i], cpx[2 * i + 1]);
+        if (db)
+            db[i] = 20 * log10f(mag[i] > 1e-10f * gain ? mag[i] : 1e-10f * gain);
+    }
+}
+
+static float dot_scalar(const float* a, const float* b, int n)
+{
+    float acc = 0;
+    int i;
+
+    for (i = 0; i < n; i++)
+        acc += a[i] * b[i];
+
+    return acc;
+}
+
+#if defined(__SSE2__)
+float dsp_dot(const float* a, const float* b, int n)
+{
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    float sum[4];
+    int i;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+
+    _mm_storeu_ps(sum, _mm_add_ps(acc0, acc1));
+    return sum[0] + sum[1] + sum[2] + sum[3] + dot_scalar(a + i, b + i, n - i);
+}
+#elif defined(USE_NEON)
+float dsp_dot(const float* a, const float* b, int n)
+{
+    float32x4_t acc0 = vdupq_n_f32(0);
+    float32x4_t acc1 = vdupq_n_f32(0);
+    float32x2_t sum;
+    int i;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        acc0 = vmlaq_f32(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+        acc1 = vmlaq_f32(acc1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+    }
+
+    acc0 = vaddq_f32(acc0, acc1);
+    sum = vadd_f32(vget_low_f32(acc0), vget_high_f32(acc0));
+    return vget_lane_f32(vpadd_f32(sum, sum), 0) + dot_scalar(a + i, b + i, n - i);
+}
+#else
+float dsp_dot(const float* a, const float* b, int n)
+{
+    return dot_scalar(a, b, n);
+}
+#endif
+
+static void goertzel_scalar(const float* x, int n, const float* c,
+                        float* s1, float* s2, int nb)
+{
+    float a, b, t;
+    int i, k;
+
+    for (k = 0; k < nb; k++) {
+        a = s1[k];
+        b = s2[k];
+        for (i = 0; i < n; i++) {
+            t = x[i] + c[k] * a - b;
+            b = a;
+            a = t;
+        }
+        s1[k] = a;
+        s2[k] = b;
+    }
+}
+
+#if defined(__SSE2__)
+void dsp_goertzel(const float* x, int n, const float* c, float* s1, float* s2, int nb)
+{
+    int i, k;
+
+    for (k = 0; k + 4 <= nb; k += 4) {
+        __m128 vc = _mm_loadu_ps(c + k);
+        __m128 a = _mm_loadu_ps(s1 + k);
+        __m128 b = _mm_loadu_ps(s2 + k);
+        __m128 t;
+
+        for (i = 0; i < n; i++) {
+            t = _mm_sub_ps(_mm_add_ps(_mm_set1_ps(x[i]), _mm_mul_ps(vc, a)), b);
+            b = a;
+            a = t;
+        }
+
+        _mm_storeu_ps(s1 + k, a);
+        _mm_storeu_ps(s2 + k, b);
+    }
+
+    goertzel_scalar(x, n, c + k, s1 + k, s2 + k, nb - k);
+}
+#elif defined(USE_NEON)
+void dsp_goertzel(const float* x, int n, const float* c, float* s1, float* s2, int nb)
+{
+    int i, k;
+
+    for (k = 0; k + 4 <= nb; k += 4) {
+        float32x4_t vc = vld1q_f32(c + k);
+        float32x4_t a = vld1q_f32(s1 + k);
+        float32x4_t b = vld1q_f32(s2 + k);
+        float32x4_t t;
+
+        for (i = 0; i < n; i++) {
+            t = vsubq_f32(vmlaq_f32(vdupq_n_f32(x[i]), vc, a), b);
+            b = a;
+            a = t;
+        }
+
+        vst1q_f32(s1 + k, a);
+        vst1q_f32(s2 + k, b);
+    }
+
+    goertzel_scalar(x, n, c + k, s1 + k, s2 + k, nb - k);
+}
+#else
+void dsp_goertzel(const float* x, int n, const float* c, float* s1, float* s2, int nb)
+{
+    goertzel_scalar(x, n, c, s1, s2, nb);
+}
+#endif
+
+static void bandpass_env_scalar(const float* x, int n, const float* b0,
+                const float* a1, const float* a2, float* z1, float* z2,
+                float* env, float release, int nb)
+{
+    float y, u, v, e;
+    int i, k;
+
+    for (k = 0; k < nb; k++) {
+        u = z1[k];
+        v = z2[k];
+        e = env[k];
+        for (i = 0; i < n; i++) {
+            y = b0[k] * x[i] + u;
+            u = v - a1[k] * y;
+            v = -b0[k] * x[i] - a2[k] * y;
+            e *= release;
+            e = fabsf(y) > e ? fabsf(y) : e;
+        }
+        z1[k] = u;
+        z2[k] = v;
+        env[k] = e;
+    }
+}
+
+#if defined(__SSE2__)
+void dsp_bandpass_env(const float* x, int n, const float* b0, const float* a1,
+                const float* a2, float* z1, float* z2, float* env,
+                float release, int nb)
+{
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    const __m128 vrel = _mm_set1_ps(release);
+    int i, k;
+
+    for (k = 0; k + 4 <= nb; k += 4) {
+        __m128 vb0 = _mm_loadu_ps(b0 + k);
+        __m128 va1 = _mm_loadu_ps(a1 + k);
+        __m128 va2 = _mm_loadu_ps(a2 + k);
+        __m128 u = _mm_loadu_ps(z1 + k);
+        __m128 v = _mm_loadu_ps(z2 + k);
+        __m128 e = _mm_loadu_ps(env + k);
+
+        for (i = 0; i < n; i++) {
+            __m128 bx = _mm_mul_ps(vb0, _mm_set1_ps(x[i]));
+            __m128 y = _mm_add_ps(bx, u);
+
+            u = _mm_sub_ps(v, _mm_mul_ps(va1, y));
+            v = _mm_sub_ps(_mm_sub_ps(_mm_setzero_ps(), bx), _mm_mul_ps(va2, y));
+            e = _mm_max_ps(_mm_andnot_ps(sign, y), _mm_mul_ps(e, vrel));
+        }
+
+        _mm_storeu_ps(z1 + k, u);
+        _mm_storeu_ps(z2 + k, v);
+        _mm_storeu_ps(env + k, e);
+    }
+
+    bandpass_env_scalar(x, n, b0 + k, a1 + k, a2 + k, z1 + k, z2 + k,
+                    env + k, release, nb - k);
+}
+#elif defined(USE_NEON)
+void dsp_bandpass_env(const float* x, int n, const float* b0, const float* a1,
+                const float* a2, float* z1, float* z2, float* env,
+                float release, int nb)
+{
+    int i, k;
+
+    for (k = 0; k + 4 <= nb; k += 4) {
+        float32x4_t vb0 = vld1q_f32(b0 + k);
+        float32x4_t va1 = vld1q_f32(a1 + k);
+        float32x4_t va2 = vld1q_f32(a2 + k);
+        float32x4_t u = vld1q_f32(z1 + k);
+        float32x4_t v = vld1q_f32(z2 + k);
+        float32x4_t e = vld1q_f32(env + k);
+
+        for (i = 0; i < n; i++) {
+            float32x4_t bx = vmulq_n_f32(vb0, x[i]);
+            float32x4_t y = vaddq_f32(bx, u);
+
+            u = vmlsq_f32(v, va1, y);
+            v = vmlsq_f32(vnegq_f32(bx), va2, y);
+            e = vmaxq_f32(vabsq_f32(y), vmulq_n_f32(e, release));
+        }
+
+        vst1q_f32(z1 + k, u);
+        vst1q_f32(z2 + k, v);
+        vst1q_f32(env + k, e);
+    }
+
+    bandpass_env_scalar(x, n, b0 + k, a1 + k, a2 + k, z1 + k, z2 + k,
+                    env + k, release, nb - k);
+}
+#else
+void dsp_bandpass_env(const float* x, int n, const float* b0, const float* a1,
+                const float* a2, float* z1, float* z2, float* env,
+                float release, int nb)
+{
+    bandpass_env_scalar(x, n, b0, a1, a2, z1, z2, env, release, nb);
+}
+#endif
+
+uint32_t dsp_isqrt64(uint64_t x)
+{
+    uint64_t res = 0;
+    uint64_t bit = (uint64_t)1 << 62;
+
+    while (bit > x)
+        bit >>= 2;
+
+    while (bit) {
+        if (x >= res + bit) {
+            x -= res + bit;
+            res = (res >> 1) + bit;
+        }
+        else {
+            res >>= 1;
+        }
+        bit >>= 2;
+    }
+
+    return (uint32_t)res;
+}
+
+#define MIX_SCALAR(in, frames, channels, scale, out)    \
+    do {                                                \
+        int _i, _c;                                     \
+        for (_i = 0; _i < (frames); _i++) {             \
+            float _acc = 0;                             \
+            for (_c = 0; _c < (channels); _c++)         \
+                _acc += (in)[_i * (channels) + _c];     \
+            (out)[_i] = (scale) * _acc;                 \
+        }                                               \
+    } while (0)
+
+void dsp_mix_s8(const int8_t* in, int frames, int channels, float scale, float* out)
+{
+    MIX_SCALAR(in, frames, channels, scale, out);
+}
+
+#if defined(__SSE2__)
+void dsp_mix_s16(const int16_t* in, int frames, int channels, float scale, float* out)
+{
+    const __m128 vscale = _mm_set1_ps(scale);
+    int i = 0;
+
+    if (channels == 1) {
+        for (; i + 8 <= frames; i += 8) {
+            __m128i x = _mm_loadu_si128((const __m128i*)(in + i));
+            __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+            __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+
+            _mm_storeu_ps(out + i, _mm_mul_ps(vscale, _mm_cvtepi32_ps(lo)));
+            _mm_storeu_ps(out + i + 4, _mm_mul_ps(vscale, _mm_cvtepi32_ps(hi)));
+        }
+    }
+    else if (channels == 2) {
+        // madd 把相邻的 L/R 直接加成 32 位
+        const __m128i ones = _mm_set1_epi16(1);
+
+        for (; i + 4 <= frames; i += 4) {
+            __m128i x = _mm_loadu_si128((const __m128i*)(in + 2 * i));
+
+            _mm_storeu_ps(out + i, _mm_mul_ps(vscale,
+                            _mm_cvtepi32_ps(_mm_madd_epi16(x, ones))));
+        }
+    }
+
+    MIX_SCALAR(in + i * channels, frames - i, channels, scale, out + i);
+}
+
+void dsp_mix_s32(const int32_t* in, int frames, int channels, float scale, float* out)
+{
+    const __m128 vscale = _mm_set1_ps(scale);
+    int i = 0;
+
+    if (channels == 1) {
+        for (; i + 4 <= frames; i += 4) {
+            __m128i x = _mm_loadu_si128((const __m128i*)(in + i));
+
+            _mm_storeu_ps(out + i, _mm_mul_ps(vscale, _mm_cvtepi32_ps(x)));
+        }
+    }
+    else if (channels == 2) {
+        for (; i + 4 <= frames; i += 4) {
+            __m128 a = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)(in + 2 * i)));
+            __m128 b = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)(in + 2 * i + 4)));
+            __m128 l = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+            __m128 r = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+
+            _mm_storeu_ps(out + i, _mm_mul_ps(vscale, _mm_add_ps(l, r)));
+        }
+    }
+
+    MIX_SCALAR(in + i * channels, frames - i, channels, scale, out + i);
+}
+
+void dsp_mix_f32(const float* in, int frames, int channels, float scale, float* out)
+{
+    const __m128 vscale = _mm_set1_ps(scale);
+    int i = 0;
+
+    if (channels == 1) {
+        for (; i + 4 <= frames; i += 4)
+            _mm_storeu_ps(out + i, _mm_mul_ps(vscale, _mm_loadu_ps(in + i)));
+    }
+    else if (channels == 2) {
+        for (; i + 4 <= frames; i += 4) {
+            __m128 a = _mm_loadu_ps(in + 2 * i);
+            __m128 b = _mm_loadu_ps(in + 2 * i + 4);
+            __m128 l = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+            __m128 r = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+
+            _mm_storeu_ps(out + i, _mm_mul_ps(vscale, _mm_add_ps(l, r)));
+        }
+    }
+
+    MIX_SCALAR(in + i * channels, frames - i, channels, scale, out + i);
+}
+#elif defined(USE_NEON)
+void dsp_mix_s16(const int16_t* in, int frames, int channels, float scale, float* out)
+{
+    int i = 0;
+
+    if (channels == 1) {
+        for (; i + 4 <= frames; i += 4) {
+            int32x4_t x = vmovl_s16(vld1_s16(in + i));
+
+            vst1q_f32(out + i, vmulq_n_f32(vcvtq_f32_s32(x), scale));
+        }
+    }
+    else if (channels == 2) {
+        for (; i + 4 <= frames; i += 4) {
+            int16x4x2_t v = vld2_s16(in + 2 * i);
+            int32x4_t x = vaddl_s16(v.val[0], v.val[1]);
+
+            vst1q_f32(out + i, vmulq_n_f32(vcvtq_f32_s32(x), scale));
+        }
+    }
+
+    MIX_SCALAR(in + i * channels, frames - i, channels, scale, out + i);
+}
+
+void dsp_mix_s32(const int32_t* in, int frames, int channels, float scale, float* out)
+{
+    int i = 0;
+
+    if (channels == 1) {
+        for (; i + 4 <= frames; i += 4)
+            vst1q_f32(out + i, vmulq_n_f32(vcvtq_f32_s32(vld1q_s32(in + i)), scale));
+    }
+    else if (channels == 2) {
+        for (; i + 4 <= frames; i += 4) {
+            int32x4x2_t v = vld2q_s32(in + 2 * i);
+            float32x4_t x = vaddq_f32(vcvtq_f32_s32(v.val[0]), vcvtq_f32_s32(v.val[1]));
+
+            vst1q_f32(out + i, vmulq_n_f32(x, scale));
+        }
+    }
+
+    MIX_SCALAR(in + i * channels, frames - i, channels, scale, out + i);
+}
+
+void dsp_mix_f32(const float* in, int frames, int channels, float scale, float* out)
+{
+    int i = 0;
+
+    if (channels == 1) {
+        for (; i + 4 <= frames; i += 4)
+            vst1q_f32(out + i, vmulq_n_f32(vld1q_f32(in + i), scale));
+    }
+    else if (channels == 2) {
+        for (; i + 4 <= frames; i += 4) {
+            float32x4x2_t v = vld2q_f32(in + 2 * i);
+
+            vst1q_f32(out + i, vmulq_n_f32(vaddq_f32(v.val[0], v.val[1]), scale));
+        }
+    }
+
+    MIX_SCALAR(in + i * channels, frames - i, channels, scale, out + i);
+}
+#else
+void dsp_mix_s16(const int16_t* in, int frames, int channels, float scale, float* out)
+{
+    MIX_SCALAR(in, frames, channels, scale, out);
+}
+
+void dsp_mix_s32(const int32_t* in, int frames, int channels, float scale, float* out)
+{
+    MIX_SCALAR(in, frames, channels, scale, out);
+}
+
+void dsp_mix_f32(const float* in, int frames, int channels, float scale, float* out)
+{
+    MIX_SCALAR(in, frames, channels, scale, out);
+}
+#endif
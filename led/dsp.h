@@ -0,0 +1,46 @@
+#ifndef _DSP_H_
+#define _DSP_H_
+
+#include <stdint.h>
+
+// 向量化的频谱后处理内核
+// 按编译选项选 AVX2 (-mavx2) / SSE2 / NEON (-mfpu=neon), 否则走标量
+
+// 10 * log10(2), 把 log2 换成 dB
+#define DSP_DB_PER_LOG2   3.01029995f
+// 功率下限, 同 np.clip(x, 1e-20, ...)
+#define DSP_POWER_FLOOR   1e-20f
+
+// cpx 为 n 个交错存放的 (re, im)
+// mag[i] = gain * sqrt(re^2 + im^2)
+// db[i] = 20 * log10(mag[i]), 对数用多项式近似, 误差 < 0.001dB, db 可为 NULL
+void dsp_mag_db(const float* cpx, int n, float gain, float* mag, float* db);
+
+// 标量参考实现, 测试和性能对比用
+void dsp_mag_db_ref(const float* cpx, int n, float gain, float* mag, float* db);
+
+// sum(a[i] * b[i]), 抽取 FIR 用
+float dsp_dot(const float* a, const float* b, int n);
+
+// nb 路 Goertzel 并行推进 n 个样本: s = x + c * s1 - s2
+// 按 4 路一组放进寄存器, 样本广播到各路
+void dsp_goertzel(const float* x, int n, const float* c, float* s1, float* s2, int nb);
+
+// nb 路带通 biquad (b1 = 0, b2 = -b0, 转置直接 II 型) 加峰值包络, 逐样本推进 n 个样本
+// y = b0 * x + z1, z1 = z2 - a1 * y, z2 = -b0 * x - a2 * y
+// env = max(|y|, env * release)
+void dsp_bandpass_env(const float* x, int n, const float* b0, const float* a1,
+                const float* a2, float* z1, float* z2, float* env,
+                float release, int nb);
+
+// 64 位整数平方根, 定点路径用
+uint32_t dsp_isqrt64(uint64_t x);
+
+// 交错多声道 PCM 转单声道: out[i] = scale * sum(in[i * channels + c])
+// 单声道和立体声有向量化实现, scale 里应含 1 / channels 和格式归一化
+void dsp_mix_s8(const int8_t* in, int frames, int channels, float scale, float* out);
+void dsp_mix_s16(const int16_t* in, int frames, int channels, float scale, float* out);
+void dsp_mix_s32(const int32_t* in, int frames, int channels, float scale, float* out);
+void dsp_mix_f32(const float* in, int frames, int channels, float scale, float* out);
+
+#endif
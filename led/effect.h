@@ -0,0 +1,74 @@
+#ifndef HAL_INC_UNI_LED_EFFECT_H_
+#define HAL_INC_UNI_LED_EFFECT_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+Effect plugin ABI, bump LED_EFFECT_ABI on any incompatible change.
+
+A plugin is a shared object exporting LED_EFFECT_ENTRY, loaded with
+	uni_hal_led_ctrl("hbs1632", "Effect Load /path/to/effect.so");
+or built in and registered with uni_hal_led_effect_register().
+Then started on a device with
+	uni_hal_led_ctrl("hbs1632", "Effect <name> [args]");
+*/
+#define LED_EFFECT_ABI		1
+#define LED_EFFECT_ENTRY	"uni_led_effect_entry"
+
+/*
+1 bit per led, row-major
+bit (x % 8) of bits[y * stride + x / 8] is led (x, y), (0, 0) is top-left
+*/
+struct led_frame {
+	int width;
+	int height;
+	int stride;
+	unsigned char *bits;
+};
+
+struct led_effect_input {
+	unsigned long long frame;	/* render calls since start */
+	unsigned long long now_ns;	/* CLOCK_MONOTONIC */
+	int nr_levels;			/* spectrum bars of the device view */
+	const int *levels;		/* bar heights in rows */
+};
+
+enum led_effect_event {
+	LED_EFFECT_CTRL,	/* 'Effect Event <arg>' */
+	LED_EFFECT_PAUSE,
+	LED_EFFECT_RESUME,
+};
+
+/*
+@fps: frame-rate hint, 0 renders once and then only after events,
+	1 renders right after each wall-clock second
+@budget_us: expected cost of one render call, the service lowers the
+	frame rate when budget or measured cost exceed its share of a frame
+@init: returns the effect context, NULL on failure
+@render: draw into frame, frame keeps the previous content,
+	returns 0 if nothing changed, < 0 to stop the effect
+@event, @teardown: optional
+*/
+struct led_effect_ops {
+	int abi;
+	const char *name;
+	int fps;
+	int budget_us;
+
+	void *(*init)(int width, int height, const char *args);
+	int (*render)(void *ctx, struct led_frame *frame,
+			const struct led_effect_input *in);
+	void (*event)(void *ctx, int event, const char *arg);
+	void (*teardown)(void *ctx);
+};
+
+typedef const struct led_effect_ops *(*led_effect_entry_fn)(void);
+
+int uni_hal_led_effect_register(const struct led_effect_ops *ops);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
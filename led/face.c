@@ -0,0 +1,246 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <time.h>
+#include "face.h"
+
+#define DOT_WIDTH    6
+#define DOT_HEIGHT   5
+
+#if (DOT_WIDTH == 3)
+static const unsigned char dot_maps[][DOT_HEIGHT][DOT_WIDTH] =
+{
+    {
+        { 1, 1, 1 },
+        { 1, 0, 1 },
+        { 1, 0, 1 },
+        { 1, 0, 1 },
+        { 1, 1, 1 }
+    },
+    {
+        { 0, 0, 1 },
+        { 0, 0, 1 },
+        { 0, 0, 1 },
+        { 0, 0, 1 },
+        { 0, 0, 1 }
+    },
+    {
+        { 1, 1, 1 },
+        { 0, 0, 1 },
+        { 1, 1, 1 },
+        { 1, 0, 0 },
+        { 1, 1, 1 }
+    },
+    {
+        { 1, 1, 1 },
+        { 0, 0, 1 },
+        { 1, 1, 1 },
+        { 0, 0, 1 },
+        { 1, 1, 1 }
+    },
+    {
+        { 1, 0, 1 },
+        { 1, 0, 1 },
+        { 1, 1, 1 },
+        { 0, 0, 1 },
+        { 0, 0, 1 }
+    },
+    {
+        { 1, 1, 1 },
+        { 1, 0, 0 },
+        { 1, 1, 1 },
+        { 0, 0, 1 },
+        { 1, 1, 1 }
+    },
+    {
+        { 1, 1, 1 },
+        { 1, 0, 0 },
+        { 1, 1, 1 },
+        { 1, 0, 1 },
+        { 1, 1, 1 }
+    },
+    {
+        { 1, 1, 1 },
+        { 0, 0, 1 },
+        { 0, 0, 1 },
+        { 0, 0, 1 },
+        { 0, 0, 1 }
+    },
+    {
+        { 1, 1, 1 },
+        { 1, 0, 1 },
+        { 1, 1, 1 },
+        { 1, 0, 1 },
+        { 1, 1, 1 }
+    },
+    {
+        { 1, 1, 1 },
+        { 1, 0, 1 },
+        { 1, 1, 1 },
+        { 0, 0, 1 },
+        { 1, 1, 1 }
+    }
+};
+#else
+static const unsigned char dot_maps[][DOT_HEIGHT][DOT_WIDTH] =
+{
+    {
+        { 1, 1, 1, 1, 1, 1 },
+        { 1, 0, 0, 0, 0, 1 },
+        { 1, 0, 0, 0, 0, 1 },
+        { 1, 0, 0, 0, 0, 1 },
+        { 1, 1, 1, 1, 1, 1 },
+    },
+    {
+        { 0, 0, 0, 0, 0, 1 },
+        { 0, 0, 0, 0, 0, 1 },
+        { 0, 0, 0, 0, 0, 1 },
+        { 0, 0, 0, 0, 0, 1 },
+        { 0, 0, 0, 0, 0, 1 }
+    },
+    {
+        { 1, 1, 1, 1, 1, 1 },
+        { 0, 0, 0, 0, 0, 1 },
+        { 1, 1, 1, 1, 1, 1 },
+        { 1, 0, 0, 0, 0, 0 },
+        { 1, 1, 1, 1, 1, 1 },
+    },
+    {
+        { 1, 1, 1, 1, 1, 1 },
+        { 0, 0, 0, 0, 0, 1 },
+        { 1, 1, 1, 1, 1, 1 },
+        { 0, 0, 0, 0, 0, 1 },
+        { 1, 1, 1, 1, 1, 1 },
+    },
+    {
+        { 1, 0, 0, 0, 0, 1 },
+        { 1, 0, 0, 0, 0, 1 },
+        { 1, 1, 1, 1, 1, 1 },
+        { 0, 0, 0, 0, 0, 1 },
+        { 0, 0, 0, 0, 0, 1 }
+    },
+    {
+        { 1, 1, 1, 1, 1, 1 },
+        { 1, 0, 0, 0, 0, 0 },
+        { 1, 1, 1, 1, 1, 1 },
+        { 0, 0, 0, 0, 0, 1 },
+        { 1, 1, 1, 1, 1, 1 },
+    },
+    {
+        { 1, 1, 1, 1, 1, 1 },
+        { 1, 0, 0, 0, 0, 0 },
+        { 1, 1, 1, 1, 1, 1 },
+        { 1, 0, 0, 0, 0, 1 },
+        { 1, 1, 1, 1, 1, 1 },
+    },
+    {
+        { 1, 1, 1, 1, 1, 1 },
+        { 0, 0, 0, 0, 0, 1 },
+        { 0, 0, 0, 0, 0, 1 },
+        { 0, 0, 0, 0, 0, 1 },
+        { 0, 0, 0, 0, 0, 1 }
+    },
+    {
+        { 1, 1, 1, 1, 1, 1 },
+        { 1, 0, 0, 0, 0, 1 },
+        { 1, 1, 1, 1, 1, 1 },
+        { 1, 0, 0, 0, 0, 1 },
+        { 1, 1, 1, 1, 1, 1 },
+    },
+    {
+        { 1, 1, 1, 1, 1, 1 },
+        { 1, 0, 0, 0, 0, 1 },
+        { 1, 1, 1, 1, 1, 1 },
+        { 0, 0, 0, 0, 0, 1 },
+        { 1, 1, 1, 1, 1, 1 },
+    }
+};
+#endif
+
+// 时十位, 时个位, 分十位, 分个位的左上角
+#if (DOT_WIDTH == 3)
+static const int digit_pos[4][2] = { {1, 1}, {5, 1}, {9, 7}, {13, 7} };
+#else
+static const int digit_pos[4][2] = { {1, 2}, {9, 2}, {1, 9}, {9, 9} };
+#endif
+
+static bool isdigt(int digit)
+{
+    return digit >= 0 && digit < 10;
+}
+
+static void show_digit(int x0, int y0, int digit, lf_dot_fn dot, void* ctx)
+{
+    int x, y;
+
+    if (!isdigt(digit)) {
+        printf("error: [LF] invalid digit: %d\n", digit);
+        return;
+    }
+
+    for (y = 0; y < DOT_HEIGHT; y++) {
+        for (x = 0; x < DOT_WIDTH; x++) {
+            dot(ctx, x0 + x, y0 + y, dot_maps[digit][y][x]);
+        }
+    }
+}
+
+static void flush_sec(int sec, int width, int height, lf_dot_fn dot, void* ctx)
+{
+#if (DOT_WIDTH == 3)
+    int y0 = 14;
+    int ten = (sec / 10) % 6;
+    int per = sec % 10;
+    int x;
+
+    for (x = 0; x < 6; x++) {
+        dot(ctx, x, y0, x < ten);
+    }
+
+    for (x = 0; x < 10; x++) {
+        dot(ctx, x, y0+1, x < per);
+    }
+#else
+    // 最下面一行做秒进度条, 大约 4 秒多亮一个点
+    int x;
+
+    for (x = 0; x < width; x++) {
+        dot(ctx, x, height - 1, x < sec * width / 60);
+    }
+#endif
+}
+
+void lf_draw(const struct tm* old, const struct tm* tm, int width, int height,
+                lf_dot_fn dot, void* ctx)
+{
+    int digits[4] = {
+        tm->tm_hour / 10, tm->tm_hour % 10, tm->tm_min / 10, tm->tm_min % 10
+    };
+    int prev[4] = { -1, -1, -1, -1 };
+    int i;
+
+    if (old) {
+        prev[0] = old->tm_hour / 10;
+        prev[1] = old->tm_hour % 10;
+        prev[2] = old->tm_min / 10;
+        prev[3] = old->tm_min % 10;
+    }
+
+    for (i = 0; i < 4; i++) {
+        if (digits[i] != prev[i])
+            show_digit(digit_pos[i][0], digit_pos[i][1], digits[i], dot, ctx);
+    }
+
+    if (!old || tm->tm_sec != old->tm_sec)
+        flush_sec(tm->tm_sec, width, height, dot, ctx);
+}
+
+void lf_step(time_t prev_t, const struct tm* prev, time_t now, struct tm* tm)
+{
+    if (now == prev_t + 1 && prev->tm_sec < 59) {
+        *tm = *prev;
+        tm->tm_sec++;
+    }
+    else {
+        localtime_r(&now, tm);
+    }
+}
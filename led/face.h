@@ -0,0 +1,16 @@
+#ifndef _FACE_H_
+#define _FACE_H_
+
+#include <time.h>
+
+// 时钟表盘: 时钟场景和 clock 效果共用的字形和布局, 点由 dot 写到各自的目标上
+typedef void (*lf_dot_fn)(void* ctx, int x, int y, int on);
+
+// 只重画和 old 不同的数字和秒条, old 为 NULL 时全画
+void lf_draw(const struct tm* old, const struct tm* tm, int width, int height,
+                lf_dot_fn dot, void* ctx);
+// prev 是 prev_t 的本地时间, 换算出 now 的本地时间
+// 同一分钟里只是秒加一, 跨分钟或者时间跳变才重新换算
+void lf_step(time_t prev_t, const struct tm* prev, time_t now, struct tm* tm);
+
+#endif
@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "utils.h"
+#include "filterbank.h"
+#include "dsp.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// 一次转换的样本数
+#define CHUNK_SIZE  64
+// 定点状态的额外小数位
+#define FB_GUARD    8
+// 定点系数 Q28, |a1| < 2 不会溢出
+#define FB_ONE      (double)(1 << 28)
+
+static void run(filter_bank* fb, const kiss_fft_scalar* x, int n)
+{
+#ifdef FIXED_POINT
+    int64_t bx;
+    int32_t y, u, v, e, ay;
+    int i, k;
+
+    // 状态比输入多 FB_GUARD 位小数, 低频段的极点贴近单位圆, 截断误差会被放大
+    for (k = 0; k < fb->nr_bands; k++) {
+        u = fb->z1[k];
+        v = fb->z2[k];
+        e = fb->env[k];
+        for (i = 0; i < n; i++) {
+            bx = (int64_t)fb->b0[k] * ((int32_t)x[i] << FB_GUARD);
+            y = (int32_t)((bx >> 28) + u);
+            u = v - (int32_t)(((int64_t)fb->a1[k] * y) >> 28);
+            v = (int32_t)((-bx - (int64_t)fb->a2[k] * y) >> 28);
+
+            ay = abs(y) >> FB_GUARD;
+            e = (int32_t)(((int64_t)e * fb->release) >> 15);
+            e = ay > e ? ay : e;
+        }
+        fb->z1[k] = u;
+        fb->z2[k] = v;
+        fb->env[k] = e;
+    }
+#else
+    dsp_bandpass_env(x, n, fb->b0, fb->a1, fb->a2, fb->z1, fb->z2,
+                    fb->env, fb->release, fb->nr_bands);
+#endif
+}
+
+int fb_feed(filter_bank* fb, const void* buf, int frames, int format, int channels)
+{
+    const char* p = buf;
+    int stride = ws_frame_bytes(format, channels);
+    int n, updated = 0;
+
+    if (!fb || !buf || frames <= 0 || channels <= 0 || !stride)
+        return 0;
+
+    while (frames > 0) {
+        // 不跨发布边界
+        n = MIN(frames, MIN(CHUNK_SIZE, fb->block - fb->pos));
+        ws_convert(p, n, format, channels, fb->scratch);
+        run(fb, fb->scratch, n);
+
+        fb->pos += n;
+        if (fb->pos == fb->block) {
+            memcpy(fb->bands, fb->env, fb->nr_bands * sizeof(ws_amp_t));
+            fb->pos = 0;
+            updated = 1;
+        }
+
+        p += n * stride;
+        frames -= n;
+    }
+
+    return updated;
+}
+
+filter_bank* fb_create(int rate, int block, int nr_bands, float fmin, float fmax,
+                    int release_ms)
+{
+    filter_bank* fb;
+    double step, f, w0, q, alpha, a0, rel;
+    int i;
+
+    fmax = MIN(fmax, rate / 2.0f);
+    if (rate <= 0 || block <= 0 || nr_bands <= 0 || nr_bands > BANDS_MAX
+        || fmin <= 0 || fmin >= fmax || release_ms <= 0) {
+        fprintf(stderr, "error: [FB] create invalid param\n");
+        return NULL;
+    }
+
+    fb = malloc(sizeof(*fb));
+    if (!fb) {
+        fprintf(stderr, "error: [FB] create malloc\n");
+        return NULL;
+    }
+    memset(fb, 0, sizeof(*fb));
+
+    fb->nr_bands = nr_bands;
+    fb->block = block;
+    fb->scratch = malloc(CHUNK_SIZE * sizeof(kiss_fft_scalar));
+    if (!fb->scratch) {
+        fprintf(stderr, "error: [FB] create alloc\n");
+        free(fb);
+        return NULL;
+    }
+
+    // RBJ 带通 (峰值增益 0dB), Q = 中心频率 / 段宽
+    step = pow(fmax / fmin, 1.0 / nr_bands);
+    q = sqrt(step) / (step - 1);
+    for (i = 0; i < nr_bands; i++) {
+        f = bm_centre(i, nr_bands, fmin, fmax);
+        w0 = 2 * M_PI * f / rate;
+        alpha = sin(w0) / (2 * q);
+        a0 = 1 + alpha;
+
+#ifdef FIXED_POINT
+        fb->b0[i] = (int32_t)floor(alpha / a0 * FB_ONE + 0.5);
+        fb->a1[i] = (int32_t)floor(-2 * cos(w0) / a0 * FB_ONE + 0.5);
+        fb->a2[i] = (int32_t)floor((1 - alpha) / a0 * FB_ONE + 0.5);
+#else
+        fb->b0[i] = alpha / a0;
+        fb->a1[i] = -2 * cos(w0) / a0;
+        fb->a2[i] = (1 - alpha) / a0;
+#endif
+    }
+
+    rel = exp(-1000.0 / (release_ms * rate));
+#ifdef FIXED_POINT
+    fb->release = (int32_t)floor(rel * 32768 + 0.5);
+#else
+    fb->release = rel;
+#endif
+
+    return fb;
+}
+
+void fb_destroy(filter_bank* fb)
+{
+    if (fb) {
+        free(fb->scratch);
+        free(fb);
+    }
+}
@@ -0,0 +1,44 @@
+#ifndef _FILTERBANK_H_
+#define _FILTERBANK_H_
+
+#include "spectrum.h"
+
+// 带通 biquad 滤波器组 + 峰值包络, 逐样本处理, 延迟只有滤波器本身的群延迟
+// 中心频率和带宽取 [fmin, fmax] 对数等分的各段, 与 band_map 一致
+// 每 block 个样本发布一次包络, 输出刻度与 bm_reduce 相同 (正弦幅度)
+typedef struct filter_bank {
+    int nr_bands;
+    int block;
+    int pos;
+
+#ifdef FIXED_POINT
+    int32_t b0[BANDS_MAX];      // Q28
+    int32_t a1[BANDS_MAX];
+    int32_t a2[BANDS_MAX];
+    int32_t z1[BANDS_MAX];
+    int32_t z2[BANDS_MAX];
+    int32_t env[BANDS_MAX];
+    int32_t release;            // Q15
+#else
+    float b0[BANDS_MAX];
+    float a1[BANDS_MAX];
+    float a2[BANDS_MAX];
+    float z1[BANDS_MAX];
+    float z2[BANDS_MAX];
+    float env[BANDS_MAX];
+    float release;
+#endif
+
+    kiss_fft_scalar* scratch;
+    ws_amp_t bands[BANDS_MAX];
+} filter_bank;
+
+// release_ms 为包络衰减到 1/e 的时间
+filter_bank* fb_create(int rate, int block, int nr_bands, float fmin, float fmax,
+                    int release_ms);
+void fb_destroy(filter_bank* fb);
+
+// 返回 1 表示 bands 已更新
+int fb_feed(filter_bank* fb, const void* buf, int frames, int format, int channels);
+
+#endif
@@ -0,0 +1,733 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <sys/stat.h>
+#include "utils.h"
+#include "image.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define USE_NEON
+#endif
+
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static im_clip* cache[IM_CACHE];
+static unsigned int cache_used;
+
+// 跳过空白和 # 注释, 返回下一个字符但不读走
+static int skip_space(FILE* f)
+{
+    int c;
+
+    while ((c = getc(f)) != EOF) {
+        if (c == '#') {
+            while ((c = getc(f)) != EOF && c != '\n')
+                ;
+        }
+        else if (!isspace(c)) {
+            ungetc(c, f);
+            break;
+        }
+    }
+
+    return c;
+}
+
+static int read_uint(FILE* f, int* v)
+{
+    int c, n = 0, digits = 0;
+
+    skip_space(f);
+    while ((c = getc(f)) != EOF && isdigit(c) && digits < 9) {
+        n = n * 10 + c - '0';
+        digits++;
+    }
+    if (c != EOF && !isdigit(c))
+        ungetc(c, f);
+
+    *v = n;
+    return digits ? 0 : -1;
+}
+
+int im_read_header(FILE* f, im_header* h)
+{
+    int c;
+
+    if (getc(f) != 'P')
+        return -1;
+    c = getc(f);
+    if (c != '1' && c != '2' && c != '4' && c != '5')
+        return -1;
+
+    h->format = c - '0';
+    h->maxval = 1;
+    if (read_uint(f, &h->width) < 0 || read_uint(f, &h->height) < 0)
+        return -1;
+    if ((h->format == 2 || h->format == 5) && read_uint(f, &h->maxval) < 0)
+        return -1;
+    if (h->width <= 0 || h->width > IM_SOURCE_MAX || h->height <= 0
+        || h->height > IM_SOURCE_MAX || h->maxval <= 0 || h->maxval > 65535)
+        return -1;
+
+    // 头和像素之间正好一个空白
+    c = getc(f);
+    return c != EOF && isspace(c) ? 0 : -1;
+}
+
+// raw 像素数据的字节数, 纯文本格式返回 -1
+static long raw_bytes(const im_header* h)
+{
+    if (h->format == 4)
+        return (long)(h->width + 7) / 8 * h->height;
+    if (h->format == 5)
+        return (long)h->width * h->height * (h->maxval > 255 ? 2 : 1);
+
+    return -1;
+}
+
+int im_read_gray(FILE* f, const im_header* h, unsigned char* gray)
+{
+    int n = h->width * h->height;
+    unsigned char row[(IM_SOURCE_MAX + 7) / 8];
+    unsigned char lut[256];
+    int i, x, y, c, v;
+
+    switch (h->format) {
+    case 1:
+        for (i = 0; i < n; i++) {
+            c = skip_space(f);
+            getc(f);
+            if (c != '0' && c != '1')
+                return -1;
+            gray[i] = c == '1' ? 0 : 255;
+        }
+        break;
+    case 2:
+        for (i = 0; i < n; i++) {
+            if (read_uint(f, &v) < 0)
+                return -1;
+            gray[i] = MIN(v, h->maxval) * 255 / h->maxval;
+        }
+        break;
+    case 4:
+        for (y = 0; y < h->height; y++) {
+            if (fread(row, (h->width + 7) / 8, 1, f) != 1)
+                return -1;
+            for (x = 0; x < h->width; x++)
+                *gray++ = row[x / 8] & (0x80 >> (x % 8)) ? 0 : 255;
+        }
+        break;
+    case 5:
+        if (h->maxval > 255) {
+            for (i = 0; i < n; i++) {
+                c = getc(f);
+                v = getc(f);
+                if (v == EOF)
+                    return -1;
+                gray[i] = MIN((c << 8) | v, h->maxval) * 255 / h->maxval;
+            }
+            break;
+        }
+
+        if (fread(gray, n, 1, f) != 1)
+            return -1;
+        if (h->maxval != 255) {
+            for (i = 0; i < 256; i++)
+                lut[i] = MIN(i, h->maxval) * 255 / h->maxval;
+            for (i = 0; i < n; i++)
+                gray[i] = lut[gray[i]];
+        }
+        break;
+    default:
+        return -1;
+    }
+
+    return 0;
+}
+
+void im_accumulate_ref(const unsigned char* src, int n, int w, uint32_t* acc)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+        acc[i] += w * src[i];
+}
+
+// 权重不超过目标高度, 255 * w 放得进 16 位
+#if defined(__SSE2__)
+void im_accumulate(const unsigned char* src, int n, int w, uint32_t* acc)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i wv = _mm_set1_epi16(w);
+    __m128i p, lo, hi;
+    __m128i* a;
+    int i;
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        p = _mm_loadu_si128((const __m128i*)(src + i));
+        lo = _mm_mullo_epi16(_mm_unpacklo_epi8(p, zero), wv);
+        hi = _mm_mullo_epi16(_mm_unpackhi_epi8(p, zero), wv);
+        a = (__m128i*)(acc + i);
+        _mm_storeu_si128(a, _mm_add_epi32(_mm_loadu_si128(a), _mm_unpacklo_epi16(lo, zero)));
+        _mm_storeu_si128(a + 1, _mm_add_epi32(_mm_loadu_si128(a + 1), _mm_unpackhi_epi16(lo, zero)));
+        _mm_storeu_si128(a + 2, _mm_add_epi32(_mm_loadu_si128(a + 2), _mm_unpacklo_epi16(hi, zero)));
+        _mm_storeu_si128(a + 3, _mm_add_epi32(_mm_loadu_si128(a + 3), _mm_unpackhi_epi16(hi, zero)));
+    }
+
+    im_accumulate_ref(src + i, n - i, w, acc + i);
+}
+#elif defined(USE_NEON)
+void im_accumulate(const unsigned char* src, int n, int w, uint32_t* acc)
+{
+    uint8x16_t p;
+    uint16x8_t lo, hi;
+    int i;
+
+    for (i = 0; i + 16 <= n; i += 16) {
+        p = vld1q_u8(src + i);
+        lo = vmovl_u8(vget_low_u8(p));
+        hi = vmovl_u8(vget_high_u8(p));
+        vst1q_u32(acc + i, vmlal_n_u16(vld1q_u32(acc + i), vget_low_u16(lo), w));
+        vst1q_u32(acc + i + 4, vmlal_n_u16(vld1q_u32(acc + i + 4), vget_high_u16(lo), w));
+        vst1q_u32(acc + i + 8, vmlal_n_u16(vld1q_u32(acc + i + 8), vget_low_u16(hi), w));
+        vst1q_u32(acc + i + 12, vmlal_n_u16(vld1q_u32(acc + i + 12), vget_high_u16(hi), w));
+    }
+
+    im_accumulate_ref(src + i, n - i, w, acc + i);
+}
+#else
+void im_accumulate(const unsigned char* src, int n, int w, uint32_t* acc)
+{
+    im_accumulate_ref(src, n, w, acc);
+}
+#endif
+
+// 源图的每一行/列在目标坐标里占 dh/dw 个单位, 目标的每一格占 sh/sw 个单位,
+// 交叠的单位数就是权重; 先纵向按行累加 (向量化), 再横向只算 dw 个输出
+void im_downscale(const unsigned char* src, int sw, int sh, int stride,
+                unsigned char* dst, int dw, int dh, uint32_t* acc)
+{
+    uint32_t total = (uint32_t)sw * sh, sum;
+    int ox, oy, x, y, a0, a1, w;
+
+    for (oy = 0; oy < dh; oy++) {
+        a0 = oy * sh;
+        a1 = a0 + sh;
+        memset(acc, 0, sw * sizeof(*acc));
+        for (y = a0 / dh; y < sh && y * dh < a1; y++) {
+            w = MIN(a1, (y + 1) * dh) - MAX(a0, y * dh);
+            if (w > 0)
+                im_accumulate(src + y * stride, sw, w, acc);
+        }
+
+        for (ox = 0; ox < dw; ox++) {
+            a0 = ox * sw;
+            a1 = a0 + sw;
+            sum = 0;
+            for (x = a0 / dw; x < sw && x * dw < a1; x++)
+                sum += (MIN(a1, (x + 1) * dw) - MAX(a0, x * dw)) * acc[x];
+            dst[oy * dw + ox] = (sum + total / 2) / total;
+        }
+    }
+}
+
+static inline void set_bit(unsigned char* bits, int stride, int x, int y)
+{
+    bits[y * stride + x / 8] |= 1 << (x % 8);
+}
+
+static const unsigned char bayer4[4][4] = {
+    {  0,  8,  2, 10 },
+    { 12,  4, 14,  6 },
+    {  3, 11,  1,  9 },
+    { 15,  7, 13,  5 },
+};
+
+// 误差放大 16 倍存, 蛇形扫描避免斜纹
+static void floyd(const unsigned char* gray, int w, int h, unsigned char* bits, int stride)
+{
+    int err[2][IM_TARGET_MAX + 2];
+    int *cur, *next;
+    int x, y, i, dir, v, e;
+
+    memset(err, 0, sizeof(err));
+    for (y = 0; y < h; y++) {
+        cur = err[y & 1] + 1;
+        next = err[(y + 1) & 1] + 1;
+        memset(next - 1, 0, sizeof(err[0]));
+        dir = y & 1 ? -1 : 1;
+
+        for (i = 0; i < w; i++) {
+            x = dir > 0 ? i : w - 1 - i;
+            v = gray[y * w + x] + cur[x] / 16;
+            if (v >= 128) {
+                set_bit(bits, stride, x, y);
+                e = v - 255;
+            }
+            else {
+                e = v;
+            }
+            cur[x + dir] += e * 7;
+            next[x - dir] += e * 3;
+            next[x] += e * 5;
+            next[x + dir] += e;
+        }
+    }
+}
+
+void im_dither(const unsigned char* gray, int w, int h, im_dither_t mode, int level,
+                unsigned char* bits, int stride)
+{
+    int x, y;
+
+    for (y = 0; y < h; y++)
+        memset(bits + y * stride, 0, (w + 7) / 8);
+
+    if (mode == IM_FLOYD) {
+        floyd(gray, w, h, bits, stride);
+        return;
+    }
+
+    for (y = 0; y < h; y++) {
+        for (x = 0; x < w; x++) {
+            int t = mode == IM_ORDERED ? bayer4[y & 3][x & 3] * 16 + 8 : level;
+
+            if (gray[y * w + x] >= t)
+                set_bit(bits, stride, x, y);
+        }
+    }
+}
+
+static void clip_free(im_clip* clip)
+{
+    if (clip->f)
+        fclose(clip->f);
+    pthread_mutex_destroy(&clip->lock);
+    free(clip->offsets);
+    free(clip->bits);
+    free(clip->done);
+    free(clip->gray);
+    free(clip->acc);
+    free(clip);
+}
+
+// 拆开 "a%03d.pgm", 路径只当数据用, 从不当格式串
+static int parse_pattern(im_clip* clip)
+{
+    char* out = clip->prefix;
+    const char* p;
+    int n = 0, convs = 0;
+
+    for (p = clip->path; *p; p++) {
+        if (*p != '%') {
+            out[n++] = *p;
+            continue;
+        }
+
+        p++;
+        if (*p == '%') {
+            out[n++] = '%';
+            continue;
+        }
+        if (convs++)
+            return -1;
+        if (*p == '0') {
+            p++;
+            if (*p < '1' || *p > '9')
+                return -1;
+            clip->digits = *p++ - '0';
+        }
+        if (*p != 'd')
+            return -1;
+
+        out[n] = 0;
+        out = clip->suffix;
+        n = 0;
+    }
+    out[n] = 0;
+
+    return convs == 1 ? 0 : -1;
+}
+
+// 拼出的路径放不下时返回 -1
+static int pattern_path(const im_clip* clip, int number, char* path)
+{
+    int n = snprintf(path, IM_PATH_SIZE, "%s%0*d%s", clip->prefix, clip->digits, number,
+                    clip->suffix);
+
+    return n < IM_PATH_SIZE ? 0 : -1;
+}
+
+// 一帧一个文件, 从 0 或 1 开始连续编号
+static int index_pattern(im_clip* clip)
+{
+    char path[IM_PATH_SIZE];
+    struct stat st;
+    int i;
+
+    for (i = 0; i < 2; i++) {
+        if (pattern_path(clip, i, path) == 0 && stat(path, &st) == 0)
+            break;
+    }
+    if (i == 2)
+        return -1;
+
+    clip->first = i;
+    while (clip->nr_frames < IM_FRAMES_MAX) {
+        if (pattern_path(clip, clip->first + clip->nr_frames, path) < 0
+            || stat(path, &st) < 0)
+            break;
+        clip->mtime = MAX(clip->mtime, st.st_mtime);
+        clip->size += st.st_size;
+        clip->nr_frames++;
+    }
+
+    return 0;
+}
+
+// 多幅 raw 图连在一个文件里, 纯文本格式只有一幅
+static int index_file(im_clip* clip)
+{
+    struct stat st;
+    im_header h;
+    long pos, bytes;
+    int c;
+
+    clip->f = fopen(clip->path, "rb");
+    if (!clip->f || fstat(fileno(clip->f), &st) < 0)
+        return -1;
+    clip->mtime = st.st_mtime;
+    clip->size = st.st_size;
+
+    clip->offsets = malloc(IM_FRAMES_MAX * sizeof(long));
+    if (!clip->offsets)
+        return -1;
+
+    while (clip->nr_frames < IM_FRAMES_MAX) {
+        pos = ftell(clip->f);
+        if (skip_space(clip->f) == EOF || im_read_header(clip->f, &h) < 0)
+            break;
+        bytes = raw_bytes(&h);
+        if (bytes > 0 && ftell(clip->f) + bytes > clip->size)
+            break;
+
+        clip->offsets[clip->nr_frames++] = pos;
+        if (bytes < 0 || fseek(clip->f, bytes, SEEK_CUR) < 0)
+            break;
+        c = getc(clip->f);
+        if (c == EOF)
+            break;
+        ungetc(c, clip->f);
+    }
+
+    return clip->nr_frames ? 0 : -1;
+}
+
+// 持 clip->lock 调用
+static int convert(im_clip* clip, int index, unsigned char* out)
+{
+    unsigned char small[IM_TARGET_MAX * IM_TARGET_MAX];
+    int stride = (clip->width + 7) / 8;
+    char path[IM_PATH_SIZE];
+    FILE* f = clip->f;
+    im_header h;
+    int i, ret = -1;
+
+    if (clip->pattern) {
+        f = pattern_path(clip, clip->first + index, path) == 0 ? fopen(path, "rb") : NULL;
+        if (!f)
+            return -1;
+    }
+    else if (fseek(f, clip->offsets[index], SEEK_SET) < 0) {
+        return -1;
+    }
+
+    skip_space(f);
+    if (im_read_header(f, &h) < 0)
+        goto out;
+
+    if (h.width * h.height > clip->gray_size) {
+        free(clip->gray);
+        clip->gray = malloc(h.width * h.height);
+        clip->gray_size = clip->gray ? h.width * h.height : 0;
+    }
+    if (h.width > clip->acc_size) {
+        free(clip->acc);
+        clip->acc = malloc(h.width * sizeof(*clip->acc));
+        clip->acc_size = clip->acc ? h.width : 0;
+    }
+    if (!clip->gray || !clip->acc || im_read_gray(f, &h, clip->gray) < 0)
+        goto out;
+
+    im_downscale(clip->gray, h.width, h.height, h.width, small,
+                clip->width, clip->height, clip->acc);
+    if (clip->invert) {
+        for (i = 0; i < clip->width * clip->height; i++)
+            small[i] = 255 - small[i];
+    }
+    im_dither(small, clip->width, clip->height, clip->dither, clip->level, out, stride);
+    ret = 0;
+
+out:
+    if (clip->pattern)
+        fclose(f);
+    return ret;
+}
+
+static bool same_clip(const im_clip* clip, const im_clip* key)
+{
+    return strcmp(clip->path, key->path) == 0 && clip->mtime == key->mtime
+        && clip->size == key->size && clip->width == key->width
+        && clip->height == key->height && clip->dither == key->dither
+        && clip->level == key->level && clip->invert == key->invert;
+}
+
+static im_clip* clip_create(const char* path, int width, int height, im_dither_t mode,
+                int level, bool invert)
+{
+    im_clip* clip;
+
+    clip = calloc(1, sizeof(*clip));
+    if (!clip)
+        return NULL;
+
+    strncpy(clip->path, path, sizeof(clip->path) - 1);
+    clip->pattern = strchr(path, '%') != NULL;
+    clip->width = width;
+    clip->height = height;
+    clip->dither = mode;
+    clip->level = level;
+    clip->invert = invert;
+    pthread_mutex_init(&clip->lock, NULL);
+
+    if (clip->pattern && parse_pattern(clip) < 0) {
+        fprintf(stderr, "error: [IM] invalid pattern %s\n", path);
+        clip_free(clip);
+        return NULL;
+    }
+    if (clip->pattern ? index_pattern(clip) : index_file(clip)) {
+        fprintf(stderr, "error: [IM] no frames in %s\n", path);
+        clip_free(clip);
+        return NULL;
+    }
+
+    clip->frame_bytes = (width + 7) / 8 * height;
+    clip->bits = malloc(clip->nr_frames * clip->frame_bytes);
+    clip->done = calloc(clip->nr_frames, sizeof(bool));
+    if (!clip->bits || !clip->done) {
+        fprintf(stderr, "error: [IM] malloc %d frames\n", clip->nr_frames);
+        clip_free(clip);
+        return NULL;
+    }
+
+    return clip;
+}
+
+im_clip* im_open(const char* path, int width, int height, im_dither_t mode,
+                int level, bool invert)
+{
+    im_clip key, *clip;
+    struct stat st;
+    int i, slot = -1;
+
+    if (!path || strlen(path) >= IM_PATH_SIZE || width <= 0 || height <= 0
+        || width > IM_TARGET_MAX || height > IM_TARGET_MAX) {
+        fprintf(stderr, "error: [IM] invalid param\n");
+        return NULL;
+    }
+
+    // 单个文件先看有没有转好的; 序列要逐个 stat, 建好后再比
+    pthread_mutex_lock(&cache_lock);
+    memset(&key, 0, sizeof(key));
+    strcpy(key.path, path);
+    key.width = width;
+    key.height = height;
+    key.dither = mode;
+    key.level = level;
+    key.invert = invert;
+    if (!strchr(path, '%') && stat(path, &st) == 0) {
+        key.mtime = st.st_mtime;
+        key.size = st.st_size;
+        for (i = 0; i < IM_CACHE; i++) {
+            if (cache[i] && same_clip(cache[i], &key)) {
+                clip = cache[i];
+                goto found;
+            }
+        }
+    }
+
+    clip = clip_create(path, width, height, mode, level, invert);
+    if (!clip) {
+        pthread_mutex_unlock(&cache_lock);
+        return NULL;
+    }
+
+    for (i = 0; i < IM_CACHE; i++) {
+        if (cache[i] && same_clip(cache[i], clip)) {
+            clip_free(clip);
+            clip = cache[i];
+            goto found;
+        }
+    }
+
+    // 空位或者没人用的最旧的一个
+    for (i = 0; i < IM_CACHE; i++) {
+        if (!cache[i]) {
+            slot = i;
+            break;
+        }
+        if (!cache[i]->refs && (slot < 0 || cache[i]->used < cache[slot]->used))
+            slot = i;
+    }
+    if (slot >= 0) {
+        if (cache[slot])
+            clip_free(cache[slot]);
+        cache[slot] = clip;
+    }
+
+found:
+    clip->refs++;
+    clip->used = ++cache_used;
+    pthread_mutex_unlock(&cache_lock);
+
+    return clip;
+}
+
+void im_close(im_clip* clip)
+{
+    int i;
+
+    if (!clip)
+        return;
+
+    pthread_mutex_lock(&cache_lock);
+    clip->refs--;
+    for (i = 0; i < IM_CACHE && cache[i] != clip; i++)
+        ;
+    // 缓存满时打开的不进缓存, 没人用就释放
+    if (i == IM_CACHE && !clip->refs)
+        clip_free(clip);
+    pthread_mutex_unlock(&cache_lock);
+}
+
+int im_frame(im_clip* clip, int index, unsigned char* bits, int stride)
+{
+    int nb = (clip->width + 7) / 8;
+    unsigned char* frame;
+    int y, ret = 0;
+
+    if (index < 0 || index >= clip->nr_frames)
+        return -1;
+
+    frame = clip->bits + index * clip->frame_bytes;
+    pthread_mutex_lock(&clip->lock);
+    if (!clip->done[index]) {
+        // 坏帧也只报一次, 之后当黑帧放
+        ret = convert(clip, index, frame);
+        if (ret < 0) {
+            fprintf(stderr, "error: [IM] %s frame %d\n", clip->path, index);
+            memset(frame, 0, clip->frame_bytes);
+        }
+        clip->done[index] = true;
+    }
+    pthread_mutex_unlock(&clip->lock);
+
+    for (y = 0; y < clip->height; y++)
+        memcpy(bits + y * stride, frame + y * nb, nb);
+
+    return ret;
+}
+
+// 'Effect image' 按帧率循环播放, 只有换帧时才有输出
+
+typedef struct im_player {
+    im_clip* clip;
+    int fps;
+    int64_t start_ns;
+    int last;
+} im_player;
+
+static void* image_init(int width, int height, const char* args)
+{
+    char buf[IM_PATH_SIZE + 64], *tok, *save = NULL;
+    im_dither_t mode = IM_THRESHOLD;
+    int fps = IM_FPS, level = 128;
+    bool invert = false, threshold = false;
+    const char* path;
+    im_player* p;
+
+    if (!args || strlen(args) >= sizeof(buf))
+        return NULL;
+    strcpy(buf, args);
+
+    path = strtok_r(buf, " ", &save);
+    while ((tok = strtok_r(NULL, " ", &save))) {
+        if (isdigit((unsigned char)tok[0]) && threshold)
+            level = CLIP(atoi(tok), 1, 255);
+        else if (isdigit((unsigned char)tok[0]))
+            fps = CLIP(atoi(tok), 1, IM_FPS_MAX);
+        else if (strcmp(tok, "Floyd") == 0)
+            mode = IM_FLOYD;
+        else if (strcmp(tok, "Ordered") == 0)
+            mode = IM_ORDERED;
+        else if (strcmp(tok, "Invert") == 0)
+            invert = true;
+        else if (strcmp(tok, "Threshold") == 0)
+            mode = IM_THRESHOLD;
+        else
+            return NULL;
+        threshold = strcmp(tok, "Threshold") == 0;
+    }
+
+    p = calloc(1, sizeof(*p));
+    if (!p)
+        return NULL;
+    p->clip = im_open(path, width, height, mode, level, invert);
+    if (!p->clip) {
+        free(p);
+        return NULL;
+    }
+    p->fps = fps;
+    p->last = -1;
+
+    return p;
+}
+
+static int image_render(void* ctx, struct led_frame* frame,
+                    const struct led_effect_input* in)
+{
+    im_player* p = (im_player*)ctx;
+    int index;
+
+    if (p->last < 0)
+        p->start_ns = in->now_ns;
+    index = (in->now_ns - p->start_ns) * p->fps / 1000000000LL % p->clip->nr_frames;
+    if (index == p->last)
+        return 0;
+
+    p->last = index;
+    im_frame(p->clip, index, frame->bits, frame->stride);
+
+    return 1;
+}
+
+static void image_teardown(void* ctx)
+{
+    im_player* p = (im_player*)ctx;
+
+    im_close(p->clip);
+    free(p);
+}
+
+const struct led_effect_ops im_effect_ops = {
+    .abi = LED_EFFECT_ABI,
+    .name = "image",
+    .fps = IM_FPS_MAX,
+    .budget_us = 2000,
+    .init = image_init,
+    .render = image_render,
+    .teardown = image_teardown,
+};
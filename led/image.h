@@ -0,0 +1,98 @@
+#ifndef _IMAGE_H_
+#define _IMAGE_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include "effect.h"
+
+// PBM/PGM 图片和序列: 面积平均缩到屏幕大小, 再二值化成 struct led_frame 的 1bpp
+// 序列可以是一个文件里连着的多幅 raw 图 (P4/P5), 也可以是带 %d 的路径, 一帧一个文件
+// 路径里只能有一个 %d 或 %0Nd (N 为 1~9), 另外只认 %% 表示字面的 %
+
+#define IM_SOURCE_MAX   1024        // 源图宽高上限
+#define IM_FRAMES_MAX   4096
+#define IM_TARGET_MAX   32          // 目标宽高上限
+#define IM_PATH_SIZE    128
+// 转好的片段按路径, 文件修改时间和参数缓存, 重放时不再解码
+#define IM_CACHE        4
+// 'Effect image' 的默认帧率和上限
+#define IM_FPS          10
+#define IM_FPS_MAX      30
+
+typedef enum im_dither {
+    IM_THRESHOLD,
+    IM_FLOYD,           // Floyd–Steinberg 误差扩散, 蛇形扫描
+    IM_ORDERED,         // 4x4 Bayer
+} im_dither_t;
+
+typedef struct im_header {
+    int format;         // 1 ~ 6, 只支持 1/2/4/5
+    int width;
+    int height;
+    int maxval;         // PBM 为 1
+} im_header;
+
+typedef struct im_clip {
+    char path[IM_PATH_SIZE];
+    bool pattern;
+    // 一帧一个文件时拆开的路径: prefix + 补零到 digits 位的编号 + suffix
+    char prefix[IM_PATH_SIZE];
+    char suffix[IM_PATH_SIZE];
+    int digits;
+    time_t mtime;
+    off_t size;
+    int width;
+    int height;
+    im_dither_t dither;
+    int level;
+    bool invert;
+
+    int nr_frames;
+    int first;              // 一帧一个文件时第一帧的编号
+    long* offsets;          // 多图文件里每帧的位置
+    int frame_bytes;
+
+    // 以下由 lock 保护, 几个设备可以同时播同一个片段
+    pthread_mutex_t lock;
+    unsigned char* bits;    // nr_frames 帧转好的 1bpp, stride 为 (width + 7) / 8
+    bool* done;
+    FILE* f;
+    unsigned char* gray;    // 解码出的源图, 按遇到的最大尺寸长
+    int gray_size;
+    uint32_t* acc;
+    int acc_size;
+
+    // 由缓存的锁保护
+    int refs;
+    unsigned int used;      // 最近使用的序号, 满了淘汰最旧的
+} im_clip;
+
+// 读 netpbm 头, 文件停在像素数据开头
+int im_read_header(FILE* f, im_header* h);
+// 像素解码成 8 位灰度, 亮为 255; PBM 的 1 是黑
+int im_read_gray(FILE* f, const im_header* h, unsigned char* gray);
+
+// 面积平均缩放 (也可以放大), acc 至少 sw 个
+void im_downscale(const unsigned char* src, int sw, int sh, int stride,
+                unsigned char* dst, int dw, int dh, uint32_t* acc);
+// acc[i] += w * src[i], 缩放的纵向累加, 按编译选项用 SSE2 / NEON
+void im_accumulate(const unsigned char* src, int n, int w, uint32_t* acc);
+void im_accumulate_ref(const unsigned char* src, int n, int w, uint32_t* acc);
+// level 只给 IM_THRESHOLD 用, 灰度 >= level 亮
+void im_dither(const unsigned char* gray, int w, int h, im_dither_t mode, int level,
+                unsigned char* bits, int stride);
+
+// 打开或从缓存里取, im_close 后仍留在缓存里
+im_clip* im_open(const char* path, int width, int height, im_dither_t mode,
+                int level, bool invert);
+void im_close(im_clip* clip);
+// 第 index 帧, 第一次用到时转换, 之后直接拷贝
+int im_frame(im_clip* clip, int index, unsigned char* bits, int stride);
+
+// 'Effect image <path> [fps] [Threshold [level]|Floyd|Ordered] [Invert]'
+extern const struct led_effect_ops im_effect_ops;
+
+#endif
@@ -0,0 +1,561 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include "input.h"
+
+// 管道和套接字等数据的超时, 也是停止时最长的等待
+#define FI_POLL_MS      100
+// 共享内存没有通知, 按这个间隔看 head
+#define FI_SHM_POLL_US  1000
+
+#define HEADER_SIZE     ((int)sizeof(struct led_stream_header))
+
+static int64_t mono_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+int fi_init(frame_input* fi)
+{
+    pthread_condattr_t attr;
+    int i;
+
+    memset(fi, 0, sizeof(*fi));
+    fi->fd = -1;
+    for (i = 0; i < FI_SLOTS; i++)
+        fi->slots[i].own = fi->bufs[i];
+    fi->incoming = fi->bufs[FI_SLOTS];
+
+    if (pthread_mutex_init(&fi->lock, NULL))
+        return -1;
+    // fi_wait 按单调时钟算超时, 不受改系统时间影响
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    i = pthread_cond_init(&fi->ready, &attr);
+    pthread_condattr_destroy(&attr);
+
+    return i ? -1 : 0;
+}
+
+int fi_parse(const char* spec, fi_kind_t* kind, char* path)
+{
+    static const struct {
+        const char* name;
+        fi_kind_t kind;
+    } kinds[] = {
+        { "Pipe ", FI_PIPE },
+        { "Socket ", FI_SOCKET },
+        { "Shm ", FI_SHM },
+    };
+    int i, n;
+
+    for (i = 0; i < sizeof(kinds) / sizeof(kinds[0]); i++) {
+        n = strlen(kinds[i].name);
+        if (strncmp(spec, kinds[i].name, n) == 0)
+            break;
+    }
+    if (i == sizeof(kinds) / sizeof(kinds[0]))
+        return -1;
+
+    spec += n;
+    // 套接字路径受 sun_path 限制, 共享内存名要以 / 开头
+    if (!*spec || strlen(spec) >= FI_PATH_SIZE
+        || (kinds[i].kind == FI_SHM && (spec[0] != '/' || strchr(spec + 1, '/'))))
+        return -1;
+
+    *kind = kinds[i].kind;
+    strcpy(path, spec);
+
+    return 0;
+}
+
+static int row_bytes(const frame_input* fi, int format)
+{
+    return format == LED_STREAM_MONO ? (fi->width + 7) / 8 : fi->width;
+}
+
+// 只收和设备一样大的帧, 返回负载字节数
+static int check_header(frame_input* fi, const struct led_stream_header* h)
+{
+    int size;
+
+    if (h->magic != LED_STREAM_MAGIC || h->width != fi->width || h->height != fi->height)
+        return -1;
+    if (h->format != LED_STREAM_MONO && h->format != LED_STREAM_GRAY)
+        return -1;
+    if (h->stride < row_bytes(fi, h->format))
+        return -1;
+
+    size = h->height * h->stride;
+    return size <= FI_BYTES_MAX ? size : -1;
+}
+
+// 灰度就地转成单色, 行宽变成 (width + 7) / 8, 写的位置不会超过读的位置
+static int gray_to_mono(frame_input* fi, unsigned char* buf, int stride)
+{
+    int nb = row_bytes(fi, LED_STREAM_MONO);
+    int x, y, i;
+
+    for (y = 0; y < fi->height; y++) {
+        const unsigned char* src = buf + y * stride;
+        unsigned char* dst = buf + y * nb;
+
+        for (x = 0; x < nb; x++) {
+            unsigned char b = 0;
+
+            for (i = 0; i < 8 && x * 8 + i < fi->width; i++)
+                b |= (src[x * 8 + i] >> 7) << i;
+            dst[x] = b;
+        }
+    }
+
+    return nb;
+}
+
+// 放进环里, 满了丢最旧的; bits 为空时用 incoming, 和槽位的缓冲对调
+static void push(frame_input* fi, const unsigned char* bits, int stride, unsigned int seq)
+{
+    fi_slot* slot;
+    unsigned char* own;
+
+    pthread_mutex_lock(&fi->lock);
+    if (fi->head - fi->tail == FI_SLOTS) {
+        fi->tail++;
+        fi->dropped++;
+    }
+
+    slot = &fi->slots[fi->head % FI_SLOTS];
+    if (!bits) {
+        own = slot->own;
+        slot->own = fi->incoming;
+        fi->incoming = own;
+        bits = slot->own;
+    }
+    slot->bits = bits;
+    slot->stride = stride;
+    slot->shm_seq = seq;
+    fi->head++;
+    pthread_cond_signal(&fi->ready);
+    pthread_mutex_unlock(&fi->lock);
+}
+
+static void push_incoming(frame_input* fi, int format, int stride)
+{
+    if (format == LED_STREAM_GRAY)
+        stride = gray_to_mono(fi, fi->incoming, stride);
+    push(fi, NULL, stride, 0);
+}
+
+static void count_invalid(frame_input* fi)
+{
+    pthread_mutex_lock(&fi->lock);
+    fi->invalid++;
+    pthread_mutex_unlock(&fi->lock);
+}
+
+// 读满 n 字节, 停止或出错返回 -1
+static int read_full(frame_input* fi, unsigned char* buf, int n)
+{
+    struct pollfd pfd = { fi->fd, POLLIN, 0 };
+    int got = 0, r;
+
+    while (got < n) {
+        if (fi->exit)
+            return -1;
+        r = poll(&pfd, 1, FI_POLL_MS);
+        if (r <= 0) {
+            if (r < 0 && errno != EINTR)
+                return -1;
+            continue;
+        }
+
+        r = read(fi->fd, buf + got, n - got);
+        if (r < 0 && errno != EINTR && errno != EAGAIN)
+            return -1;
+        if (r > 0)
+            got += r;
+    }
+
+    return 0;
+}
+
+// 管道是字节流, 头部不对时按字节滑动重新找 magic, 负载直接读进 incoming
+static void pipe_loop(frame_input* fi)
+{
+    struct led_stream_header h;
+    unsigned char* p = (unsigned char*)&h;
+    bool lost = false;
+    int size;
+
+    if (read_full(fi, p, HEADER_SIZE) < 0)
+        return;
+
+    while (!fi->exit) {
+        size = check_header(fi, &h);
+        if (size < 0) {
+            if (!lost)
+                count_invalid(fi);
+            lost = true;
+            memmove(p, p + 1, HEADER_SIZE - 1);
+            if (read_full(fi, p + HEADER_SIZE - 1, 1) < 0)
+                return;
+            continue;
+        }
+
+        lost = false;
+        if (read_full(fi, fi->incoming, size) < 0)
+            return;
+        push_incoming(fi, h.format, h.stride);
+
+        if (read_full(fi, p, HEADER_SIZE) < 0)
+            return;
+    }
+}
+
+// 一个数据报一帧, 头部和负载分散读, 负载直接落进 incoming
+static void socket_loop(frame_input* fi)
+{
+    struct pollfd pfd = { fi->fd, POLLIN, 0 };
+    struct led_stream_header h;
+    struct iovec iov[2];
+    struct msghdr msg;
+    int n, size;
+
+    while (!fi->exit) {
+        n = poll(&pfd, 1, FI_POLL_MS);
+        if (n < 0 && errno != EINTR)
+            break;
+        if (n <= 0)
+            continue;
+
+        iov[0].iov_base = &h;
+        iov[0].iov_len = HEADER_SIZE;
+        iov[1].iov_base = fi->incoming;
+        iov[1].iov_len = FI_BYTES_MAX;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = 2;
+
+        n = recvmsg(fi->fd, &msg, MSG_DONTWAIT);
+        if (n < 0) {
+            if (errno == EINTR || errno == EAGAIN)
+                continue;
+            break;
+        }
+
+        size = n >= HEADER_SIZE ? check_header(fi, &h) : -1;
+        if (size < 0 || n != HEADER_SIZE + size || (msg.msg_flags & MSG_TRUNC)) {
+            count_invalid(fi);
+            continue;
+        }
+        push_incoming(fi, h.format, h.stride);
+    }
+}
+
+// 槽位数和大小只用打开时检查过的副本, 生产者之后改共享区里的值也越不了界
+static const unsigned char* shm_slot(const frame_input* fi, unsigned int seq)
+{
+    return (const unsigned char*)(fi->shm + 1) + (seq % fi->shm_slots) * fi->shm_slot_size;
+}
+
+// seq 所在的槽位还没被生产者重写
+static bool shm_intact(const frame_input* fi, unsigned int seq)
+{
+    __sync_synchronize();
+    return fi->shm->head - seq < fi->shm_slots;
+}
+
+// 单色帧不拷贝, 环里只放指向共享内存的指针, 载入后再确认没有被覆盖
+static void shm_loop(frame_input* fi)
+{
+    const struct led_stream_shm* shm = fi->shm;
+    struct led_stream_header h;
+    unsigned int seen = fi->shm_next, head;
+    const unsigned char* slot;
+    int size;
+
+    while (!fi->exit) {
+        head = shm->head;
+        if (head == seen) {
+            usleep(FI_SHM_POLL_US);
+            continue;
+        }
+        __sync_synchronize();
+
+        // 落后超过一圈, 中间的已经被覆盖了
+        if (head - seen > fi->shm_slots) {
+            pthread_mutex_lock(&fi->lock);
+            fi->dropped += head - seen - fi->shm_slots;
+            pthread_mutex_unlock(&fi->lock);
+            seen = head - fi->shm_slots;
+        }
+
+        for (; seen != head && !fi->exit; seen++) {
+            slot = shm_slot(fi, seen);
+            memcpy(&h, slot, HEADER_SIZE);
+            size = check_header(fi, &h);
+            if (size < 0 || size > fi->shm_slot_size - HEADER_SIZE || !shm_intact(fi, seen)) {
+                count_invalid(fi);
+                continue;
+            }
+
+            if (h.format == LED_STREAM_MONO) {
+                push(fi, slot + HEADER_SIZE, h.stride, seen);
+                continue;
+            }
+
+            memcpy(fi->incoming, slot + HEADER_SIZE, size);
+            if (!shm_intact(fi, seen)) {
+                count_invalid(fi);
+                continue;
+            }
+            push_incoming(fi, h.format, h.stride);
+        }
+    }
+}
+
+static void* input_fn(void* arg)
+{
+    frame_input* fi = (frame_input*)arg;
+
+    if (fi->kind == FI_PIPE)
+        pipe_loop(fi);
+    else if (fi->kind == FI_SOCKET)
+        socket_loop(fi);
+    else
+        shm_loop(fi);
+
+    // 出错退出时也要叫醒等帧的设备线程
+    pthread_mutex_lock(&fi->lock);
+    pthread_cond_broadcast(&fi->ready);
+    pthread_mutex_unlock(&fi->lock);
+
+    return NULL;
+}
+
+static int open_pipe(frame_input* fi)
+{
+    if (mkfifo(fi->path, FI_FIFO_MODE) < 0 && errno != EEXIST) {
+        fprintf(stderr, "error: [FI] mkfifo %s %d\n", fi->path, errno);
+        return -1;
+    }
+
+    // 自己也占着写端, 生产者关掉重开时读不到 EOF
+    fi->fd = open(fi->path, O_RDWR | O_NONBLOCK);
+    if (fi->fd < 0) {
+        fprintf(stderr, "error: [FI] open %s %d\n", fi->path, errno);
+        return -1;
+    }
+    // 已经存在的管道可能是别人建的或者更宽
+    if (fchmod(fi->fd, FI_FIFO_MODE) < 0) {
+        fprintf(stderr, "error: [FI] fchmod %s %d\n", fi->path, errno);
+        close(fi->fd);
+        fi->fd = -1;
+        return -1;
+    }
+
+    return 0;
+}
+
+static int open_socket(frame_input* fi)
+{
+    struct sockaddr_un addr;
+
+    fi->fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+    if (fi->fd < 0) {
+        fprintf(stderr, "error: [FI] socket %d\n", errno);
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, fi->path, sizeof(addr.sun_path) - 1);
+    unlink(fi->path);
+    if (bind(fi->fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        fprintf(stderr, "error: [FI] bind %s %d\n", fi->path, errno);
+        close(fi->fd);
+        fi->fd = -1;
+        return -1;
+    }
+
+    return 0;
+}
+
+// 共享区由生产者建好, 这里只读映射
+static int open_shm(frame_input* fi)
+{
+    struct led_stream_shm* shm;
+    struct stat st;
+    unsigned int slots, slot_size;
+    int fd;
+
+    fd = shm_open(fi->path, O_RDONLY, 0);
+    if (fd < 0) {
+        fprintf(stderr, "error: [FI] shm_open %s %d\n", fi->path, errno);
+        return -1;
+    }
+    if (fstat(fd, &st) < 0 || st.st_size < sizeof(*shm)) {
+        fprintf(stderr, "error: [FI] shm %s too small\n", fi->path);
+        close(fd);
+        return -1;
+    }
+
+    shm = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (shm == MAP_FAILED) {
+        fprintf(stderr, "error: [FI] mmap %d\n", errno);
+        return -1;
+    }
+
+    // 只读一次再检查, 检查和使用的是同一份值
+    slots = shm->slots;
+    slot_size = shm->slot_size;
+    if (shm->magic != LED_STREAM_MAGIC || !slots || slot_size < HEADER_SIZE
+        || (st.st_size - sizeof(*shm)) / slots < slot_size) {
+        fprintf(stderr, "error: [FI] shm %s bad layout\n", fi->path);
+        munmap(shm, st.st_size);
+        return -1;
+    }
+
+    fi->shm = shm;
+    fi->shm_slots = slots;
+    fi->shm_slot_size = slot_size;
+    fi->shm_size = st.st_size;
+    // 从生产者当前这一帧开始, 更早的不补
+    fi->shm_next = shm->head ? shm->head - 1 : 0;
+
+    return 0;
+}
+
+int fi_start(frame_input* fi, const char* spec, int width, int height)
+{
+    fi_kind_t kind;
+    int ret;
+
+    if (fi_parse(spec, &kind, fi->path) < 0) {
+        fprintf(stderr, "error: [FI] invalid %s\n", spec);
+        return -1;
+    }
+    if (width * height > FI_BYTES_MAX) {
+        fprintf(stderr, "error: [FI] %dx%d too large\n", width, height);
+        return -1;
+    }
+
+    fi_stop(fi);
+    fi->kind = kind;
+    fi->width = width;
+    fi->height = height;
+
+    if (kind == FI_PIPE)
+        ret = open_pipe(fi);
+    else if (kind == FI_SOCKET)
+        ret = open_socket(fi);
+    else
+        ret = open_shm(fi);
+    if (ret < 0)
+        return -2;
+
+    fi->exit = false;
+    if (pthread_create(&fi->pid, NULL, input_fn, fi)) {
+        fprintf(stderr, "error: [FI] create pthread\n");
+        fi->running = true;
+        fi->exit = true;
+        fi_stop(fi);
+        return -3;
+    }
+    fi->running = true;
+
+    return 0;
+}
+
+void fi_stop(frame_input* fi)
+{
+    if (!fi->running)
+        return;
+
+    if (!fi->exit) {
+        fi->exit = true;
+        pthread_join(fi->pid, NULL);
+    }
+
+    if (fi->fd >= 0) {
+        close(fi->fd);
+        fi->fd = -1;
+    }
+    // 管道留给生产者, 套接字是自己绑的
+    if (fi->kind == FI_SOCKET)
+        unlink(fi->path);
+    if (fi->shm) {
+        munmap(fi->shm, fi->shm_size);
+        fi->shm = NULL;
+    }
+
+    pthread_mutex_lock(&fi->lock);
+    fi->running = false;
+    fi->head = fi->tail = 0;
+    pthread_cond_broadcast(&fi->ready);
+    pthread_mutex_unlock(&fi->lock);
+}
+
+void fi_wait(frame_input* fi, int64_t timeout_ns)
+{
+    int64_t ns = mono_ns() + timeout_ns;
+    struct timespec ts;
+
+    ts.tv_sec = ns / 1000000000LL;
+    ts.tv_nsec = ns % 1000000000LL;
+
+    pthread_mutex_lock(&fi->lock);
+    while (fi->running && !fi->exit && !fi->woken && fi->head == fi->tail) {
+        if (pthread_cond_timedwait(&fi->ready, &fi->lock, &ts) == ETIMEDOUT)
+            break;
+    }
+    fi->woken = false;
+    pthread_mutex_unlock(&fi->lock);
+}
+
+void fi_wake(frame_input* fi)
+{
+    pthread_mutex_lock(&fi->lock);
+    fi->woken = true;
+    pthread_cond_broadcast(&fi->ready);
+    pthread_mutex_unlock(&fi->lock);
+}
+
+int fi_load(frame_input* fi, led_render* lr)
+{
+    fi_slot* slot;
+    int ret = 1;
+
+    pthread_mutex_lock(&fi->lock);
+    if (fi->head == fi->tail) {
+        pthread_mutex_unlock(&fi->lock);
+        return 0;
+    }
+
+    slot = &fi->slots[fi->tail++ % FI_SLOTS];
+    lr_load(lr, slot->bits, slot->stride);
+    // 指向共享内存的帧在载入途中被重写了, 这一帧作废
+    if (slot->bits != slot->own && !shm_intact(fi, slot->shm_seq)) {
+        fi->invalid++;
+        ret = -1;
+    }
+    else {
+        fi->frames++;
+    }
+    pthread_mutex_unlock(&fi->lock);
+
+    return ret;
+}
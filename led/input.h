@@ -0,0 +1,79 @@
+#ifndef _INPUT_H_
+#define _INPUT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "render.h"
+#include "stream.h"
+
+// 每设备最多积压的帧, 满了丢最旧的
+#define FI_SLOTS        4
+// 一帧负载的上限, 32x32 灰度
+#define FI_BYTES_MAX    1024
+#define FI_PATH_SIZE    64
+// 管道只让服务自己的用户写
+#define FI_FIFO_MODE    0600
+
+typedef enum fi_kind {
+    FI_PIPE,
+    FI_SOCKET,
+    FI_SHM,
+} fi_kind_t;
+
+typedef struct fi_slot {
+    unsigned char* own;             // 自有缓冲, 和接收缓冲对调, 不拷贝
+    const unsigned char* bits;      // 要载入的数据, own 或共享内存里的单色帧
+    int stride;
+    unsigned int shm_seq;           // 共享内存帧号, 载入后检查有没有被覆盖
+} fi_slot;
+
+// 设备的外部帧输入: 接收线程收帧放进 slots, 设备线程取出载入显存
+// lock/ready 在注册设备时建好, 和设备同生命周期
+typedef struct frame_input {
+    fi_kind_t kind;
+    char path[FI_PATH_SIZE];
+    int width;
+    int height;
+    bool running;
+    volatile bool exit;
+    pthread_t pid;
+
+    int fd;
+    struct led_stream_shm* shm;
+    size_t shm_size;
+    unsigned int shm_slots;         // 打开时检查过的布局, 之后不再读共享区里的
+    unsigned int shm_slot_size;
+    unsigned int shm_next;          // 下一个要读的共享内存帧号
+
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    fi_slot slots[FI_SLOTS];
+    unsigned int head;
+    unsigned int tail;
+    bool woken;                     // fi_wake 叫醒 fi_wait, 取走后清掉
+    unsigned char* incoming;        // 接收线程正在收的缓冲, 灰度帧就地转成单色
+    unsigned char bufs[FI_SLOTS + 1][FI_BYTES_MAX];
+
+    unsigned int frames;
+    unsigned int dropped;
+    unsigned int invalid;
+} frame_input;
+
+int fi_init(frame_input* fi);
+
+// "Pipe /tmp/led.fifo", "Socket /tmp/led.sock", "Shm /name"
+int fi_parse(const char* spec, fi_kind_t* kind, char* path);
+// 打开传输并起接收线程, 已经在收的先停掉, 失败返回负数
+int fi_start(frame_input* fi, const char* spec, int width, int height);
+void fi_stop(frame_input* fi);
+
+// 等到有帧, 停止或超时, 不持设备锁调用
+void fi_wait(frame_input* fi, int64_t timeout_ns);
+// 让正在或将要 fi_wait 的设备线程马上返回, 注销设备时用
+void fi_wake(frame_input* fi);
+// 最旧的一帧载入 lr 的显存, 持设备锁调用
+// 返回 1 载入了, 0 没有帧, -1 共享内存里的帧载入途中被覆盖, 显存要等下一帧
+int fi_load(frame_input* fi, led_render* lr);
+
+#endif
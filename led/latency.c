@@ -0,0 +1,310 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include "render.h"
+#include "service.h"
+#include "spectrum.h"
+#include "trace.h"
+
+// 音频到灯的端到端延迟, 主机上编译运行: make latency CROSS_COMPILE=
+// 模拟音频线程按实际节拍往 uni_hal_led_feed_pcm 喂静音, 隔一段时间插入一个带编号的
+// 短音 (每次换一个频率, 落在不同的柱上), 同一时刻只有一个在途
+// 短音取共享频段的中心频率, Goertzel 只看这些频率, 三种分析方式都能比
+// 设备用 LR_NULL_NODE, 通过 lr_set_sink 在真正写设备的那一刻取时间和整帧,
+// 亮点数超过静音时的基线就算这个编号到了
+//
+//  ./latency [-f fps] [-n 次数] [-b 每次喂的样本数] [-s FFT 大小]
+//            [-a FFT|Goertzel|Filter] [-l 干扰线程数] [-r 采样率] [-p 调度配置]
+//
+// 报三组分布: 送入到写出 (total), 送入那一次 feed 的耗时 (feed), 相邻两次写出的间隔 (frame)
+// 库带 -DLED_TRACE 编译时再按埋点把 total 拆成三段: 送入到之后第一次发布快照 (analyse),
+// 发布到设备线程画完亮起的那一帧 (draw), 画完到写出 (write)
+// -p 给设备线程发 'Realtime <配置>', 如 -p "Fifo 50 Cpu 1", 结束时再打印设备线程的唤醒延迟
+#define LAT_NODE        LR_NULL_NODE
+#define LAT_BURST_MS    40
+#define LAT_GAP_MS      300
+// 设备线程可能还在空闲轮询里, 等它切到 Wave Rate 后再取基线
+#define LAT_WARMUP_MS   1000
+#define LAT_TIMEOUT_MS  2000
+#define LAT_LIT         4
+#define LAT_FRAMES      4096
+#define LAT_TONES       4
+
+typedef struct lat_stats {
+    int64_t* ns;
+    int nr;
+    int max;
+} lat_stats;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static int pending;             // 在途的编号, 0 表示没有
+static int64_t written_ns;      // 在途编号第一次写出的时刻
+static int lit_base = -1;       // 静音时的亮点数
+static int lit_last;
+static int64_t last_write_ns;
+static lat_stats frames;
+static volatile bool stop;
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void sleep_until(int64_t ns)
+{
+    struct timespec ts;
+
+    ts.tv_sec = ns / 1000000000LL;
+    ts.tv_nsec = ns % 1000000000LL;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+        ;
+}
+
+static void stats_add(lat_stats* st, int64_t ns)
+{
+    if (st->nr < st->max)
+        st->ns[st->nr++] = ns;
+}
+
+static int cmp_ns(const void* a, const void* b)
+{
+    int64_t x = *(const int64_t*)a, y = *(const int64_t*)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static void stats_print(const char* name, lat_stats* st)
+{
+    int64_t* v = st->ns;
+    int n = st->nr;
+
+    if (!n) {
+        printf("%-8s no samples\n", name);
+        return;
+    }
+
+    qsort(v, n, sizeof(v[0]), cmp_ns);
+    printf("%-8s %5d %9.2f %9.2f %9.2f %9.2f %9.2f\n", name, n,
+            v[0] / 1e6, v[n / 2] / 1e6, v[n * 9 / 10] / 1e6,
+            v[n * 99 / 100] / 1e6, v[n - 1] / 1e6);
+}
+
+// 设备线程里调用, 持着设备锁, 只做计数和取时间
+static void capture(const led_render* lr, const unsigned char* frame, int nr_bytes)
+{
+    int64_t now = now_ns();
+    int i, lit = 0;
+
+    for (i = 0; i < lr->sz_data; i++)
+        lit += __builtin_popcount(frame[i]);
+
+    pthread_mutex_lock(&lock);
+    if (last_write_ns)
+        stats_add(&frames, now - last_write_ns);
+    last_write_ns = now;
+    lit_last = lit;
+    if (pending && !written_ns && lit_base >= 0 && lit >= lit_base + LAT_LIT)
+        written_ns = now;
+    pthread_mutex_unlock(&lock);
+}
+
+static void* load_fn(void* arg)
+{
+    volatile unsigned int spin = 0;
+
+    while (!stop)
+        spin++;
+
+    return NULL;
+}
+
+static void tone(short* buf, int n, int rate, float freq, int64_t* phase)
+{
+    int i;
+
+    for (i = 0; i < n; i++, (*phase)++)
+        buf[i] = (short)(24000 * sin(2 * M_PI * freq * *phase / rate));
+}
+
+static int ctrl(const char* fmt, const char* arg, int val)
+{
+    char cmd[64];
+
+    if (arg)
+        snprintf(cmd, sizeof(cmd), fmt, arg);
+    else
+        snprintf(cmd, sizeof(cmd), fmt, val);
+
+    return uni_hal_led_ctrl(LAT_NODE, cmd);
+}
+
+int main(int argc, char* argv[])
+{
+    float freqs[LAT_TONES];
+    const char* analyser = "FFT";
+    const char* profile = NULL;
+    int fps = 30, count = 50, block = 256, nfft = 512, loads = 0, rate = 44100;
+    lat_stats total = { 0 }, feed = { 0 }, analyse = { 0 }, render = { 0 }, output = { 0 };
+    pthread_t* threads = NULL;
+    int64_t period, next, inject = 0, gap, t0, phase = 0;
+    int tag = 0, burst = 0, missed = 0;
+    short* buf;
+    int i, opt;
+
+    while ((opt = getopt(argc, argv, "f:n:b:s:a:l:r:p:")) != -1) {
+        switch (opt) {
+        case 'f': fps = atoi(optarg); break;
+        case 'n': count = atoi(optarg); break;
+        case 'b': block = atoi(optarg); break;
+        case 's': nfft = atoi(optarg); break;
+        case 'a': analyser = optarg; break;
+        case 'l': loads = atoi(optarg); break;
+        case 'r': rate = atoi(optarg); break;
+        case 'p': profile = optarg; break;
+        default:
+            fprintf(stderr, "usage: %s [-f fps] [-n count] [-b block] [-s nfft]"
+                    " [-a FFT|Goertzel|Filter] [-l loads] [-r rate] [-p profile]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (count <= 0 || block <= 0 || rate <= 0) {
+        fprintf(stderr, "error: [LAT] invalid param\n");
+        return 2;
+    }
+
+    // 在共享频段里均匀取几段, 从低音到高音
+    for (i = 0; i < LAT_TONES; i++)
+        freqs[i] = bm_centre(SHARED_BANDS * (2 * i + 1) / (2 * LAT_TONES),
+                        SHARED_BANDS, BAND_FMIN, BAND_FMAX);
+
+    buf = malloc(block * sizeof(*buf));
+    total.ns = malloc(count * sizeof(int64_t));
+    feed.ns = malloc(count * sizeof(int64_t));
+    analyse.ns = malloc(count * sizeof(int64_t));
+    render.ns = malloc(count * sizeof(int64_t));
+    output.ns = malloc(count * sizeof(int64_t));
+    frames.ns = malloc(LAT_FRAMES * sizeof(int64_t));
+    if (!buf || !total.ns || !feed.ns || !analyse.ns || !render.ns || !output.ns || !frames.ns) {
+        fprintf(stderr, "error: [LAT] malloc\n");
+        return 2;
+    }
+    total.max = feed.max = analyse.max = render.max = output.max = count;
+    frames.max = LAT_FRAMES;
+
+    lr_set_sink(capture);
+    if (uni_hal_led_register(LAT_NODE) < 0)
+        return 2;
+    if (ctrl("Spectrum %s", analyser, 0) < 0 || ctrl("Spectrum Size %d", NULL, nfft) < 0
+        || ctrl("Spectrum Rate %d", NULL, rate) < 0 || ctrl("Wave Rate %d", NULL, fps) < 0
+        || (profile && ctrl("Realtime %s", profile, 0) < 0))
+        goto out;
+
+    if (loads > 0) {
+        threads = calloc(loads, sizeof(*threads));
+        for (i = 0; threads && i < loads; i++)
+            pthread_create(&threads[i], NULL, load_fn, NULL);
+    }
+
+    // 按音频设备的节拍喂数据, 先喂一段静音取基线
+    period = block * 1000000000LL / rate;
+    gap = LAT_GAP_MS * 1000000LL;
+    t0 = next = now_ns();
+    while (total.nr + missed < count) {
+        int64_t now, t_feed, done = 0, publish, drawn;
+        int written = 0;
+        bool first;
+
+        pthread_mutex_lock(&lock);
+        if (lit_base < 0 && next - t0 > LAT_WARMUP_MS * 1000000LL && last_write_ns)
+            lit_base = lit_last;
+        if (pending) {
+            if (written_ns) {
+                stats_add(&total, written_ns - inject);
+                done = written_ns;
+                written = 1;
+            }
+            else if (next - inject > LAT_TIMEOUT_MS * 1000000LL) {
+                missed++;
+                written = 1;
+            }
+            if (written) {
+                pending = 0;
+                written_ns = 0;
+            }
+        }
+        if (!pending && lit_base >= 0 && next - inject > gap + LAT_BURST_MS * 1000000LL) {
+            pending = ++tag;
+            burst = LAT_BURST_MS * rate / 1000;
+            phase = 0;
+        }
+        pthread_mutex_unlock(&lock);
+
+        // 在 [送入, 写出] 里找埋点: 第一次发布, 和写出前最后画完的一帧
+        if (done) {
+            publish = tr_find("publish", 'i', inject, done, 0);
+            drawn = publish > 0 ? tr_find("draw", 'E', publish, done, 1) : 0;
+            if (drawn > 0) {
+                stats_add(&analyse, publish - inject);
+                stats_add(&render, drawn - publish);
+                stats_add(&output, done - drawn);
+            }
+        }
+
+        first = burst > 0 && phase == 0;
+        if (burst > 0) {
+            tone(buf, block, rate, freqs[tag % LAT_TONES], &phase);
+            burst -= block;
+        }
+        else {
+            memset(buf, 0, block * sizeof(*buf));
+        }
+
+        now = now_ns();
+        if (first)
+            inject = now;
+        uni_hal_led_feed_pcm(buf, block, UNI_HAL_LED_S16, 1);
+        t_feed = now_ns() - now;
+        if (first)
+            stats_add(&feed, t_feed);
+
+        next += period;
+        sleep_until(next);
+    }
+
+    printf("latency: %s nfft %d, block %d @ %d Hz, %d fps, %d load threads, %s, %d missed\n",
+            analyser, nfft, block, rate, fps, loads, profile ? profile : "Other", missed);
+    printf("%-8s %5s %9s %9s %9s %9s %9s (ms)\n", "", "n", "min", "p50", "p90", "p99", "max");
+    stats_print("total", &total);
+    if (tr_find("publish", 'i', 0, 0, 0) < 0) {
+        printf("%-8s built without LED_TRACE\n", "stages");
+    }
+    else {
+        stats_print("analyse", &analyse);
+        stats_print("draw", &render);
+        stats_print("write", &output);
+    }
+    stats_print("feed", &feed);
+    pthread_mutex_lock(&lock);
+    stats_print("frame", &frames);
+    pthread_mutex_unlock(&lock);
+    ctrl("Realtime Stats", NULL, 0);
+
+out:
+    stop = true;
+    for (i = 0; threads && i < loads; i++)
+        pthread_join(threads[i], NULL);
+    uni_hal_led_unregister(LAT_NODE);
+    lr_set_sink(NULL);
+
+    return missed ? 1 : 0;
+}
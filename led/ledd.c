@@ -0,0 +1,23 @@
+#include <stdio.h>
+#include <signal.h>
+#include "service.h"
+
+// 持有面板的守护进程: ledd hbs1632.0 [hbs1632.1 ...]
+// 其他进程照常调用 uni_hal_led_*, 自动变成客户端
+static void on_signal(int sig)
+{
+    uni_hal_led_daemon_stop();
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <led node> ...\n", argv[0]);
+        return 1;
+    }
+
+    signal(SIGTERM, on_signal);
+    signal(SIGINT, on_signal);
+
+    return uni_hal_led_daemon((const char**)argv + 1, argc - 1) < 0 ? 1 : 0;
+}
@@ -0,0 +1,411 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include "utils.h"
+#include "player.h"
+#include "clock.h"
+#include "image.h"
+#include "face.h"
+
+// 一帧里效果最多占 1/EFFECT_DUTY, 超了就降帧率
+#define EFFECT_DUTY     4
+
+static const struct led_effect_ops* effects[EFFECT_MAX];
+static pthread_mutex_t effect_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t builtin_once = PTHREAD_ONCE_INIT;
+
+static void register_builtins(void);
+
+bool ep_reserved(const char* name)
+{
+    static const char* verbs[] = { "Load", "Stop", "Pause", "Resume", "Event" };
+    int i;
+
+    for (i = 0; i < sizeof(verbs) / sizeof(verbs[0]); i++) {
+        if (strcmp(name, verbs[i]) == 0)
+            return true;
+    }
+
+    return false;
+}
+
+int64_t ep_now(void)
+{
+    return lc_now(CLOCK_MONOTONIC);
+}
+
+static int do_register(const struct led_effect_ops* ops)
+{
+    int i, ret = -1;
+
+    if (!ops || ops->abi != LED_EFFECT_ABI || !ops->name
+        || !ops->init || !ops->render || ops->fps < 0) {
+        fprintf(stderr, "error: [EP] register invalid ops %s\n",
+                ops && ops->name ? ops->name : "???");
+        return -1;
+    }
+    // 同名的效果会被当成播放控制, 永远选不中
+    if (ep_reserved(ops->name)) {
+        fprintf(stderr, "error: [EP] register %s reserved name\n", ops->name);
+        return -1;
+    }
+
+    pthread_mutex_lock(&effect_lock);
+    for (i = 0; i < EFFECT_MAX; i++) {
+        if (effects[i] && strcmp(effects[i]->name, ops->name) == 0) {
+            effects[i] = ops;
+            ret = 0;
+            break;
+        }
+    }
+    for (i = 0; ret && i < EFFECT_MAX; i++) {
+        if (!effects[i]) {
+            effects[i] = ops;
+            ret = 0;
+        }
+    }
+    pthread_mutex_unlock(&effect_lock);
+
+    if (ret)
+        fprintf(stderr, "error: [EP] register %s table full\n", ops->name);
+    return ret;
+}
+
+int ep_register(const struct led_effect_ops* ops)
+{
+    pthread_once(&builtin_once, register_builtins);
+    return do_register(ops);
+}
+
+int uni_hal_led_effect_register(const struct led_effect_ops *ops)
+{
+    return ep_register(ops);
+}
+
+const struct led_effect_ops* ep_find(const char* name)
+{
+    const struct led_effect_ops* ops = NULL;
+    int i;
+
+    pthread_once(&builtin_once, register_builtins);
+
+    pthread_mutex_lock(&effect_lock);
+    for (i = 0; i < EFFECT_MAX; i++) {
+        if (effects[i] && strcmp(effects[i]->name, name) == 0) {
+            ops = effects[i];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&effect_lock);
+
+    return ops;
+}
+
+const char* ep_load(const char* path)
+{
+    led_effect_entry_fn entry;
+    const struct led_effect_ops* ops;
+    void* handle;
+
+    // 插件一旦注册就不卸载, 别的设备可能还在跑它
+    handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (!handle) {
+        fprintf(stderr, "error: [EP] load %s\n", dlerror());
+        return NULL;
+    }
+
+    entry = (led_effect_entry_fn)dlsym(handle, LED_EFFECT_ENTRY);
+    ops = entry ? entry() : NULL;
+    if (!ops || ep_register(ops)) {
+        fprintf(stderr, "error: [EP] load %s no valid entry\n", path);
+        dlclose(handle);
+        return NULL;
+    }
+
+    return ops->name;
+}
+
+static void set_period(effect_player* ep)
+{
+    const struct led_effect_ops* ops = ep->ops;
+    int64_t period = ops->fps ? 1000000000LL / ops->fps : 0;
+    int64_t cost = MAX((int64_t)ops->budget_us * 1000, ep->cost_ns);
+
+    if (period && cost * EFFECT_DUTY > period) {
+        period = cost * EFFECT_DUTY;
+        if (!ep->warned) {
+            printf("[EP] %s costs %lld us, %d fps -> %lld fps\n", ops->name,
+                    (long long)(cost / 1000), ops->fps,
+                    (long long)(1000000000LL / period));
+            ep->warned = true;
+        }
+    }
+
+    ep->period_ns = period;
+}
+
+int ep_start(effect_player* ep, const char* name, int width, int height,
+                const char* args)
+{
+    const struct led_effect_ops* ops = ep_find(name);
+    void* ctx;
+
+    if (!ops) {
+        fprintf(stderr, "error: [EP] no effect %s\n", name);
+        return -1;
+    }
+
+    if ((width + 7) / 8 * height > EFFECT_BITS) {
+        fprintf(stderr, "error: [EP] %dx%d too large\n", width, height);
+        return -1;
+    }
+
+    ctx = ops->init(width, height, args);
+    if (!ctx) {
+        fprintf(stderr, "error: [EP] %s init failed\n", name);
+        return -1;
+    }
+
+    ep_stop(ep);
+    ep->ops = ops;
+    ep->ctx = ctx;
+    ep->fb.width = width;
+    ep->fb.height = height;
+    ep->fb.stride = (width + 7) / 8;
+    ep->fb.bits = ep->bits;
+    ep->next_ns = ep_now();
+    ep->dirty = true;
+    set_period(ep);
+
+    return 0;
+}
+
+void ep_stop(effect_player* ep)
+{
+    if (ep->ops && ep->ops->teardown)
+        ep->ops->teardown(ep->ctx);
+
+    memset(ep, 0, sizeof(*ep));
+}
+
+void ep_event(effect_player* ep, int event, const char* arg)
+{
+    if (!ep->ops)
+        return;
+
+    if (event == LED_EFFECT_PAUSE)
+        ep->paused = true;
+    else if (event == LED_EFFECT_RESUME)
+        ep->paused = false;
+
+    if (ep->ops->event)
+        ep->ops->event(ep->ctx, event, arg);
+    ep->dirty = true;
+}
+
+int ep_frame(effect_player* ep, int64_t now_ns, const int* levels, int nr_levels)
+{
+    struct led_effect_input in;
+    int64_t t0, cost;
+    int ret;
+
+    if (!ep->ops || ep->paused)
+        return 0;
+    if (ep->period_ns ? now_ns < ep->next_ns : !ep->dirty)
+        return 0;
+
+    in.frame = ep->frame;
+    in.now_ns = now_ns;
+    in.nr_levels = nr_levels;
+    in.levels = levels;
+
+    t0 = ep_now();
+    ret = ep->ops->render(ep->ctx, &ep->fb, &in);
+    cost = ep_now() - t0;
+
+    // 1/8 的滑动平均, 实测超出预算时再调一次帧周期
+    ep->cost_ns = ep->cost_ns ? ep->cost_ns + (cost - ep->cost_ns) / 8 : cost;
+    if (ep->cost_ns > (int64_t)ep->ops->budget_us * 1000)
+        set_period(ep);
+
+    ep->frame++;
+    ep->dirty = false;
+    if (ep->period_ns) {
+        ep->next_ns += ep->period_ns;
+        // 落后就跳过错过的帧, 不追
+        if (ep->next_ns <= now_ns)
+            ep->next_ns = now_ns + ep->period_ns;
+        // 1 fps 的 (时钟) 和时钟场景一样对齐到墙上时间的下一个整秒
+        if (ep->period_ns == 1000000000LL)
+            ep->next_ns = now_ns + 1000000000LL - lc_now(CLOCK_REALTIME) % 1000000000LL;
+    }
+
+    if (ret < 0) {
+        ep_stop(ep);
+        return -1;
+    }
+
+    return ret > 0;
+}
+
+int64_t ep_next(const effect_player* ep, int64_t now_ns, int64_t idle_ns)
+{
+    if (!ep->ops || ep->paused || !ep->period_ns)
+        return now_ns + idle_ns;
+
+    return MIN(ep->next_ns, now_ns + idle_ns);
+}
+
+// 内置效果
+
+#define LOVE_WIDTH  16
+#define LOVE_HEIGHT 12
+
+static void* love_init(int width, int height, const char* args)
+{
+    static int dummy;
+
+    return &dummy;
+}
+
+static int love_render(void* ctx, struct led_frame* frame,
+                    const struct led_effect_input* in)
+{
+    static const uint16_t map[LOVE_HEIGHT] = {
+        0x3c78, 0x7efc, 0x7ffc, 0x7ffc, 0x7ffc, 0x3ff8,
+        0x3ff8, 0x1ff0, 0x0fe0, 0x07c0, 0x0380, 0x0100,
+    };
+    int y0 = (frame->height - LOVE_HEIGHT) / 2;
+    int x, y;
+
+    memset(frame->bits, 0, frame->stride * frame->height);
+    for (y = 0; y < LOVE_HEIGHT && y0 + y < frame->height; y++) {
+        for (x = 0; x < LOVE_WIDTH && x < frame->width; x++) {
+            // map 最高位是最左边
+            if (map[y] & (0x8000 >> x))
+                frame->bits[(y0 + y) * frame->stride + x / 8] |= 1 << (x % 8);
+        }
+    }
+
+    return 1;
+}
+
+static const struct led_effect_ops love_ops = {
+    .abi = LED_EFFECT_ABI,
+    .name = "love",
+    .fps = 0,
+    .budget_us = 50,
+    .init = love_init,
+    .render = love_render,
+};
+
+static void set_pixel(struct led_frame* frame, int x, int y)
+{
+    frame->bits[y * frame->stride + x / 8] |= 1 << (x % 8);
+}
+
+// 频谱柱, 和设备视图的柱数一致
+static void* bars_init(int width, int height, const char* args)
+{
+    static int dummy;
+
+    return &dummy;
+}
+
+static int bars_render(void* ctx, struct led_frame* frame,
+                    const struct led_effect_input* in)
+{
+    int cw, x, y, h;
+
+    memset(frame->bits, 0, frame->stride * frame->height);
+    if (!in->nr_levels)
+        return 1;
+
+    cw = MAX(frame->width / in->nr_levels, 1);
+    for (x = 0; x < frame->width && x / cw < in->nr_levels; x++) {
+        h = CLIP(in->levels[x / cw], 0, frame->height);
+        for (y = frame->height - h; y < frame->height; y++)
+            set_pixel(frame, x, y);
+    }
+
+    return 1;
+}
+
+static const struct led_effect_ops bars_ops = {
+    .abi = LED_EFFECT_ABI,
+    .name = "bars",
+    .fps = 20,
+    .budget_us = 50,
+    .init = bars_init,
+    .render = bars_render,
+};
+
+// 时钟, 和时钟场景同一个表盘, 每个整秒只重画变了的数字和秒条
+typedef struct clock_ctx {
+    time_t tnow;        // 0 表示还没画过
+    struct tm now;
+} clock_ctx;
+
+static void frame_dot(void* ctx, int x, int y, int on)
+{
+    struct led_frame* frame = ctx;
+
+    if (on)
+        set_pixel(frame, x, y);
+    else
+        frame->bits[y * frame->stride + x / 8] &= ~(1 << (x % 8));
+}
+
+static void* clock_init(int width, int height, const char* args)
+{
+    if (width < 16 || height < 16)
+        return NULL;
+    tzset();
+    return calloc(1, sizeof(clock_ctx));
+}
+
+static int clock_render(void* ctx, struct led_frame* frame,
+                    const struct led_effect_input* in)
+{
+    clock_ctx* c = ctx;
+    time_t now = lc_time();
+    struct tm tm;
+
+    if (now == c->tnow)
+        return 0;
+
+    if (c->tnow) {
+        lf_step(c->tnow, &c->now, now, &tm);
+        lf_draw(&c->now, &tm, frame->width, frame->height, frame_dot, frame);
+    }
+    else {
+        localtime_r(&now, &tm);
+        memset(frame->bits, 0, frame->stride * frame->height);
+        lf_draw(NULL, &tm, frame->width, frame->height, frame_dot, frame);
+    }
+    c->tnow = now;
+    c->now = tm;
+
+    return 1;
+}
+
+static const struct led_effect_ops clock_ops = {
+    .abi = LED_EFFECT_ABI,
+    .name = "clock",
+    .fps = 1,
+    .budget_us = 50,
+    .init = clock_init,
+    .render = clock_render,
+    .teardown = free,
+};
+
+static void register_builtins(void)
+{
+    do_register(&love_ops);
+    do_register(&bars_ops);
+    do_register(&clock_ops);
+    do_register(&im_effect_ops);
+}
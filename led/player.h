@@ -0,0 +1,48 @@
+#ifndef _PLAYER_H_
+#define _PLAYER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "effect.h"
+
+#define EFFECT_MAX      16
+#define EFFECT_BITS     128
+
+// 设备上正在跑的效果, 只由设备线程和持有设备锁的 session_exec 访问
+typedef struct effect_player {
+    const struct led_effect_ops* ops;
+    void* ctx;
+
+    int64_t period_ns;      // 0 表示只在事件后重画
+    int64_t cost_ns;        // render 耗时的滑动平均
+    int64_t next_ns;
+    uint64_t frame;
+    bool dirty;
+    bool paused;
+    bool warned;
+
+    struct led_frame fb;
+    unsigned char bits[EFFECT_BITS];
+} effect_player;
+
+int ep_register(const struct led_effect_ops* ops);
+// dlopen 插件并注册, 返回效果名, 失败返回 NULL
+const char* ep_load(const char* path);
+const struct led_effect_ops* ep_find(const char* name);
+// 'Effect' 的控制字 Load/Stop/Pause/Resume/Event, 不能用作效果名
+bool ep_reserved(const char* name);
+
+int ep_start(effect_player* ep, const char* name, int width, int height,
+                const char* args);
+void ep_stop(effect_player* ep);
+void ep_event(effect_player* ep, int event, const char* arg);
+
+// 到时间就调一次 render, 返回 1 表示 fb 有变化, -1 表示效果要求停止
+int ep_frame(effect_player* ep, int64_t now_ns, const int* levels, int nr_levels);
+// 下一次要渲染的时刻, 只在事件后重画的效果返回 now + idle_ns
+int64_t ep_next(const effect_player* ep, int64_t now_ns, int64_t idle_ns);
+
+// CLOCK_MONOTONIC, 取自 lc_now, 装了虚拟时钟时跟着它走
+int64_t ep_now(void);
+
+#endif
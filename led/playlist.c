@@ -0,0 +1,292 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "utils.h"
+#include "playlist.h"
+
+#define PL_WORDS    (EFFECT_BITS / 4)
+
+static void set_bit(uint32_t* mask, int stride, int x, int y)
+{
+    unsigned char* p = (unsigned char*)mask;
+
+    p[y * stride + x / 8] |= 1 << (x % 8);
+}
+
+// 掩码第 k 步为 1 的点取新场景, 每步都包含上一步
+static void init_masks(playlist* pl)
+{
+    int n = pl->width * pl->height;
+    int order[EFFECT_BITS * 8];
+    unsigned int seed = 0x1632;
+    int k, i, j, t, x, y;
+
+    memset(pl->wipe, 0, sizeof(pl->wipe));
+    memset(pl->dissolve, 0, sizeof(pl->dissolve));
+
+    for (k = 0; k < PL_STEPS; k++) {
+        for (y = 0; y < pl->height; y++) {
+            for (x = 0; x < (k + 1) * pl->width / PL_STEPS; x++)
+                set_bit(pl->wipe[k], pl->stride, x, y);
+        }
+    }
+
+    // 固定种子的洗牌, 每次的溶解图案一样
+    for (i = 0; i < n; i++)
+        order[i] = i;
+    for (i = n - 1; i > 0; i--) {
+        seed = seed * 1103515245 + 12345;
+        j = (seed >> 16) % (i + 1);
+        t = order[i];
+        order[i] = order[j];
+        order[j] = t;
+    }
+    for (k = 0; k < PL_STEPS; k++) {
+        for (i = 0; i < (k + 1) * n / PL_STEPS; i++)
+            set_bit(pl->dissolve[k], pl->stride, order[i] % pl->width, order[i] / pl->width);
+    }
+}
+
+void pl_init(playlist* pl, int width, int height)
+{
+    memset(pl, 0, sizeof(*pl));
+    pl->width = width;
+    pl->height = height;
+    pl->stride = (width + 7) / 8;
+    init_masks(pl);
+}
+
+void pl_clear(playlist* pl)
+{
+    pl_stop(pl);
+    pl->nr = 0;
+}
+
+int pl_parse(const char* spec, pl_entry* e)
+{
+    static const char* names[] = { "Cut", "Wipe", "Dissolve", "Slide" };
+    char trans[16] = {0};
+    int sec = 0, ms = 0, n = 0, i;
+
+    memset(e, 0, sizeof(*e));
+    if (sscanf(spec, "%15s %d %n", e->name, &sec, &n) < 2 || sec <= 0
+        || !ep_find(e->name)) {
+        fprintf(stderr, "error: [PL] invalid entry %s\n", spec);
+        return -1;
+    }
+
+    spec += n;
+    // 转场名之外的 "<词> <数>" 是特效参数 (比如 image 的路径加帧率), 原样留给特效
+    i = 4;
+    if (sscanf(spec, "%15s %d %n", trans, &ms, &n) == 2) {
+        for (i = 0; i < 4; i++) {
+            if (strcmp(trans, names[i]) == 0)
+                break;
+        }
+    }
+    if (i < 4) {
+        if (ms < 0) {
+            fprintf(stderr, "error: [PL] invalid transition %s %d\n", trans, ms);
+            return -1;
+        }
+        e->transition = i;
+        e->transition_ms = MIN(ms, sec * 1000);
+        spec += n;
+    }
+    // 截断的参数到播放时才会出错, 这里就拒绝
+    if (strlen(spec) >= sizeof(e->args)) {
+        fprintf(stderr, "error: [PL] args too long %s\n", spec);
+        return -1;
+    }
+    strcpy(e->args, spec);
+    e->duration_ms = sec * 1000;
+
+    return 0;
+}
+
+int pl_add(playlist* pl, const char* spec)
+{
+    if (pl->nr >= PL_MAX) {
+        fprintf(stderr, "error: [PL] playlist full\n");
+        return -1;
+    }
+
+    if (pl_parse(spec, &pl->entries[pl->nr]))
+        return -1;
+
+    pl->nr++;
+    return 0;
+}
+
+static int start_entry(playlist* pl, effect_player* ep, int index)
+{
+    pl_entry* e = &pl->entries[index];
+
+    return ep_start(ep, e->name, pl->width, pl->height, e->args[0] ? e->args : NULL);
+}
+
+int pl_start(playlist* pl, int64_t now_ns)
+{
+    if (!pl->nr)
+        return -1;
+
+    pl_stop(pl);
+    pl->cur = 0;
+    if (start_entry(pl, &pl->cur_ep, 0))
+        return -1;
+
+    pl->running = true;
+    pl->start_ns = now_ns;
+    pl->trans_ns = 0;
+    pl->step = -1;
+    return 0;
+}
+
+void pl_stop(playlist* pl)
+{
+    ep_stop(&pl->cur_ep);
+    ep_stop(&pl->next_ep);
+    pl->running = false;
+}
+
+// 合成: out = (a & ~m) | (b & m)
+static void blend(uint32_t* out, const uint32_t* a, const uint32_t* b,
+                const uint32_t* m, int words)
+{
+    int i;
+
+    for (i = 0; i < words; i++)
+        out[i] = (a[i] & ~m[i]) | (b[i] & m[i]);
+}
+
+// 每行当一个字, 旧场景左移出去, 新场景从右边跟进, 宽度不超过 32
+static void slide(playlist* pl, const unsigned char* a, const unsigned char* b, int k)
+{
+    unsigned char* out = (unsigned char*)pl->out;
+    int shift = (k + 1) * pl->width / PL_STEPS;
+    uint32_t ra, rb, r, mask = pl->width == 32 ? ~0u : (1u << pl->width) - 1;
+    int x, y;
+
+    for (y = 0; y < pl->height; y++) {
+        ra = rb = 0;
+        for (x = 0; x < pl->stride; x++) {
+            ra |= (uint32_t)a[y * pl->stride + x] << (8 * x);
+            rb |= (uint32_t)b[y * pl->stride + x] << (8 * x);
+        }
+
+        // 位 0 在最左边
+        r = shift >= pl->width ? rb : ((ra >> shift) | (rb << (pl->width - shift))) & mask;
+        for (x = 0; x < pl->stride; x++)
+            out[y * pl->stride + x] = r >> (8 * x);
+    }
+}
+
+static void compose(playlist* pl, int k)
+{
+    const pl_entry* e = &pl->entries[(pl->cur + 1) % pl->nr];
+    uint32_t a[PL_WORDS], b[PL_WORDS];
+    int words = (pl->stride * pl->height + 3) / 4;
+
+    // 效果的帧是字节数组, 先拷成字再合成
+    memcpy(a, pl->cur_ep.bits, sizeof(a));
+    memcpy(b, pl->next_ep.bits, sizeof(b));
+
+    switch (e->transition) {
+    case PL_WIPE:
+        blend(pl->out, a, b, pl->wipe[k], words);
+        break;
+    case PL_DISSOLVE:
+        blend(pl->out, a, b, pl->dissolve[k], words);
+        break;
+    case PL_SLIDE:
+        if (pl->width <= 32) {
+            slide(pl, pl->cur_ep.bits, pl->next_ep.bits, k);
+            break;
+        }
+        blend(pl->out, a, b, pl->wipe[k], words);
+        break;
+    default:
+        memcpy(pl->out, b, words * 4);
+        break;
+    }
+}
+
+int pl_frame(playlist* pl, int64_t now_ns, const int* levels, int nr_levels)
+{
+    const pl_entry *e, *ne;
+    int changed = 0, k;
+
+    if (!pl->running)
+        return 0;
+
+    e = &pl->entries[pl->cur];
+    ne = &pl->entries[(pl->cur + 1) % pl->nr];
+
+    // 进入过渡: 提前启动下一项
+    if (!pl->trans_ns && pl->nr > 1
+        && now_ns >= pl->start_ns + (int64_t)(e->duration_ms - ne->transition_ms) * 1000000LL) {
+        if (start_entry(pl, &pl->next_ep, (pl->cur + 1) % pl->nr) == 0) {
+            pl->trans_ns = now_ns;
+            pl->step = -1;
+        }
+    }
+
+    changed |= ep_frame(&pl->cur_ep, now_ns, levels, nr_levels) > 0;
+    if (pl->trans_ns)
+        changed |= ep_frame(&pl->next_ep, now_ns, levels, nr_levels) > 0;
+
+    if (!pl->trans_ns) {
+        if (changed || pl->step < 0)
+            memcpy(pl->out, pl->cur_ep.bits, sizeof(pl->out));
+        changed |= pl->step < 0;
+        pl->step = 0;
+        return changed;
+    }
+
+    k = ne->transition_ms ?
+        (int)((now_ns - pl->trans_ns) * PL_STEPS / ((int64_t)ne->transition_ms * 1000000LL)) : PL_STEPS;
+    if (k >= PL_STEPS) {
+        // 过渡结束, 下一项成为当前项
+        ep_stop(&pl->cur_ep);
+        pl->cur_ep = pl->next_ep;
+        pl->cur_ep.fb.bits = pl->cur_ep.bits;
+        memset(&pl->next_ep, 0, sizeof(pl->next_ep));
+        pl->cur = (pl->cur + 1) % pl->nr;
+        pl->start_ns = pl->trans_ns;
+        pl->trans_ns = 0;
+        memcpy(pl->out, pl->cur_ep.bits, sizeof(pl->out));
+        pl->step = 0;
+        return 1;
+    }
+
+    if (changed || k != pl->step) {
+        compose(pl, k);
+        pl->step = k;
+        return 1;
+    }
+
+    return 0;
+}
+
+int64_t pl_next(const playlist* pl, int64_t now_ns, int64_t idle_ns)
+{
+    const pl_entry *e, *ne;
+    int64_t next;
+
+    if (!pl->running)
+        return now_ns + idle_ns;
+
+    next = ep_next(&pl->cur_ep, now_ns, idle_ns);
+    if (pl->trans_ns) {
+        next = MIN(next, ep_next(&pl->next_ep, now_ns, idle_ns));
+        next = MIN(next, now_ns + 1000000000LL / PL_FPS);
+    }
+    else if (pl->nr > 1) {
+        e = &pl->entries[pl->cur];
+        ne = &pl->entries[(pl->cur + 1) % pl->nr];
+        next = MIN(next, pl->start_ns
+                + (int64_t)(e->duration_ms - ne->transition_ms) * 1000000LL);
+    }
+
+    return MAX(next, now_ns);
+}
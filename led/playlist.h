@@ -0,0 +1,66 @@
+#ifndef _PLAYLIST_H_
+#define _PLAYLIST_H_
+
+#include "player.h"
+
+#define PL_MAX      8
+#define PL_STEPS    16
+// 过渡期间的合成帧率
+#define PL_FPS      30
+// 效果参数, 要放得下 'Effect image' 的路径 (IM_PATH_SIZE) 和选项
+#define PL_ARGS_SIZE 160
+
+typedef enum pl_transition {
+    PL_CUT,
+    PL_WIPE,        // 从左往右擦除
+    PL_DISSOLVE,    // 随机像素逐步替换
+    PL_SLIDE,       // 新场景从右边推进来
+} pl_transition_t;
+
+typedef struct pl_entry {
+    char name[16];
+    char args[PL_ARGS_SIZE];
+    int duration_ms;
+    pl_transition_t transition;     // 切到这一项时用的过渡
+    int transition_ms;
+} pl_entry;
+
+// 设备上的场景播放列表, 只由设备线程和持有设备锁的 session_exec 访问
+// 过渡时两个效果各自按帧率渲染, 按预先算好的掩码逐字合成
+typedef struct playlist {
+    pl_entry entries[PL_MAX];
+    int nr;
+    int cur;
+    bool running;
+
+    int width;
+    int height;
+    int stride;
+
+    effect_player cur_ep;
+    effect_player next_ep;
+    int64_t start_ns;       // 当前项开始时间
+    int64_t trans_ns;       // 过渡开始时间, 0 表示不在过渡中
+    int step;               // 已合成的过渡步, -1 表示还没画过
+
+    // 按 4 字节对齐, 合成按 32 位字做
+    uint32_t wipe[PL_STEPS][EFFECT_BITS / 4];
+    uint32_t dissolve[PL_STEPS][EFFECT_BITS / 4];
+    uint32_t out[EFFECT_BITS / 4];
+} playlist;
+
+void pl_init(playlist* pl, int width, int height);
+void pl_clear(playlist* pl);
+
+// "clock 30 Wipe 1000" -> 名字, 秒数, 过渡, 过渡毫秒, 其后为效果参数, 参数过长时失败
+int pl_parse(const char* spec, pl_entry* e);
+int pl_add(playlist* pl, const char* spec);
+
+int pl_start(playlist* pl, int64_t now_ns);
+void pl_stop(playlist* pl);
+
+// 返回 1 表示 out 有变化
+int pl_frame(playlist* pl, int64_t now_ns, const int* levels, int nr_levels);
+int64_t pl_next(const playlist* pl, int64_t now_ns, int64_t idle_ns);
+
+#endif
@@ -0,0 +1,269 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include "realtime.h"
+
+// mlock 不计次数, 同一页锁两次放开一次就没了; 按页记引用, 第一次锁时 mlock,
+// 最后一个放开时 munlock
+typedef struct rt_page {
+    uintptr_t addr;
+    int refs;               // 0 为空位
+} rt_page;
+
+static rt_page pages[RT_PAGES];
+static pthread_mutex_t pages_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int parse_cpus(const char* s, unsigned int* cpus)
+{
+    char* end;
+    long a, b;
+
+    *cpus = 0;
+    while (*s) {
+        a = strtol(s, &end, 10);
+        if (end == s)
+            return -1;
+        b = a;
+        if (*end == '-') {
+            s = end + 1;
+            b = strtol(s, &end, 10);
+            if (end == s)
+                return -1;
+        }
+        if (a < 0 || b < a || b >= 32)
+            return -1;
+        for (; a <= b; a++)
+            *cpus |= 1u << a;
+
+        s = end;
+        if (*s == ',')
+            s++;
+        else if (*s)
+            return -1;
+    }
+
+    return *cpus ? 0 : -1;
+}
+
+int rt_parse(const char* spec, rt_profile* p)
+{
+    char buf[RT_SPEC_SIZE], *tok, *save = NULL;
+    rt_profile r;
+
+    if (!spec || strlen(spec) >= sizeof(buf))
+        return -1;
+    strcpy(buf, spec);
+    memset(&r, 0, sizeof(r));
+    r.policy = SCHED_OTHER;
+
+    for (tok = strtok_r(buf, " ", &save); tok; tok = strtok_r(NULL, " ", &save)) {
+        if (strcmp(tok, "Other") == 0) {
+            r.policy = SCHED_OTHER;
+            r.priority = 0;
+        }
+        else if (strcmp(tok, "Fifo") == 0) {
+            r.policy = SCHED_FIFO;
+            r.priority = sched_get_priority_min(SCHED_FIFO);
+            // 优先级可以省略
+            if (save && *save >= '0' && *save <= '9') {
+                tok = strtok_r(NULL, " ", &save);
+                r.priority = atoi(tok);
+                if (r.priority < sched_get_priority_min(SCHED_FIFO)
+                    || r.priority > sched_get_priority_max(SCHED_FIFO))
+                    return -1;
+            }
+        }
+        else if (strcmp(tok, "Cpu") == 0) {
+            tok = strtok_r(NULL, " ", &save);
+            if (!tok || parse_cpus(tok, &r.cpus) < 0)
+                return -1;
+        }
+        else if (strcmp(tok, "Lock") == 0) {
+            r.lock = true;
+        }
+        else {
+            return -1;
+        }
+    }
+
+    *p = r;
+    return 0;
+}
+
+int rt_apply(pthread_t pid, const rt_profile* p)
+{
+    struct sched_param param;
+    cpu_set_t set;
+    long i, n;
+    int err, ret = 0;
+
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = p->priority;
+    err = pthread_setschedparam(pid, p->policy, &param);
+    if (err) {
+        fprintf(stderr, "error: [RT] policy %d priority %d: %s\n",
+                p->policy, p->priority, strerror(err));
+        ret = -1;
+    }
+
+    // 不绑时放开到所有 CPU, 撤销之前的绑定
+    CPU_ZERO(&set);
+    n = sysconf(_SC_NPROCESSORS_CONF);
+    for (i = 0; i < n && i < CPU_SETSIZE; i++) {
+        if (!p->cpus || (i < 32 && (p->cpus & (1u << i))))
+            CPU_SET(i, &set);
+    }
+    err = pthread_setaffinity_np(pid, sizeof(set), &set);
+    if (err) {
+        fprintf(stderr, "error: [RT] affinity %#x: %s\n", p->cpus, strerror(err));
+        ret = -2;
+    }
+
+    return ret;
+}
+
+static rt_page* find_page(uintptr_t addr)
+{
+    int i;
+
+    for (i = 0; i < RT_PAGES; i++) {
+        if (pages[i].refs && pages[i].addr == addr)
+            return &pages[i];
+    }
+
+    return NULL;
+}
+
+// 持 pages_lock 调用
+static void unref_pages(uintptr_t first, uintptr_t end, size_t size)
+{
+    rt_page* pg;
+
+    for (; first < end; first += size) {
+        pg = find_page(first);
+        if (pg && !--pg->refs)
+            munlock((void*)first, size);
+    }
+}
+
+int rt_lock(const void* addr, size_t len)
+{
+    size_t size = sysconf(_SC_PAGESIZE);
+    uintptr_t first = (uintptr_t)addr & ~(size - 1);
+    uintptr_t end = ((uintptr_t)addr + len + size - 1) & ~(size - 1);
+    uintptr_t a;
+    rt_page* pg;
+    int i;
+
+    pthread_mutex_lock(&pages_lock);
+    for (a = first; a < end; a += size) {
+        pg = find_page(a);
+        if (pg) {
+            pg->refs++;
+            continue;
+        }
+
+        for (i = 0; i < RT_PAGES && pages[i].refs; i++)
+            ;
+        if (i == RT_PAGES) {
+            fprintf(stderr, "error: [RT] too many locked pages\n");
+            goto fail;
+        }
+        if (mlock((void*)a, size) < 0) {
+            fprintf(stderr, "error: [RT] mlock %u bytes %d\n", (unsigned int)len, errno);
+            goto fail;
+        }
+        pages[i].addr = a;
+        pages[i].refs = 1;
+    }
+    pthread_mutex_unlock(&pages_lock);
+
+    return 0;
+
+fail:
+    unref_pages(first, a, size);
+    pthread_mutex_unlock(&pages_lock);
+    return -1;
+}
+
+void rt_unlock(const void* addr, size_t len)
+{
+    size_t size = sysconf(_SC_PAGESIZE);
+    uintptr_t first = (uintptr_t)addr & ~(size - 1);
+    uintptr_t end = ((uintptr_t)addr + len + size - 1) & ~(size - 1);
+
+    pthread_mutex_lock(&pages_lock);
+    unref_pages(first, end, size);
+    pthread_mutex_unlock(&pages_lock);
+}
+
+int rt_locked_pages(void)
+{
+    int i, n = 0;
+
+    pthread_mutex_lock(&pages_lock);
+    for (i = 0; i < RT_PAGES; i++)
+        n += pages[i].refs > 0;
+    pthread_mutex_unlock(&pages_lock);
+
+    return n;
+}
+
+void rt_record(rt_stats* st, int64_t late_ns)
+{
+    int64_t us;
+    int i;
+
+    if (late_ns < 0)
+        late_ns = 0;
+
+    st->count++;
+    st->sum_ns += late_ns;
+    if (late_ns > st->max_ns)
+        st->max_ns = late_ns;
+
+    us = late_ns / 1000;
+    for (i = 0; us && i < RT_BUCKETS - 1; i++)
+        us >>= 1;
+    st->buckets[i]++;
+}
+
+int64_t rt_percentile(const rt_stats* st, double q)
+{
+    uint64_t want, seen = 0;
+    int64_t bound;
+    int i;
+
+    if (!st->count)
+        return 0;
+
+    want = (uint64_t)(q * st->count + 0.5);
+    if (want < 1)
+        want = 1;
+    for (i = 0; i < RT_BUCKETS - 1; i++) {
+        seen += st->buckets[i];
+        if (seen >= want)
+            break;
+    }
+
+    bound = (1LL << i) * 1000;
+    return bound < st->max_ns ? bound : st->max_ns;
+}
+
+void rt_print(const char* name, const rt_stats* st)
+{
+    if (!st->count) {
+        printf("[RT] %s no wakeups\n", name);
+        return;
+    }
+
+    printf("[RT] %s %llu wakeups, late mean %lld us, p50 < %lld us, p99 < %lld us, max %lld us\n",
+            name, (unsigned long long)st->count, (long long)(st->sum_ns / st->count / 1000),
+            (long long)(rt_percentile(st, 0.5) / 1000), (long long)(rt_percentile(st, 0.99) / 1000),
+            (long long)(st->max_ns / 1000));
+}
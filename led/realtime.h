@@ -0,0 +1,49 @@
+#ifndef _REALTIME_H_
+#define _REALTIME_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+
+// 设备线程和外部帧接收线程的调度配置, 由 'Realtime ...' 命令给出,
+// 注册设备时先取环境变量 RT_ENV, 如 LED_RT="Fifo 50 Cpu 1 Lock"
+#define RT_ENV          "LED_RT"
+#define RT_SPEC_SIZE    64
+
+typedef struct rt_profile {
+    int policy;             // SCHED_OTHER / SCHED_FIFO
+    int priority;           // FIFO 时 1~99
+    unsigned int cpus;      // 绑定的 CPU 位图, 0 为不绑
+    bool lock;              // 设备用到的内存锁在物理内存里
+} rt_profile;
+
+// "Fifo [prio]" / "Other", "Cpu 1" / "Cpu 0-1" / "Cpu 0,2", "Lock", 顺序不限
+// 没给的项取默认: SCHED_OTHER, 不绑 CPU, 不锁内存
+int rt_parse(const char* spec, rt_profile* p);
+// 失败 (通常是没有 CAP_SYS_NICE) 返回负数, 已经生效的部分不回退
+int rt_apply(pthread_t pid, const rt_profile* p);
+// 锁住 [addr, addr + len) 所在的页, 按页计数, 锁几次就要放开几次
+#define RT_PAGES        64
+int rt_lock(const void* addr, size_t len);
+void rt_unlock(const void* addr, size_t len);
+// 当前锁着的页数
+int rt_locked_pages(void);
+
+// 唤醒延迟: 实际醒来的时刻减去要求的时刻
+// 桶 0 为 < 1us, 桶 i 为 [2^(i-1), 2^i) us, 最后一个桶收下所有更大的
+#define RT_BUCKETS      24
+
+typedef struct rt_stats {
+    uint64_t count;
+    int64_t sum_ns;
+    int64_t max_ns;
+    uint32_t buckets[RT_BUCKETS];
+} rt_stats;
+
+void rt_record(rt_stats* st, int64_t late_ns);
+// 第 q (0~1) 分位所在桶的上界, 不超过 max
+int64_t rt_percentile(const rt_stats* st, double q);
+void rt_print(const char* name, const rt_stats* st);
+
+#endif
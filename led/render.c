@@ -7,6 +7,7 @@
 #include <assert.h>
 #include <time.h>
 #include "render.h"
+#include "trace.h"
 
 // #define DEBUG
 // #define USE_SYSTEM
@@ -15,6 +16,8 @@
 
 #define ADDR_MAGIC   2
 
+static lr_sink_fn sink;
+
 static bool outside(led_render* lr, int x, int y)
 {
     return x < 0 || x >= lr->width || y < 0 || y >= lr->height;
@@ -25,6 +28,150 @@ static int get_index(led_render* lr, int x, int y)
     return (x + y * lr->width) / 8;
 }
 
+// 显存每字节高低半字节对调后, bit i 就是本字节第 i 个 led (x % 8 == i)
+// 下面的位矩阵运算都在这种 "低位在前" 的形式上做, 对调是自逆的
+static inline unsigned char swap_nibble(unsigned char b)
+{
+    return (b >> 4) | (b << 4);
+}
+
+static inline unsigned char reverse8(unsigned char b)
+{
+    b = (b >> 4) | (b << 4);
+    b = ((b >> 2) & 0x33) | ((b & 0x33) << 2);
+    return ((b >> 1) & 0x55) | ((b & 0x55) << 1);
+}
+
+static inline uint16_t reverse16(uint16_t w)
+{
+    w = (w >> 8) | (w << 8);
+    w = ((w >> 4) & 0x0f0f) | ((w & 0x0f0f) << 4);
+    w = ((w >> 2) & 0x3333) | ((w & 0x3333) << 2);
+    return ((w >> 1) & 0x5555) | ((w & 0x5555) << 1);
+}
+
+// 16x16 转置, a[y] 的 bit x 为 (x, y), 8/4/2/1 四轮分块交换
+static void transpose16(uint16_t a[16])
+{
+    uint16_t m = 0x00ff, t;
+    int j, k;
+
+    for (j = 8; j; j >>= 1, m ^= m << j) {
+        for (k = 0; k < 16; k = (k + j + 1) & ~j) {
+            t = ((a[k] >> j) ^ a[k + j]) & m;
+            a[k + j] ^= t;
+            a[k] ^= t << j;
+        }
+    }
+}
+
+// 8x8 转置, 第 r 字节的 bit c 为 (c, r)
+static uint64_t transpose8(uint64_t x)
+{
+    uint64_t t;
+
+    t = (x ^ (x >> 7)) & 0x00aa00aa00aa00aaULL;
+    x = x ^ t ^ (t << 7);
+    t = (x ^ (x >> 14)) & 0x0000cccc0000ccccULL;
+    x = x ^ t ^ (t << 14);
+    t = (x ^ (x >> 28)) & 0x00000000f0f0f0f0ULL;
+    x = x ^ t ^ (t << 28);
+
+    return x;
+}
+
+// 16x16 整屏放在 16 个字里做
+static void orient16(led_render* lr, unsigned char* out)
+{
+    uint16_t a[16], r[16];
+    int y;
+
+    for (y = 0; y < 16; y++)
+        a[y] = swap_nibble(lr->data[2 * y]) | (swap_nibble(lr->data[2 * y + 1]) << 8);
+
+    // 90 = 转置 + 水平翻转, 180 = 水平 + 垂直翻转, 270 = 转置 + 垂直翻转
+    if (lr->degree == 90 || lr->degree == 270)
+        transpose16(a);
+    for (y = 0; y < 16; y++) {
+        r[y] = a[lr->degree >= 180 ? 15 - y : y];
+        if ((lr->degree == 90 || lr->degree == 180) != lr->mirror)
+            r[y] = reverse16(r[y]);
+    }
+
+    for (y = 0; y < 16; y++) {
+        out[2 * y] = swap_nibble(r[y] & 0xff);
+        out[2 * y + 1] = swap_nibble(r[y] >> 8);
+    }
+}
+
+// 任意 8 的倍数: 按 8x8 块转置, 块 (i, j) 转置后放到 (j, i)
+static void orient_blocks(led_render* lr, unsigned char* out)
+{
+    int nb = lr->width / 8;
+    int h = lr->height;
+    bool turn = lr->degree == 90 || lr->degree == 270;
+    bool hflip = (lr->degree == 90 || lr->degree == 180) != lr->mirror;
+    bool vflip = lr->degree >= 180;
+    unsigned char* src = lr->data;
+    int x, y, i, j;
+
+    if (turn) {
+        for (i = 0; i < h / 8; i++) {
+            for (j = 0; j < nb; j++) {
+                uint64_t blk = 0;
+
+                for (y = 0; y < 8; y++)
+                    blk |= (uint64_t)swap_nibble(src[(i * 8 + y) * nb + j]) << (8 * y);
+                blk = transpose8(blk);
+                for (y = 0; y < 8; y++)
+                    out[(j * 8 + y) * nb + i] = swap_nibble(blk >> (8 * y));
+            }
+        }
+        src = out;
+    }
+
+    // 翻转原地做, 垂直翻转交换行, 水平翻转交换字节并反转位序
+    for (y = 0; y < (vflip ? h / 2 : h); y++) {
+        unsigned char* a = src + y * nb;
+        unsigned char* b = src + (vflip ? h - 1 - y : y) * nb;
+        unsigned char ra[DEFAULT_DATA_SIZE], rb[DEFAULT_DATA_SIZE];
+
+        for (x = 0; x < nb; x++) {
+            ra[x] = hflip ? swap_nibble(reverse8(swap_nibble(a[nb - 1 - x]))) : a[x];
+            rb[x] = hflip ? swap_nibble(reverse8(swap_nibble(b[nb - 1 - x]))) : b[x];
+        }
+        memcpy(out + (vflip ? h - 1 - y : y) * nb, ra, nb);
+        memcpy(out + y * nb, rb, nb);
+    }
+}
+
+const unsigned char* lr_output(led_render* lr)
+{
+    if (!lr->degree && !lr->mirror)
+        return lr->data;
+
+    if (lr->width == 16 && lr->height == 16)
+        orient16(lr, lr->out);
+    else
+        orient_blocks(lr, lr->out);
+
+    return lr->out;
+}
+
+int lr_orient(led_render* lr, int degree, bool mirror)
+{
+    if ((degree != 0 && degree != 90 && degree != 180 && degree != 270)
+        || (lr->width % 8) || (lr->height % 8)
+        || (degree % 180 && lr->width != lr->height)) {
+        fprintf(stderr, "error: [LR] orient %d unsupported\n", degree);
+        return -1;
+    }
+
+    lr->degree = degree;
+    lr->mirror = mirror;
+    return 0;
+}
+
 void lr_sram(led_render* lr, int x, int y, int color)
 {
     int index, bit, flip;
@@ -55,12 +202,68 @@ void lr_sram(led_render* lr, int x, int y, int color)
     //     printf("index=%d y=%02d %d %02X\n", index, y, color, lr->data[index]);
 }
 
+static void write_byte(led_render* lr, int index, unsigned char value)
+{
+#ifdef USE_SYSTEM
+    char data[DEFAULT_DATA_SIZE];
+
+    sprintf(data, "echo \"%02x%02x\" > /sys/class/leds/%s/device/led_pattern",
+                    index * ADDR_MAGIC, value, lr->node);
+    #ifdef DEBUG
+        printf("[LR] fill {%s}\n", data);
+    #endif
+    system(data);
+#else
+    fprintf(lr->f_pattern, "%02x%02x", index * ADDR_MAGIC, value);
+    fflush(lr->f_pattern);
+#endif
+}
+
+int lr_update(led_render* lr)
+{
+    const unsigned char* frame;
+    int i, n = 0;
+
+    TRACE_BEGIN("output");
+    frame = lr_output(lr);
+    TRACE_END("output");
+
+    for (i = 0; i < lr->sz_data; i++)
+        n += frame[i] != lr->sent[i];
+
+    // 每个字节单独一次写, 超过 1/4 帧就不如整帧划算
+    if (n > lr->sz_data / 4) {
+        lr_flush(lr);
+        return lr->sz_data;
+    }
+
+    TRACE_BEGIN("update");
+    for (i = 0; i < lr->sz_data && n; i++) {
+        if (frame[i] != lr->sent[i]) {
+            write_byte(lr, i, frame[i]);
+            lr->sent[i] = frame[i];
+        }
+    }
+    TRACE_END("update");
+
+    if (sink && n)
+        sink(lr, lr->sent, n);
+
+    return n;
+}
+
 void lr_flush(led_render* lr)
 {
     char data[DEFAULT_DATA_SIZE] = {0};
+    const unsigned char* frame;
     char* p = data;
     int i;
 
+    TRACE_BEGIN("output");
+    frame = lr_output(lr);
+    TRACE_END("output");
+    TRACE_BEGIN("flush");
+
 #ifdef USE_SYSTEM
     memcpy(p, "echo ", 5);
     p += 5;
@@ -70,7 +273,7 @@ void lr_flush(led_render* lr)
     p += 3;
 
     for (i = 0; i < lr->sz_data; i++) {
-        sprintf(p, "%02x ", lr->data[i]);
+        sprintf(p, "%02x ", frame[i]);
         p += 3;
     }
 #ifdef USE_SYSTEM
@@ -80,34 +283,27 @@ void lr_flush(led_render* lr)
     fwrite(data, p - data, 1, lr->f_pattern);
     fflush(lr->f_pattern);
 #endif
+    memcpy(lr->sent, frame, lr->sz_data);
+    TRACE_END("flush");
+
+    if (sink)
+        sink(lr, lr->sent, lr->sz_data);
 }
 
-void lr_fill(led_render* lr, int x, int y, int color)
+void lr_set_sink(lr_sink_fn fn)
 {
-    int index;
-#ifdef USE_SYSTEM
-    char data[DEFAULT_DATA_SIZE];
-#endif
+    sink = fn;
+}
 
+void lr_fill(led_render* lr, int x, int y, int color)
+{
     if (outside(lr, x, y)) {
         printf("error: [LR] fill (%d,%d) is outside\n", x, y);
         return;
     }
 
     lr_sram(lr, x, y, color);
-    index = get_index(lr, x, y);
-
-#ifdef USE_SYSTEM
-    sprintf(data, "echo \"%02x%02x\" > /sys/class/leds/%s/device/led_pattern",
-                    index * ADDR_MAGIC, lr->data[index], lr->node);
-    #ifdef DEBUG
-        printf("[LR] fill {%s}\n", data);
-    #endif
-    system(data);
-#else
-    fprintf(lr->f_pattern, "%02x%02x", index * ADDR_MAGIC, lr->data[index]);
-    fflush(lr->f_pattern);
-#endif
+    lr_update(lr);
 }
 
 void lr_invert(led_render* lr, bool invert)
@@ -141,6 +337,17 @@ void lr_invert(led_render* lr, bool invert)
 //     }
 // }
 
+void lr_load(led_render* lr, const unsigned char* bits, int stride)
+{
+    int nb = lr->width / 8;
+    int x, y;
+
+    for (y = 0; y < lr->height; y++) {
+        for (x = 0; x < nb; x++)
+            lr->data[y * nb + x] = swap_nibble(bits[y * stride + x]);
+    }
+}
+
 void lr_clear(led_render* lr)
 {
     memset(lr->data, 0, lr->sz_data);
@@ -209,10 +416,28 @@ void lr_brightness(led_render* lr, int brightness)
 #endif
 }
 
-led_render* lr_create(const char *node, int width, int height)
+#ifndef USE_SYSTEM
+// LR_NULL_NODE 的所有输出都写到 /dev/null, 主机上跑基准和测试用
+static FILE* open_sink(const char* node, const char* fmt)
 {
     char path[128];
+    FILE* f;
+
+    if (strcmp(node, LR_NULL_NODE) == 0)
+        snprintf(path, sizeof(path), "/dev/null");
+    else
+        snprintf(path, sizeof(path), fmt, node);
+
+    f = fopen(path, "wb");
+    if (!f)
+        fprintf(stderr, "error: [LR] open %s\n", path);
 
+    return f;
+}
+#endif
+
+led_render* lr_create(const char *node, int width, int height)
+{
     if (!node || width <= 0 || height <= 0) {
         fprintf(stderr, "error: [LR] init invalid param\n");
         return NULL;
@@ -226,44 +451,38 @@ led_render* lr_create(const char *node, int width, int height)
 
     lr->width = 16;
     lr->height = 16;
+    lr->degree = 0;
+    lr->mirror = false;
+    lr->invert = false;
     lr->sz_data = lr->width * lr->height / 8;
-    lr->data = malloc(lr->sz_data);
+    // 后面依次是旋转/镜像后的输出帧和已送出的帧
+    lr->data = malloc(lr->sz_data * 3);
     if (!lr->data) {
         fprintf(stderr, "error: [LR] init malloc 2\n");
         goto free_lr;
     }
-    memset(lr->data, 0, lr->sz_data);
+    memset(lr->data, 0, lr->sz_data * 3);
+    lr->out = lr->data + lr->sz_data;
+    lr->sent = lr->out + lr->sz_data;
 
 #ifdef USE_SYSTEM
     strncpy(lr->node, node, sizeof(lr->node)/sizeof(char));
 #else
-    snprintf(path, sizeof(path), "/sys/class/leds/%s/device/led_pattern", node);
-    lr->f_pattern = fopen(path, "wb");
-    if (!lr->f_pattern) {
-        fprintf(stderr, "error: [LR] open %s\n", path);
+    lr->f_pattern = open_sink(node, "/sys/class/leds/%s/device/led_pattern");
+    if (!lr->f_pattern)
         goto free_data;
-    }
 
-    snprintf(path, sizeof(path), "/sys/class/leds/%s/brightness", node);
-    lr->f_brightness = fopen(path, "wb");
-    if (!lr->f_brightness) {
-        fprintf(stderr, "error: [LR] open %s\n", path);
+    lr->f_brightness = open_sink(node, "/sys/class/leds/%s/brightness");
+    if (!lr->f_brightness)
         goto close_pattern;
-    }
 
-    snprintf(path, sizeof(path), "/sys/class/leds/%s/device/led_blink", node);
-    lr->f_blink = fopen(path, "wb");
-    if (!lr->f_blink) {
-        fprintf(stderr, "error: [LR] open %s\n", path);
+    lr->f_blink = open_sink(node, "/sys/class/leds/%s/device/led_blink");
+    if (!lr->f_blink)
         goto close_brightness;
-    }
 
-    snprintf(path, sizeof(path), "/sys/class/leds/%s/device/led_engine", node);
-    lr->f_engine = fopen(path, "wb");
-    if (!lr->f_engine) {
-        fprintf(stderr, "error: [LR] open %s\n", path);
+    lr->f_engine = open_sink(node, "/sys/class/leds/%s/device/led_engine");
+    if (!lr->f_engine)
         goto close_blink;
-    }
 #endif
 
     return lr;
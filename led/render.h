@@ -24,10 +24,25 @@ typedef struct led_render {
 	int width;
 	int height;
 
+	// 输出变换: 先顺时针旋转 degree, 再水平镜像, 只在 flush 时做
+	int degree;
+	bool mirror;
+
 	int sz_data;
 	unsigned char* data;
+	unsigned char* out;
+	// 最近一次送出去的帧, lr_update 只写和它不同的字节
+	unsigned char* sent;
 } led_render;
 
+// 输出钩子, 每次整帧或按地址写完后在调用者线程里回调, frame 为设备上的整帧
+// nr_bytes 为这次实际写出的字节数; 只给测量工具用, 全进程共用一个
+typedef void (*lr_sink_fn)(const led_render* lr, const unsigned char* frame, int nr_bytes);
+void lr_set_sink(lr_sink_fn fn);
+
+// 节点名为 LR_NULL_NODE 时不碰 sysfs, 输出全部丢弃
+#define LR_NULL_NODE "null"
+
 led_render* lr_create(const char *node, int width, int height);
 void lr_destroy(led_render* lr);
 
@@ -35,7 +50,16 @@ void lr_sram(led_render* lr, int x, int y, int color);
 void lr_invert(led_render* lr, bool invert);
 void lr_blank(led_render* lr, bool blank);
 void lr_flush(led_render* lr);
+// 只送出变化的字节 (按地址写), 变化太多时退回整帧, 返回写出的字节数
+int lr_update(led_render* lr);
+
+// 旋转 (0/90/180/270, 要求方屏) 和镜像, 宽高都要是 8 的倍数
+int lr_orient(led_render* lr, int degree, bool mirror);
+// 变换后要送出的帧, 没有变换时就是 data
+const unsigned char* lr_output(led_render* lr);
 void lr_clear(led_render* lr);
+// 整帧载入 1bpp 行优先, 每字节低位在左的缓冲 (struct led_frame 的格式), 不刷新
+void lr_load(led_render* lr, const unsigned char* bits, int stride);
 void lr_fill(led_render* lr, int x, int y, int color);
 
 void lr_blink(led_render* lr, const char* type);
@@ -4,11 +4,25 @@
 #include <string.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <errno.h>
+#include <time.h>
 #include <sys/time.h>
 #include <math.h>
 #include "utils.h"
 #include "render.h"
-#include "kiss_fft.h"
+#include "service.h"
+#include "spectrum.h"
+#include "tracker.h"
+#include "filterbank.h"
+#include "view.h"
+#include "player.h"
+#include "playlist.h"
+#include "trace.h"
+#include "clock.h"
+#include "daemon.h"
+#include "input.h"
+#include "realtime.h"
+#include "face.h"
 
 #define DEBUG
 
@@ -18,11 +32,12 @@
 #define FIXED_HEIGH 16
 
 #define DOT_BORDER   1
-#define DOT_WIDTH    6
-#define DOT_HEIGHT   5
 
 #define BRIGHTNESS_MAX 16
 
+// 没有定时任务时设备线程的轮询间隔
+#define IDLE_NS     500000000LL
+
 typedef struct led_device {
     char name[NAME_SIZE];
     led_render *render;
@@ -30,13 +45,21 @@ typedef struct led_device {
     int brightness;
 
     bool timing;
+    time_t tnow;
     struct tm now;
 
     bool waving;
-    int degree;
-    int wave[FIXED_WIDTH];
+    led_view view;
+    int64_t wave_ns;        // 'Wave Rate' 下一帧的时刻
+    effect_player effect;
+    playlist playlist;
+    frame_input input;      // 'Stream ...' 外部帧
+
+    rt_profile rt;          // 设备线程和接收线程的调度
+    bool locked;
+    rt_stats wakeups;       // 定时睡眠的唤醒延迟, 'Realtime Stats' 打印后清零
 
-    bool exit;
+    volatile bool exit;
     pthread_t pid;
     pthread_mutex_t lock;
 
@@ -56,6 +79,15 @@ typedef enum session_type {
     ACT_LED_DISPLAY_TIME = 0x20,
     ACT_LED_DISPLAY_WAVE = 0x40,
     ACT_LED_DISPLAY_LOVE = 0x80,
+    ACT_LED_SPECTRUM = 0x100,
+    ACT_LED_SPECTRUM_SIZE = 0x200,
+    ACT_LED_SPECTRUM_RATE = 0x400,
+    ACT_LED_WAVE_VIEW = 0x800,
+    ACT_LED_EFFECT = 0x1000,
+    ACT_LED_PLAYLIST = 0x2000,
+    ACT_LED_TRACE = 0x4000,
+    ACT_LED_STREAM = 0x8000,
+    ACT_LED_REALTIME = 0x10000,
 } session_t;
 
 typedef struct led_session {
@@ -64,13 +96,17 @@ typedef struct led_session {
     void* extra;
 } led_session;
 
-// 样本数量
+// 默认采样率, 'Spectrum Rate' 可改, 高于 48KHz 时自动抽取
+#define SAMPLE_RATE 44100
+// 默认 FFT 样本数, 'Spectrum Size' 可改, 帧移为一半
 #define SAMPLE_SZIE 512
-// 预分频
-#define PRESCALE    1
-#define FFT_SIZE    SAMPLE_SZIE / PRESCALE
-// 坐标显示个数
-#define AXIS_SIZE   16
+#define SAMPLE_MIN  64
+#define SAMPLE_MAX  8192
+// Goertzel 每块样本数
+#define TRACKER_BLOCK   256
+// 滤波器组发布间隔 (样本) 和包络衰减时间
+#define FILTER_BLOCK    64
+#define FILTER_RELEASE  60
 
 
 // #define WAVE_LENGTH 512
@@ -80,271 +116,195 @@ typedef struct led_session {
 // // 显示频率个数
 // #define AXIS_COUNT  16
 
-typedef struct wave_spectrum {
-    kiss_fft_cpx cin[FFT_SIZE];
-    kiss_fft_cpx cout[FFT_SIZE];
-    kiss_fft_cfg state;
-    int nfft;
-
-    float amps[FFT_SIZE];
-    float mags[FFT_SIZE];
-    int nr_axises;
-    int okey;
-} wave_spectrum_t;
+// 频段结果快照 (seqlock)
+// 写者: uni_hal_led_feed_buffer 所在的音频线程, 只能有一个, 从不阻塞
+// 读者: 各设备的 thread_fn, seq 为奇数或前后不一致时重读, 不会读到撕裂数据
+// 每块音频只分析一次, 设备再多也只是多几个读者
+// 有守护进程时快照放在共享区里, 写者是喂音频的客户端进程
+typedef struct band_snapshot {
+    volatile unsigned int seq;
+    ws_amp_t bands[SHARED_BANDS];
+
+    // 分析方式和参数, 'Spectrum ...' 只改这几个值, 音频线程发现和当前分析状态不符时重建
+    // 跟着快照放进共享区, 守护进程执行命令, 喂音频的客户端照着分析
+    volatile int analyser;
+    volatile int size;
+    volatile int rate;
+} band_snapshot_t;
+
+// 频段分析方式, 由 'Spectrum' 命令切换, 音频线程按需创建对应的状态
+typedef enum analyser_type {
+    ANALYSER_FFT,
+    ANALYSER_GOERTZEL,
+    ANALYSER_FILTER,
+} analyser_t;
+
+// 本进程在多进程方案里的角色, 第一次调用接口时确定
+typedef enum service_mode {
+    MODE_LOCAL,     // 自己持有设备, 默认
+    MODE_CLIENT,    // 设备在守护进程里, 命令写进共享环
+    MODE_DAEMON,
+} service_mode_t;
+
+// 写者在写快照中途退出时 seq 会一直是奇数, 读这么多次后就用读到的
+#define SNAPSHOT_RETRY  1000
 
 static led_service my_service, *service = &my_service;
-static wave_spectrum_t wave_spectrum = {
-    .nfft = FFT_SIZE,
-    .nr_axises = AXIS_SIZE,
-    .okey = 0,
+static int analysis_rate;
+static spectrum_ctx* spectrum;
+static band_tracker* tracker;
+static filter_bank* filters;
+static band_snapshot_t local_snapshot = {
+    .analyser = ANALYSER_FFT,
+    .size = SAMPLE_SZIE,
+    .rate = SAMPLE_RATE,
 };
+static band_snapshot_t* band_snapshot = &local_snapshot;
+static service_mode_t mode = MODE_LOCAL;
+static pthread_once_t mode_once = PTHREAD_ONCE_INIT;
+static ld_shared* shared;
+// 客户端里保护 shared 和 band_snapshot, 守护进程重启时换成新的共享区
+static pthread_mutex_t client_lock = PTHREAD_MUTEX_INITIALIZER;
+static volatile bool daemon_exit;
+static const band_layout shared_layout = { SHARED_BANDS, BAND_FMIN, BAND_FMAX };
 
 static led_session* session_create(const char *cmd, void* context);
 static void session_destroy(led_session* se);
 static void session_exec(led_session* se);
 static led_device* get_device(const char *name);
-static void show_time(led_render* render);
-static void show_random_wave(led_render* render);
-static void show_spectrum_wave(led_render* render);
-static void show_love(led_render* render);
-
-static void flush_hour(led_render* render, int hour);
-static void flush_min(led_render* render, int min);
-static void flush_sec(led_render* render, int sec);
-
-#if (DOT_WIDTH == 3)
-static int dot_maps[][DOT_HEIGHT][DOT_WIDTH] =
-{
-    {
-        { 1, 1, 1 },
-        { 1, 0, 1 },
-        { 1, 0, 1 },
-        { 1, 0, 1 },
-        { 1, 1, 1 }
-    },
-    {
-        { 0, 0, 1 },
-        { 0, 0, 1 },
-        { 0, 0, 1 },
-        { 0, 0, 1 },
-        { 0, 0, 1 }
-    },
-    {
-        { 1, 1, 1 },
-        { 0, 0, 1 },
-        { 1, 1, 1 },
-        { 1, 0, 0 },
-        { 1, 1, 1 }
-    },
-    {
-        { 1, 1, 1 },
-        { 0, 0, 1 },
-        { 1, 1, 1 },
-        { 0, 0, 1 },
-        { 1, 1, 1 }
-    },
-    {
-        { 1, 0, 1 },
-        { 1, 0, 1 },
-        { 1, 1, 1 },
-        { 0, 0, 1 },
-        { 0, 0, 1 }
-    },
-    {
-        { 1, 1, 1 },
-        { 1, 0, 0 },
-        { 1, 1, 1 },
-        { 0, 0, 1 },
-        { 1, 1, 1 }
-    },
-    {
-        { 1, 1, 1 },
-        { 1, 0, 0 },
-        { 1, 1, 1 },
-        { 1, 0, 1 },
-        { 1, 1, 1 }
-    },
-    {
-        { 1, 1, 1 },
-        { 0, 0, 1 },
-        { 0, 0, 1 },
-        { 0, 0, 1 },
-        { 0, 0, 1 }
-    },
-    {
-        { 1, 1, 1 },
-        { 1, 0, 1 },
-        { 1, 1, 1 },
-        { 1, 0, 1 },
-        { 1, 1, 1 }
-    },
-    {
-        { 1, 1, 1 },
-        { 1, 0, 1 },
-        { 1, 1, 1 },
-        { 0, 0, 1 },
-        { 1, 1, 1 }
-    }
-};
-#else
-static int dot_maps[][DOT_HEIGHT][DOT_WIDTH] =
-{
-    {
-        { 1, 1, 1, 1, 1, 1 },
-        { 1, 0, 0, 0, 0, 1 },
-        { 1, 0, 0, 0, 0, 1 },
-        { 1, 0, 0, 0, 0, 1 },
-        { 1, 1, 1, 1, 1, 1 },
-    },
-    {
-        { 0, 0, 0, 0, 0, 1 },
-        { 0, 0, 0, 0, 0, 1 },
-        { 0, 0, 0, 0, 0, 1 },
-        { 0, 0, 0, 0, 0, 1 },
-        { 0, 0, 0, 0, 0, 1 }
-    },
-    {
-        { 1, 1, 1, 1, 1, 1 },
-        { 0, 0, 0, 0, 0, 1 },
-        { 1, 1, 1, 1, 1, 1 },
-        { 1, 0, 0, 0, 0, 0 },
-        { 1, 1, 1, 1, 1, 1 },
-    },
-    {
-        { 1, 1, 1, 1, 1, 1 },
-        { 0, 0, 0, 0, 0, 1 },
-        { 1, 1, 1, 1, 1, 1 },
-        { 0, 0, 0, 0, 0, 1 },
-        { 1, 1, 1, 1, 1, 1 },
-    },
-    {
-        { 1, 0, 0, 0, 0, 1 },
-        { 1, 0, 0, 0, 0, 1 },
-        { 1, 1, 1, 1, 1, 1 },
-        { 0, 0, 0, 0, 0, 1 },
-        { 0, 0, 0, 0, 0, 1 }
-    },
-    {
-        { 1, 1, 1, 1, 1, 1 },
-        { 1, 0, 0, 0, 0, 0 },
-        { 1, 1, 1, 1, 1, 1 },
-        { 0, 0, 0, 0, 0, 1 },
-        { 1, 1, 1, 1, 1, 1 },
-    },
-    {
-        { 1, 1, 1, 1, 1, 1 },
-        { 1, 0, 0, 0, 0, 0 },
-        { 1, 1, 1, 1, 1, 1 },
-        { 1, 0, 0, 0, 0, 1 },
-        { 1, 1, 1, 1, 1, 1 },
-    },
-    {
-        { 1, 1, 1, 1, 1, 1 },
-        { 0, 0, 0, 0, 0, 1 },
-        { 0, 0, 0, 0, 0, 1 },
-        { 0, 0, 0, 0, 0, 1 },
-        { 0, 0, 0, 0, 0, 1 }
-    },
-    {
-        { 1, 1, 1, 1, 1, 1 },
-        { 1, 0, 0, 0, 0, 1 },
-        { 1, 1, 1, 1, 1, 1 },
-        { 1, 0, 0, 0, 0, 1 },
-        { 1, 1, 1, 1, 1, 1 },
-    },
-    {
-        { 1, 1, 1, 1, 1, 1 },
-        { 1, 0, 0, 0, 0, 1 },
-        { 1, 1, 1, 1, 1, 1 },
-        { 0, 0, 0, 0, 0, 1 },
-        { 1, 1, 1, 1, 1, 1 },
-    }
-};
-#endif
+static void show_time(led_device* dev);
+static void tick_time(led_device* dev);
+static void show_random_wave(led_device* dev);
+static int64_t show_spectrum_wave(led_device* dev);
+static int64_t show_effect(led_device* dev);
+static int64_t show_playlist(led_device* dev);
+static void show_stream(led_device* dev);
+static void stop_scene(led_device* dev);
+static void apply_realtime(led_device* dev);
+static void lock_memory(led_device* dev, bool lock);
+
+static void flush_clock(led_render* render, const struct tm* old, const struct tm* tm);
 
 static void* thread_fn(void *arg)
 {
     led_device *dev = (led_device*)arg;
-    struct timeval tv_last, tv_now;
-    int usec;
-    int tick = 0;
+    int64_t wake, deadline, late = -1;
+    clockid_t clock;
 
     while (!dev->exit) {
-        gettimeofday(&tv_last,NULL);
-#ifdef DEBUG
-        // printf("last: %ld\n", tv_last.tv_sec*1000 + tv_last.tv_usec/1000);
-#endif
+        wake = 0;
+        TRACE_BEGIN("lock");
         pthread_mutex_lock(&dev->lock);
+        TRACE_END("lock");
+        if (late >= 0)
+            rt_record(&dev->wakeups, late);
+
+        TRACE_BEGIN("frame");
+        if (dev->playlist.running)
+            wake = show_playlist(dev);
+        else if (dev->effect.ops)
+            wake = show_effect(dev);
+        else if (dev->input.running)
+            show_stream(dev);
+        else if (dev->timing)
+            tick_time(dev);
+        else
+            wake = show_spectrum_wave(dev);
+        // show_random_wave(dev);
+        TRACE_END("frame");
 
-        if (0 && dev->timing && (tick % 2) == 0) {
-            time_t new;
-            struct tm* tm_new;
-            struct tm* tm_now;
-            int sync = 0;
+        pthread_mutex_unlock(&dev->lock);
 
-            time(&new);
-            tm_new = localtime(&new);
+        if (!wake && dev->input.running) {
+            // 外部帧不按时钟走, 不算在虚拟时钟的运行线程里, 有帧就醒, 也不计唤醒延迟
+            lc_exit();
+            fi_wait(&dev->input, IDLE_NS);
+            late = -1;
+            continue;
+        }
 
-            tm_now = &dev->now;
+        clock = CLOCK_MONOTONIC;
+        if (wake) {
+            // 按效果或 Wave Rate 的帧周期睡到下一帧
+            deadline = wake;
+        }
+        else if (dev->timing) {
+            // 按绝对时间睡到下一个整秒, 处理耗时和唤醒延迟不会累积
+            clock = CLOCK_REALTIME;
+            deadline = (lc_now(CLOCK_REALTIME) / 1000000000LL + 1) * 1000000000LL;
+        }
+        else {
+            deadline = lc_now(CLOCK_MONOTONIC) + IDLE_NS;
+        }
+        lc_sleep_until_stop(clock, deadline, &dev->exit);
+        late = lc_now(clock) - deadline;
+    }
 
-            if (tm_new->tm_sec != tm_now->tm_sec){
-                flush_sec(dev->render, tm_new->tm_sec);
-                sync++;
-            }
+    pthread_mutex_lock(&dev->lock);
+    stop_scene(dev);
+    pthread_mutex_unlock(&dev->lock);
+    lc_exit();
 
-            if (tm_new->tm_min != tm_now->tm_min) {
-                flush_min(dev->render, tm_new->tm_min);
-                sync++;
-            }
+    printf("[LS] %d exit\n", (int)pthread_self());
+    pthread_exit(NULL);
 
-            if (tm_new->tm_hour != tm_now->tm_hour) {
-                flush_hour(dev->render, tm_new->tm_hour);
-                sync++;
-            }
+    return NULL;
+}
 
-#ifdef DEBUG
-            // printf("[LS] now timing: %d-%d-%d %d:%d:%d\n",
-            //     tm_now->tm_year+1900, tm_now->tm_mon+1, tm_now->tm_mday,
-            //     tm_now->tm_hour, tm_now->tm_min, tm_now->tm_sec);
-            // printf("[LS] new timing: %d-%d-%d %d:%d:%d\n",
-            //     tm_new->tm_year+1900, tm_new->tm_mon+1, tm_new->tm_mday,
-            //     tm_new->tm_hour, tm_new->tm_min, tm_new->tm_sec);
-#endif
+// 有活着的守护进程就当客户端, 快照也改用共享区里的
+static void mode_init(void)
+{
+    if (mode != MODE_LOCAL)
+        return;
 
-            if (sync)
-                memcpy(&dev->now, tm_new, sizeof(struct tm));
-        }
+    shared = ld_attach(sizeof(band_snapshot_t));
+    if (shared) {
+        band_snapshot = (band_snapshot_t*)ld_extra(shared);
+        mode = MODE_CLIENT;
+        printf("[LS] attached to daemon\n");
+    }
+}
 
-        show_spectrum_wave(dev->render);
-        // show_random_wave(dev->render);
+// 持 client_lock 调用. 守护进程退出或重启后旧的共享区没人读了, 换到新的上;
+// 还没有新的守护进程时返回 false, 下次调用再试
+static bool client_attach(void)
+{
+    ld_shared* ld;
 
-        pthread_mutex_unlock(&dev->lock);
+    if (ld_alive(shared))
+        return true;
 
-        gettimeofday(&tv_now,NULL);
-#ifdef DEBUG
-        // printf("now: %ld\n", tv_now.tv_sec*1000 + tv_now.tv_usec/1000);
-#endif
-        usec = MAX(50000, 250000 - tv_now.tv_usec);
-        usleep(500000);
-        tick++;
-    }
+    ld = ld_attach(sizeof(band_snapshot_t));
+    if (!ld)
+        return false;
 
-    printf("[LS] %d exit\n", (int)pthread_self());
-    pthread_exit(NULL);
+    ld_detach(shared);
+    shared = ld;
+    band_snapshot = (band_snapshot_t*)ld_extra(shared);
+    printf("[LS] attached to restarted daemon\n");
 
-    return NULL;
+    return true;
 }
 
 int uni_hal_led_register(const char *name)
 {
     int i;
     led_device *dev;
+    const char* env;
 
     if (!name) {
         fprintf(stderr, "error: %d invalid name\n", __LINE__);
         return -1;
     }
 
+    pthread_once(&mode_once, mode_init);
+    if (mode == MODE_CLIENT) {
+        pthread_mutex_lock(&client_lock);
+        i = client_attach() && ld_has_device(shared, name) ? 0 : -2;
+        pthread_mutex_unlock(&client_lock);
+        return i;
+    }
+
     for (i = 0; i < MAX_DEVNO; i++) {
         dev = &service->dev_list[i];
         if (dev->name[0] && strcmp(name, dev->name) == 0) {
@@ -363,31 +323,56 @@ int uni_hal_led_register(const char *name)
                 return -2;
             }
 
-            dev->exit = false;
-            if (pthread_create(&dev->pid, NULL, thread_fn, (void *)dev)) {
-                fprintf(stderr, "error: create pthread\n");
-                dev->exit = true;
+            lv_init(&dev->view, &shared_layout, FIXED_WIDTH);
+            pl_init(&dev->playlist, FIXED_WIDTH, FIXED_HEIGH);
+            if (fi_init(&dev->input)) {
+                fprintf(stderr, "error: init input\n");
                 lr_destroy(dev->render);
                 dev->render = NULL;
                 dev->name[0] = 0;
-                return -3;
+                return -2;
             }
-
+            // 线程一起来就会用锁和统计, 都在创建线程之前准备好
             if (pthread_mutex_init(&dev->lock, NULL)) {
                 fprintf(stderr, "error: init mutex\n");
-                dev->exit = true;
                 lr_destroy(dev->render);
                 dev->render = NULL;
                 dev->name[0] = 0;
+                return -3;
             }
 
-            {
-                time_t now;
+            // 环境变量给的调度配置, 之后可以用 'Realtime ...' 改
+            env = getenv(RT_ENV);
+            dev->locked = false;
+            memset(&dev->wakeups, 0, sizeof(dev->wakeups));
+            rt_parse("", &dev->rt);
+            if (env && rt_parse(env, &dev->rt) < 0) {
+                fprintf(stderr, "error: invalid %s=%s\n", RT_ENV, env);
+                env = NULL;
+            }
 
-                time(&now);
-                memcpy(&dev->now, localtime(&now), sizeof(struct tm));
+            dev->exit = false;
+            lc_attach();
+            if (pthread_create(&dev->pid, NULL, thread_fn, (void *)dev)) {
+                fprintf(stderr, "error: create pthread\n");
+                lc_detach();
+                dev->exit = true;
+                pthread_mutex_destroy(&dev->lock);
+                lr_destroy(dev->render);
+                dev->render = NULL;
+                dev->name[0] = 0;
+                return -3;
+            }
+
+            if (env) {
+                pthread_mutex_lock(&dev->lock);
+                apply_realtime(dev);
+                pthread_mutex_unlock(&dev->lock);
             }
-            srand(time(NULL));
+
+            dev->tnow = lc_time();
+            localtime_r(&dev->tnow, &dev->now);
+            srand(lc_time());
 
             printf("[LS] register %s handle=(%d,%x)\n",
                     name, (int)dev->pid, (unsigned int)dev->render);
@@ -403,7 +388,8 @@ void uni_hal_led_unregister(const char *name)
     int i;
     led_device* dev;
 
-    if (!name)
+    // 客户端不持有设备
+    if (!name || mode == MODE_CLIENT)
         return;
 
     for (i = 0; i < MAX_DEVNO; i++) {
@@ -411,9 +397,13 @@ void uni_hal_led_unregister(const char *name)
         if (strcmp(dev->name, name) == 0) {
             printf("[LS] unregister %s handle=(%d,%x)\n",
                     name, (int)dev->pid, (unsigned int)dev->render);
+            // 等设备线程收尾退出后再拆锁和显存, 它睡着的话叫醒
             dev->exit = true;
-            // sleep(2);
+            lc_kick();
+            fi_wake(&dev->input);
+            pthread_join(dev->pid, NULL);
             pthread_mutex_destroy(&dev->lock);
+            lock_memory(dev, false);
             lr_destroy(dev->render);
             dev->render = NULL;
             dev->name[0] = 0;
@@ -432,15 +422,33 @@ int uni_hal_led_ctrl(const char *name, const char *cmd)
         return -1;
     }
 
+    // 写进共享环就返回, 命令的错误只在守护进程里打印
+    pthread_once(&mode_once, mode_init);
+    if (mode == MODE_CLIENT) {
+        int ret = 0;
+
+        pthread_mutex_lock(&client_lock);
+        if (!client_attach()) {
+            fprintf(stderr, "[LS ctrl] daemon gone\n");
+            ret = -2;
+        }
+        else if (!name || !ld_has_device(shared, name)) {
+            fprintf(stderr, "[LS ctrl] %s\n", name ? name : "???");
+            ret = -2;
+        }
+        else if (ld_push(shared, name, cmd) < 0) {
+            ret = -4;
+        }
+        pthread_mutex_unlock(&client_lock);
+        return ret;
+    }
+
     dev = get_device(name);
     if (!dev) {
         fprintf(stderr, "[LS ctrl] %s\n", name ? name : "???");
         return -2;
     }
 
-    if (strcmp(name, "hbs1632.2"))
-        return 0;
-
 #ifdef DEBUG
     printf("[LS ctrl] %s %s\n", name, cmd);
 #endif
@@ -456,113 +464,247 @@ int uni_hal_led_ctrl(const char *name, const char *cmd)
     return 0;
 }
 
-float hypot_fabs(kiss_fft_cpx *y)
+// 环里的命令可能来自任何接入的进程, 加载代码和写文件的只在守护进程自己调用时执行
+static bool ring_allowed(const char* cmd)
 {
-    return hypot((float)abs(y->r), (float)abs(y->i));
+    char verb[NAME_SIZE] = {0};
+
+    if (strncmp(cmd, "Trace Dump", 10) == 0)
+        return false;
+    if (strncmp(cmd, "Effect ", 7) == 0 && sscanf(cmd + 7, "%15s", verb) == 1
+        && strcmp(verb, "Load") == 0)
+        return false;
+
+    return true;
 }
 
-float np_clip(float x, float min, float max)
+int uni_hal_led_daemon(const char *names[], int nr)
 {
-    if (x < min)
-        return min;
-    else if (x > max)
-        return max;
-    else
-        return x;
+    char name[LD_NAME_SIZE], cmd[LD_CMD_SIZE];
+    int i, ret = 0;
+
+    mode = MODE_DAEMON;
+    pthread_once(&mode_once, mode_init);
+
+    shared = ld_create(sizeof(band_snapshot_t));
+    if (!shared)
+        return -1;
+    band_snapshot = (band_snapshot_t*)ld_extra(shared);
+    band_snapshot->analyser = local_snapshot.analyser;
+    band_snapshot->size = local_snapshot.size;
+    band_snapshot->rate = local_snapshot.rate;
+
+    for (i = 0; i < nr; i++) {
+        if (uni_hal_led_register(names[i]) < 0 || ld_add_device(shared, names[i]) < 0) {
+            fprintf(stderr, "error: [LS] daemon register %s\n", names[i]);
+            ret = -2;
+            goto out;
+        }
+    }
+
+    printf("[LS] daemon %d serving %d devices\n", (int)getpid(), nr);
+    while (!daemon_exit) {
+        ld_wait(shared);
+        while (ld_pop(shared, name, cmd)) {
+            if (!ring_allowed(cmd)) {
+                fprintf(stderr, "error: [LS] %s is local only\n", cmd);
+                continue;
+            }
+            uni_hal_led_ctrl(name, cmd);
+        }
+    }
+
+out:
+    while (i-- > 0)
+        uni_hal_led_unregister(names[i]);
+    band_snapshot = &local_snapshot;
+    ld_destroy(shared);
+    shared = NULL;
+    daemon_exit = false;
+
+    return ret;
 }
 
-void spectrum(char *buf, int len)
+void uni_hal_led_daemon_stop(void)
 {
-    wave_spectrum_t *ws = &wave_spectrum;
-    float factor;
-    int i;
-    // static int dump = 0;
+    daemon_exit = true;
+    if (shared)
+        ld_wake(shared);
+}
+
+static void snapshot_publish(band_snapshot_t *bs, const ws_amp_t *bands)
+{
+    // gcc 4.6 工具链没有 __atomic, 用 __sync 全屏障
+    bs->seq++;
+    __sync_synchronize();
+    memcpy(bs->bands, bands, sizeof(bs->bands));
+    __sync_synchronize();
+    bs->seq++;
+}
 
-    // if (dump == 10) {
-    //     printf("=== buf\n");
-    //     for (i = 0; i < len; i++) {
-    //         printf("%d, ", buf[i]);
-    //     }
-    //     printf("===\n");
-    // }
-    // dump++;
+static unsigned int snapshot_read(band_snapshot_t *bs, ws_amp_t *bands)
+{
+    unsigned int seq;
+    int retry = 0;
 
-    if (!ws->okey) {
-        ws->state = kiss_fft_alloc(ws->nfft, 0, NULL, NULL);
-        if (ws->state) {
-            kiss_fft_scalar zero;
+    do {
+        seq = bs->seq;
+        __sync_synchronize();
+        memcpy(bands, bs->bands, sizeof(bs->bands));
+        __sync_synchronize();
+    } while (((seq & 1) || seq != bs->seq) && ++retry < SNAPSHOT_RETRY);
 
-            // ugly way of setting short,int,float,double, or __m128 to zero
-            memset(&zero,0,sizeof(zero));
-            for (i = 0; i < ws->nfft; i++)
-                ws->cin[i].i = zero;
+    return seq;
+}
 
-            ws->okey = 1;
-        }
+static void analysis_reconfigure(void)
+{
+    int rate = band_snapshot->rate;
+    int size = band_snapshot->size;
+
+    if (rate != analysis_rate) {
+        sc_destroy(spectrum);
+        bt_destroy(tracker);
+        fb_destroy(filters);
+        spectrum = NULL;
+        tracker = NULL;
+        filters = NULL;
+        analysis_rate = rate;
     }
 
-    if (ws->okey) {
-        if (PRESCALE > 1) {
-            for (i = 0; i < ws->nfft; i++) {
-                ws->cin[i].r = (buf[i * 8] + buf[i * 8 + 1] + buf[i * 8 + 2]
-                                + buf[i * 8 + 3] + buf[i * 8 + 4] + buf[i * 8 + 5]
-                                + buf[i * 8 + 6] + buf[i * 8 + 7]) / 8.0;
-            }
-        }
-        else {
-            for (i = 0; i < ws->nfft; i++) {
-                ws->cin[i].r = buf[i];
-            }
-        }
+    // FFT 配置有缓存, 来回切换大小不会重算旋转因子
+    if (spectrum && spectrum->conf.nfft != size) {
+        sc_destroy(spectrum);
+        spectrum = NULL;
+    }
+}
 
-        kiss_fft(ws->state, ws->cin, ws->cout);
+static int analyse_fft(const void *buf, int frames, int format, int channels,
+                    ws_amp_t *bands)
+{
+    if (!spectrum) {
+        spectrum_config conf = {
+            .rate = analysis_rate,
+            .nfft = band_snapshot->size,
+            .nr_bands = SHARED_BANDS,
+            .fmin = BAND_FMIN,
+            .fmax = BAND_FMAX,
+            .window = WS_WINDOW_HANN,
+        };
+
+        spectrum = sc_create(&conf);
+        if (!spectrum)
+            return -1;
+    }
 
-        // amp[0] = np.abs(mag[0])/fftSize
-        // amp[endIndex] = np.abs(mag[endIndex])/fftSize
-        // amp[1:endIndex] = np.abs(mag[1:endIndex])*temp
-        // amp = 20*np.log10(np.clip(np.abs(amp), 1e-20, 1e100))
+    if (!sc_feed(spectrum, buf, frames, format, channels))
+        return 0;
 
-        ws->amps[0] = hypot_fabs(&ws->cout[0]) / ws->nfft;
-        ws->amps[ws->nfft - 1] = hypot_fabs(&ws->cout[ws->nfft - 1]) / ws->nfft;
-        factor = 2.0 / ws->nfft;
-        for (i = 1; i < ws->nfft - 1; i++) {
-            ws->amps[i] = hypot_fabs(&ws->cout[i]) * factor;
-            // ws->mags[i] = 20*log10(np_clip(fabs(ws->amps[i]), 1e-20, 1e100));
-        }
+    memcpy(bands, spectrum->bands, SHARED_BANDS * sizeof(ws_amp_t));
+    return 1;
+}
 
+static int analyse_goertzel(const void *buf, int frames, int format, int channels,
+                    ws_amp_t *bands)
+{
+    if (!tracker) {
+        tracker = bt_create(analysis_rate, TRACKER_BLOCK,
+                        SHARED_BANDS, BAND_FMIN, BAND_FMAX);
+        if (!tracker)
+            return -1;
+    }
 
-        // 计算得到幅度基数
-        // 如果要分16份，就基数amps[i] * 16
-        factor = (float)ws->nr_axises * PRESCALE * 2 / len;
-        for (i = 0; i < ws->nfft; i++) {
-            ws->amps[i] *= factor;
-        }
+    if (!bt_feed(tracker, buf, frames, format, channels))
+        return 0;
 
-        //20000表示的最大频点20KHZ,这里的20-20K之间坐标的数据成对数关系,这是音频标准
-        //方法中20为低频起点20HZ，16为段数
-        // printf("freqs: ");
-        // factor = pow(20000 / 20, 1.0 / ws->nfft);
-        for (i = 0; i < ws->nfft; i++) {
-            //乘方，30为低频起点，sampleratePoint数组中存的就是坐标值
-            // ws->freqs[i] = 20 * pow(factor, i);
-            // printf("(%f mV, %f dB)\n", ws->amps[i], ws->mags[i]);
-        }
-        // printf("\n");
+    memcpy(bands, tracker->bands, SHARED_BANDS * sizeof(ws_amp_t));
+    return 1;
+}
+
+static int analyse_filter(const void *buf, int frames, int format, int channels,
+                    ws_amp_t *bands)
+{
+    if (!filters) {
+        filters = fb_create(analysis_rate, FILTER_BLOCK, SHARED_BANDS,
+                        BAND_FMIN, BAND_FMAX, FILTER_RELEASE);
+        if (!filters)
+            return -1;
     }
+
+    if (!fb_feed(filters, buf, frames, format, channels))
+        return 0;
+
+    memcpy(bands, filters->bands, SHARED_BANDS * sizeof(ws_amp_t));
+    return 1;
 }
 
-int uni_hal_led_feed_buffer(char *buf, int len)
+static int feed_pcm(const void *buf, int frames, int format, int channels)
 {
-    spectrum(buf, len);
+    ws_amp_t bands[SHARED_BANDS];
+    int ret;
+
+    // 只在音频线程里创建和使用
+    analysis_reconfigure();
+    TRACE_BEGIN("analyse");
+    switch (band_snapshot->analyser) {
+    case ANALYSER_GOERTZEL:
+        ret = analyse_goertzel(buf, frames, format, channels, bands);
+        break;
+    case ANALYSER_FILTER:
+        ret = analyse_filter(buf, frames, format, channels, bands);
+        break;
+    default:
+        ret = analyse_fft(buf, frames, format, channels, bands);
+        break;
+    }
+    TRACE_END("analyse");
+
+    if (ret <= 0)
+        return ret;
+
+    snapshot_publish(band_snapshot, bands);
+    TRACE_MARK("publish");
 
     return 0;
 }
 
+int uni_hal_led_feed_pcm(const void *buf, int frames, int format, int channels)
+{
+    int ret;
+
+    pthread_once(&mode_once, mode_init);
+    if (mode != MODE_CLIENT)
+        return feed_pcm(buf, frames, format, channels);
+
+    // 守护进程不在时照常分析, 结果没人读; 它回来后发布到新的共享区
+    pthread_mutex_lock(&client_lock);
+    client_attach();
+    ret = feed_pcm(buf, frames, format, channels);
+    pthread_mutex_unlock(&client_lock);
+
+    return ret;
+}
+
+int uni_hal_led_feed_buffer(const char *buf, int len)
+{
+    return uni_hal_led_feed_pcm(buf, len, UNI_HAL_LED_S8, 1);
+}
+
 static bool isbrightness(int brig)
 {
     return (brig >= 0) && (brig < BRIGHTNESS_MAX);
 }
 
+static bool isfftsize(int size)
+{
+    return (size >= SAMPLE_MIN) && (size <= SAMPLE_MAX) && !(size & (size - 1));
+}
+
+static bool israte(int rate)
+{
+    return (rate >= 8000) && (rate <= 192000);
+}
+
 static bool isdegree(int deg)
 {
     return (deg == 0) || (deg == 90) || (deg == 180) || (deg == 270);
@@ -594,19 +736,91 @@ static led_session* session_create(const char *cmd, void* context)
         int* p = (int*)&se->extra;
         led_device* dev = (led_device*)context;
 
+        *p = dev->render->degree;
         if (strlen(cmd) == 9) {
-            dev->degree = 0;
+            *p = 0;
         } else if (strlen(cmd) > 10) {
             sscanf(cmd+10, "%d", &deg);
-            dev->degree = isdegree(deg) ? deg : dev->degree;
+            *p = isdegree(deg) ? deg : *p;
         }
 
-        *p = dev->degree;
         se->type = ACT_LED_DISPLAY_WAVE;
     }
+    else if (strncmp(cmd, "Wave ", 5) == 0) {
+        led_device* dev = (led_device*)context;
+        led_view view = dev->view;
+
+        // 先在副本上试一次, 真正修改放到 session_exec 里持锁做
+        if (lv_ctrl(&view, cmd+5) < 0) {
+            free(se);
+            fprintf(stderr, "[LS] invalid %s\n", cmd);
+            return NULL;
+        }
+
+        se->extra = strdup(cmd+5);
+        se->type = ACT_LED_WAVE_VIEW;
+    }
     else if (strncmp(cmd, "Show Love", 9) == 0) {
         se->type = ACT_LED_DISPLAY_LOVE;
     }
+    else if (strncmp(cmd, "Playlist ", 9) == 0) {
+        const char* arg = cmd + 9;
+        pl_entry entry;
+
+        if (strncmp(arg, "Add ", 4) == 0 ? pl_parse(arg + 4, &entry) < 0
+            : (strcmp(arg, "Start") && strcmp(arg, "Stop") && strcmp(arg, "Clear"))) {
+            free(se);
+            fprintf(stderr, "[LS] invalid playlist %s\n", cmd);
+            return NULL;
+        }
+
+        se->extra = strdup(arg);
+        se->type = ACT_LED_PLAYLIST;
+    }
+    else if (strncmp(cmd, "Stream ", 7) == 0) {
+        fi_kind_t kind;
+        char path[FI_PATH_SIZE];
+
+        if (strcmp(cmd+7, "Stop") && fi_parse(cmd+7, &kind, path) < 0) {
+            free(se);
+            fprintf(stderr, "[LS] invalid stream %s\n", cmd);
+            return NULL;
+        }
+
+        se->extra = strdup(cmd+7);
+        se->type = ACT_LED_STREAM;
+    }
+    else if (strncmp(cmd, "Realtime ", 9) == 0) {
+        rt_profile rt;
+
+        if (strcmp(cmd+9, "Stats") && rt_parse(cmd+9, &rt) < 0) {
+            free(se);
+            fprintf(stderr, "[LS] invalid realtime %s\n", cmd);
+            return NULL;
+        }
+
+        se->extra = strdup(cmd+9);
+        se->type = ACT_LED_REALTIME;
+    }
+    else if (strncmp(cmd, "Trace Dump ", 11) == 0) {
+        se->extra = strdup(cmd+11);
+        se->type = ACT_LED_TRACE;
+    }
+    else if (strncmp(cmd, "Effect ", 7) == 0) {
+        const char* arg = cmd + 7;
+        char name[NAME_SIZE] = {0};
+
+        // 'Effect <name> [args]' 要求效果已注册, 其余是播放控制
+        sscanf(arg, "%15s", name);
+        if (!ep_reserved(name) && !ep_find(name)) {
+            free(se);
+            fprintf(stderr, "[LS] invalid effect %s\n", cmd);
+            return NULL;
+        }
+
+        se->extra = strdup(arg);
+        se->type = ACT_LED_EFFECT;
+    }
     else if (strncmp(cmd, "Brightness", 10) == 0) {
         int brig = -1;
         int* p = (int*)&se->extra;
@@ -648,6 +862,42 @@ static led_session* session_create(const char *cmd, void* context)
         else
             se->extra = NULL;
         se->type = ACT_LED_BLINK;
+    }
+    else if (strncmp(cmd, "Spectrum Size", 13) == 0
+            || strncmp(cmd, "Spectrum Rate", 13) == 0) {
+        int val = -1;
+        int* p = (int*)&se->extra;
+        bool size = cmd[9] == 'S';
+
+        if (strlen(cmd) > 14)
+            sscanf(cmd+14, "%d", &val);
+        if (size ? !isfftsize(val) : !israte(val)) {
+            free(se);
+            fprintf(stderr, "[LS] invalid %s\n", cmd);
+            return NULL;
+        }
+
+        *p = val;
+        se->type = size ? ACT_LED_SPECTRUM_SIZE : ACT_LED_SPECTRUM_RATE;
+    }
+    else if (strncmp(cmd, "Spectrum", 8) == 0) {
+        int* p = (int*)&se->extra;
+
+        if (strcmp(cmd+8, " Goertzel") == 0) {
+            *p = ANALYSER_GOERTZEL;
+        }
+        else if (strcmp(cmd+8, " Filter") == 0) {
+            *p = ANALYSER_FILTER;
+        }
+        else if (strlen(cmd) == 8 || strcmp(cmd+8, " FFT") == 0) {
+            *p = ANALYSER_FFT;
+        }
+        else {
+            free(se);
+            fprintf(stderr, "[LS] invalid analyser %s\n", cmd);
+            return NULL;
+        }
+        se->type = ACT_LED_SPECTRUM;
     } else {
         free(se);
         fprintf(stderr, "[LS] invalid cmd %s\n", cmd);
@@ -663,6 +913,12 @@ static void session_destroy(led_session* se)
         switch (se->type) {
         case ACT_LED_BLINK:
         case ACT_LED_ENGINE:
+        case ACT_LED_WAVE_VIEW:
+        case ACT_LED_EFFECT:
+        case ACT_LED_PLAYLIST:
+        case ACT_LED_TRACE:
+        case ACT_LED_STREAM:
+        case ACT_LED_REALTIME:
             if (se->extra)
                 free(se->extra);
             break;
@@ -674,16 +930,158 @@ static void session_destroy(led_session* se)
     }
 }
 
+// 切换场景前停掉正在跑的效果, 播放列表和外部帧
+static void stop_scene(led_device* dev)
+{
+    ep_stop(&dev->effect);
+    pl_stop(&dev->playlist);
+    fi_stop(&dev->input);
+}
+
+// 设备线程每帧都碰的内存: 设备, 显存和频段快照
+// 设备表和快照几个设备共用, rt_lock 按页计数, 一个设备放开不影响别的设备
+static void lock_memory(led_device* dev, bool lock)
+{
+    led_render* lr = dev->render;
+    const struct {
+        const void* addr;
+        size_t len;
+    } areas[] = {
+        { dev, sizeof(*dev) },
+        { lr, sizeof(*lr) },
+        { lr->data, lr->sz_data * 3 },
+        { band_snapshot, sizeof(*band_snapshot) },
+    };
+    int n = sizeof(areas) / sizeof(areas[0]);
+    int i;
+
+    if (lock == dev->locked)
+        return;
+
+    if (lock) {
+        for (i = 0; i < n && rt_lock(areas[i].addr, areas[i].len) == 0; i++)
+            ;
+        dev->locked = i == n;
+        if (dev->locked)
+            return;
+        // 只放开这次锁上的
+        n = i;
+    }
+
+    while (n-- > 0)
+        rt_unlock(areas[n].addr, areas[n].len);
+    dev->locked = false;
+}
+
+static void apply_realtime(led_device* dev)
+{
+    rt_apply(dev->pid, &dev->rt);
+    if (dev->input.running)
+        rt_apply(dev->input.pid, &dev->rt);
+    lock_memory(dev, dev->rt.lock);
+}
+
+static void exec_realtime(led_device* dev, const char* arg)
+{
+    if (!arg)
+        return;
+
+    if (strcmp(arg, "Stats") == 0) {
+        rt_print(dev->name, &dev->wakeups);
+        memset(&dev->wakeups, 0, sizeof(dev->wakeups));
+        return;
+    }
+
+    if (rt_parse(arg, &dev->rt) == 0)
+        apply_realtime(dev);
+}
+
+static void exec_stream(led_device* dev, const char* arg)
+{
+    if (!arg)
+        return;
+
+    if (strcmp(arg, "Stop") == 0) {
+        fi_stop(&dev->input);
+        return;
+    }
+
+    stop_scene(dev);
+    if (fi_start(&dev->input, arg, dev->render->width, dev->render->height) == 0) {
+        rt_apply(dev->input.pid, &dev->rt);
+        dev->timing = false;
+        dev->waving = false;
+    }
+}
+
+static void exec_playlist(led_device* dev, const char* arg)
+{
+    if (!arg)
+        return;
+
+    if (strncmp(arg, "Add ", 4) == 0) {
+        pl_add(&dev->playlist, arg + 4);
+    }
+    else if (strcmp(arg, "Start") == 0) {
+        stop_scene(dev);
+        if (pl_start(&dev->playlist, ep_now()) == 0) {
+            dev->timing = false;
+            dev->waving = false;
+        }
+    }
+    else if (strcmp(arg, "Stop") == 0) {
+        pl_stop(&dev->playlist);
+    }
+    else if (strcmp(arg, "Clear") == 0) {
+        pl_clear(&dev->playlist);
+    }
+}
+
+static void exec_effect(led_device* dev, const char* arg)
+{
+    char name[NAME_SIZE] = {0};
+    const char* rest;
+
+    if (!arg)
+        return;
+
+    sscanf(arg, "%15s", name);
+    rest = arg + strlen(name);
+    rest += *rest == ' ';
+
+    if (strcmp(name, "Load") == 0)
+        ep_load(rest);
+    else if (strcmp(name, "Stop") == 0)
+        ep_stop(&dev->effect);
+    else if (strcmp(name, "Pause") == 0)
+        ep_event(&dev->effect, LED_EFFECT_PAUSE, NULL);
+    else if (strcmp(name, "Resume") == 0)
+        ep_event(&dev->effect, LED_EFFECT_RESUME, NULL);
+    else if (strcmp(name, "Event") == 0)
+        ep_event(&dev->effect, LED_EFFECT_CTRL, rest);
+    else if (ep_find(name)) {
+        pl_stop(&dev->playlist);
+        fi_stop(&dev->input);
+        if (ep_start(&dev->effect, name, dev->render->width,
+                    dev->render->height, *rest ? rest : NULL))
+            return;
+        dev->timing = false;
+        dev->waving = false;
+    }
+}
+
 static void session_exec(led_session* se)
 {
     if (se) {
         led_device* dev = (led_device*)se->context;
 
         pthread_mutex_lock(&dev->lock);
+        TRACE_BEGIN("exec");
 
         if (se->type & ACT_LED_FULLY_ON) {
             dev->timing = false;
             dev->waving = false;
+            stop_scene(dev);
             lr_blank(dev->render, true);
 #ifdef DEBUG
             printf("[LS] exec Fully on\n");
@@ -693,6 +1091,7 @@ static void session_exec(led_session* se)
         if (se->type & ACT_LED_FULLY_OFF) {
             dev->timing = false;
             dev->waving = false;
+            stop_scene(dev);
             lr_clear(dev->render);
 #ifdef DEBUG
             printf("[LS] exec Fully off\n");
@@ -723,7 +1122,8 @@ static void session_exec(led_session* se)
         if (se->type & ACT_LED_DISPLAY_TIME) {
             dev->timing = true;
             dev->waving = false;
-            show_time(dev->render);
+            stop_scene(dev);
+            show_time(dev);
 #ifdef DEBUG
             printf("[LS] exec Show time\n");
 #endif
@@ -732,7 +1132,9 @@ static void session_exec(led_session* se)
         if (se->type & ACT_LED_DISPLAY_WAVE) {
             dev->timing = false;
             dev->waving = true;
-            show_random_wave(dev->render);
+            stop_scene(dev);
+            lr_orient(dev->render, (int)se->extra, dev->render->mirror);
+            show_random_wave(dev);
 #ifdef DEBUG
             printf("[LS] exec Show waving\n");
 #endif
@@ -741,13 +1143,82 @@ static void session_exec(led_session* se)
         if (se->type & ACT_LED_DISPLAY_LOVE) {
             dev->timing = false;
             dev->waving = false;
-            show_love(dev->render);
+            pl_stop(&dev->playlist);
+            fi_stop(&dev->input);
+            ep_start(&dev->effect, "love", dev->render->width,
+                    dev->render->height, NULL);
 #ifdef DEBUG
             printf("[LS] exec Show love\n");
 #endif
         }
 
+        if (se->type & ACT_LED_EFFECT) {
+            exec_effect(dev, (char*)se->extra);
+#ifdef DEBUG
+            printf("[LS] exec Effect %s\n", se->extra ? (char*)se->extra : "???");
+#endif
+        }
+
+        if (se->type & ACT_LED_PLAYLIST) {
+            exec_playlist(dev, (char*)se->extra);
+#ifdef DEBUG
+            printf("[LS] exec Playlist %s\n", se->extra ? (char*)se->extra : "???");
+#endif
+        }
+
+        if (se->type & ACT_LED_STREAM) {
+            exec_stream(dev, (char*)se->extra);
+#ifdef DEBUG
+            printf("[LS] exec Stream %s\n", se->extra ? (char*)se->extra : "???");
+#endif
+        }
+
+        if (se->type & ACT_LED_REALTIME) {
+            exec_realtime(dev, (char*)se->extra);
+#ifdef DEBUG
+            printf("[LS] exec Realtime %s\n", se->extra ? (char*)se->extra : "???");
+#endif
+        }
+
+        if (se->type & ACT_LED_SPECTRUM) {
+            band_snapshot->analyser = (int)se->extra;
+#ifdef DEBUG
+            printf("[LS] exec Spectrum %d\n", (int)se->extra);
+#endif
+        }
+
+        if (se->type & ACT_LED_WAVE_VIEW) {
+            if (se->extra)
+                lv_ctrl(&dev->view, (char*)se->extra);
+#ifdef DEBUG
+            printf("[LS] exec Wave %s\n", se->extra ? (char*)se->extra : "???");
+#endif
+        }
+
+        if (se->type & ACT_LED_SPECTRUM_SIZE) {
+            band_snapshot->size = (int)se->extra;
+#ifdef DEBUG
+            printf("[LS] exec Spectrum Size %d\n", (int)se->extra);
+#endif
+        }
+
+        if (se->type & ACT_LED_SPECTRUM_RATE) {
+            band_snapshot->rate = (int)se->extra;
+#ifdef DEBUG
+            printf("[LS] exec Spectrum Rate %d\n", (int)se->extra);
+#endif
+        }
+
+        TRACE_END("exec");
         pthread_mutex_unlock(&dev->lock);
+
+        // 导出与设备无关, 不用持锁
+        if (se->type & ACT_LED_TRACE) {
+            int n = tr_dump((char*)se->extra);
+#ifdef DEBUG
+            printf("[LS] exec Trace Dump %s %d\n", (char*)se->extra, n);
+#endif
+        }
     }
 }
 
@@ -768,218 +1239,151 @@ static led_device* get_device(const char *name)
     return NULL;
 }
 
-static bool isdigt(int digit)
+static void render_dot(void* ctx, int x, int y, int on)
 {
-    return digit >= 0 && digit < 10;
+    lr_sram((led_render*)ctx, x, y, on);
 }
 
-static void show_digit(led_render* render, int x0, int y0, int digit)
+// 只重画和 old 不同的数字, old 为 NULL 时全画
+static void flush_clock(led_render* render, const struct tm* old, const struct tm* tm)
 {
-    int x, y;
-
-    return;
-
-    if (!isdigt(digit)) {
-        printf("error: [LS] invalid digit: %d\n", digit);
-        return;
-    }
+    lf_draw(old, tm, render->width, render->height, render_dot, render);
+}
 
-    for (y = 0; y < DOT_HEIGHT; y++) {
-        for (x = 0; x < DOT_WIDTH; x++) {
-            int** map = (int**)((int*)dot_maps + (digit * DOT_WIDTH * DOT_HEIGHT));
-            int* line = (int*)map + y * DOT_WIDTH;
+static void show_time(led_device* dev)
+{
+    // 时区在进入时钟时读一次, 之后 localtime_r 用缓存的
+    tzset();
+    dev->tnow = lc_time();
+    localtime_r(&dev->tnow, &dev->now);
 
-            lr_sram(render, x0 + x, y0 + y, line[x]);
-        }
-    }
+#ifdef DEBUG
+    printf("[LS] datatime: %d-%d-%d %d:%d:%d\n",
+        dev->now.tm_year+1900, dev->now.tm_mon+1, dev->now.tm_mday,
+        dev->now.tm_hour, dev->now.tm_min, dev->now.tm_sec);
+#endif
 
-    lr_flush(render);
+    lr_clear(dev->render);
+    flush_clock(dev->render, NULL, &dev->now);
+    lr_flush(dev->render);
 }
 
-static void flush_hour(led_render* render, int hour)
+static void tick_time(led_device* dev)
 {
-#if (DOT_WIDTH == 3)
-    show_digit(render, 1, 1, hour / 10);
-    show_digit(render, 5, 1, hour % 10);
-#else
-    show_digit(render, 1, 2, hour / 10);
-    show_digit(render, 9, 2, hour % 10);
-#endif
+    time_t now = lc_time();
+    struct tm tm;
+
+    if (now == dev->tnow)
+        return;
+
+    lf_step(dev->tnow, &dev->now, now, &tm);
+
+    TRACE_BEGIN("draw");
+    flush_clock(dev->render, &dev->now, &tm);
+    TRACE_END("draw");
+    lr_update(dev->render);
+
+    dev->tnow = now;
+    dev->now = tm;
 }
 
-static void flush_min(led_render* render, int min)
+static void show_wave(led_device* dev, const int* levels)
 {
-#if (DOT_WIDTH == 3)
-    show_digit(render, 9, 7, min / 10);
-    show_digit(render, 13, 7, min % 10);
-#else
-    show_digit(render, 1, 9, min / 10);
-    show_digit(render, 9, 9, min % 10);
-#endif
+    TRACE_BEGIN("draw");
+    lv_draw(&dev->view, dev->render, levels);
+    TRACE_END("draw");
+    lr_flush(dev->render);
 }
 
-static void flush_sec(led_render* render, int sec)
+static void show_random_wave(led_device* dev)
 {
-#if (DOT_WIDTH == 3)
-    int y0 = 14;
-    int ten = (sec / 10) % 6;
-    int per = sec % 10;
-    int x;
+    int levels[VIEW_COLS_MAX];
+    int i;
 
-    for (x = 0; x < 6; x++) {
-        lr_fill(render, x, y0, x < ten);
-    }
+    for (i = 0; i < dev->view.nr_cols; i++)
+        levels[i] = 1 + rand() % (dev->render->height - 2);
 
-    for (x = 0; x < 10; x++) {
-        lr_fill(render, x, y0+1, x < per);
-    }
-#endif
+    show_wave(dev, levels);
 }
 
-static void show_time(led_render* render)
+// 设了 'Wave Rate' 时返回下一帧的时刻, 按固定节拍推进, 落后超过一帧就重新对齐
+static int64_t show_spectrum_wave(led_device* dev)
 {
-    time_t now;
-    struct tm* tm_now;
+    int levels[VIEW_COLS_MAX];
+    ws_amp_t bands[SHARED_BANDS];
+    int64_t now, period;
 
-    return;
+    snapshot_read(band_snapshot, bands);
+    lv_levels(&dev->view, bands, levels);
 
-    time(&now);
-    tm_now = localtime(&now);
+    show_wave(dev, levels);
 
-#ifdef DEBUG
-    printf("[LS] datatime: %d-%d-%d %d:%d:%d\n",
-        tm_now->tm_year+1900, tm_now->tm_mon+1, tm_now->tm_mday,
-        tm_now->tm_hour, tm_now->tm_min, tm_now->tm_sec);
-#endif
+    if (!dev->view.fps)
+        return 0;
 
-    lr_clear(render);
-    flush_hour(render, tm_now->tm_hour);
-    flush_min(render, tm_now->tm_min);
-    flush_sec(render, tm_now->tm_sec);
+    now = ep_now();
+    period = 1000000000LL / dev->view.fps;
+    dev->wave_ns += period;
+    if (dev->wave_ns <= now || dev->wave_ns > now + period)
+        dev->wave_ns = now + period;
+
+    return dev->wave_ns;
 }
 
-static void show_wave(led_render* render, int wave[FIXED_WIDTH])
+static int64_t show_effect(led_device* dev)
 {
-    led_device *dev;
-    int x, y;
-    int hit, top;
-
-    dev = get_device("hbs1632.2");
-    if (!dev) {
-        return;
+    int levels[VIEW_COLS_MAX];
+    ws_amp_t bands[SHARED_BANDS];
+    effect_player* ep = &dev->effect;
+    int64_t now = ep_now();
+    int n;
+
+    snapshot_read(band_snapshot, bands);
+    lv_levels(&dev->view, bands, levels);
+
+    // 只送出和上一帧不同的字节
+    TRACE_BEGIN("draw");
+    n = ep_frame(ep, now, levels, dev->view.nr_cols);
+    TRACE_END("draw");
+    if (n > 0) {
+        lr_load(dev->render, ep->fb.bits, ep->fb.stride);
+        lr_update(dev->render);
     }
 
-    lr_clear(render);
-    // draw base
-    for (x = 0; x < render->width; x++) {
-        hit = CLIP(wave[x], 0, render->width-1);
-        if (hit > dev->wave[x]) {
-            dev->wave[x] = hit;
-            top = hit;
-        }
-        else {
-            dev->wave[x] = MAX(0, dev->wave[x]-1);
-            top = dev->wave[x];
-        }
-
-        // if (x == 1)
-        //     printf("(%d, %d, %d)\n", hit, top, dev->wave[x]);
-
-        hit = render->width - hit;
-        for (y = 0; y < render->height; y++) {
-            lr_sram(render, x, y, y >= hit);
-        }
+    return ep_next(ep, now, IDLE_NS);
+}
 
-        // if (top > 0) {
-        //     top = render->width - top;
-        //     lr_sram(render, x, top, 1);
-        // }
+static int64_t show_playlist(led_device* dev)
+{
+    int levels[VIEW_COLS_MAX];
+    ws_amp_t bands[SHARED_BANDS];
+    playlist* pl = &dev->playlist;
+    int64_t now = ep_now();
+    int n;
+
+    snapshot_read(band_snapshot, bands);
+    lv_levels(&dev->view, bands, levels);
+
+    TRACE_BEGIN("draw");
+    n = pl_frame(pl, now, levels, dev->view.nr_cols);
+    TRACE_END("draw");
+    if (n > 0) {
+        lr_load(dev->render, (unsigned char*)pl->out, pl->stride);
+        lr_update(dev->render);
     }
 
-    lr_flush(render);
-
-    // printf("\n");
+    return pl_next(pl, now, IDLE_NS);
 }
 
-static void show_random_wave(led_render* render)
+// 每次醒来只送一帧, 积压的留在环里, 显示跟不上时由接收线程丢最旧的
+static void show_stream(led_device* dev)
 {
-    int wave[FIXED_WIDTH];
-    int i;
-
-    for (i = 0; i < FIXED_WIDTH; i++)
-        wave[i] = 1 + rand() % (FIXED_WIDTH - 2);
-
-    show_wave(render, wave);
-}
-
-static void show_spectrum_wave(led_render* render)
-{
-    int wave[FIXED_WIDTH];
-    wave_spectrum_t *ws;
-    // int i;
-
-    ws = &wave_spectrum;
-    // for (i = 0; i < FIXED_WIDTH; i++)
-    wave[0] = (int)ws->amps[1];    // 86Hz
-    wave[1] = (int)ws->amps[2];    // 172Hz
-    wave[2] = (int)ws->amps[3];    // 258Hz
-    wave[3] = (int)ws->amps[5];    // 430Hz
-    wave[4] = (int)ws->amps[7];    // 603Hz
-    wave[5] = (int)ws->amps[9];    // 775Hz
-    wave[6] = (int)ws->amps[13];   // 1.1KHz
-    wave[7] = (int)ws->amps[19];   // 1.6KHz
-    wave[8] = (int)ws->amps[23];   // 1.9KHz
-    wave[9] = (int)ws->amps[26];   // 2.2KHz
-    wave[10] = (int)ws->amps[56];  // 4.8KHz
-    wave[11] = (int)ws->amps[90];  // 7.7KHz
-    wave[12] = (int)ws->amps[128]; // 11KHz
-    wave[13] = (int)ws->amps[163]; // 14KHz
-    wave[14] = (int)ws->amps[198]; // 17KHz
-    wave[15] = (int)ws->amps[232]; // 20KHz
-
-    show_wave(render, wave);
-}
-
-static void show_love(led_render* render)
-{
-#define LOVE_WIDTH  16
-#define LOVE_HEIGHT 12
-#define LOVE_Y0     2
-    bool map[LOVE_HEIGHT][LOVE_WIDTH] = {
-        {0, 0, 1, 1, 1, 1, 0, 0, 0, 1, 1, 1, 1, 0, 0, 0},
-        {0, 1, 1, 1, 1, 1, 1, 0, 1, 1, 1, 1, 1, 1, 0, 0},
-        {0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0},
-        {0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0},
-        {0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0},
-        {0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0},
-        {0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0},
-        {0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0},
-        {0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0},
-        {0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0},
-        {0, 0, 0, 0, 0, 0, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0},
-        {0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0}
-    };
-    int x, y;
-    int width, height;
-
-    return;
-
-#ifdef DEBUG
-    // printf("[LS] loving\n");
-#endif
-
-    lr_clear(render);
-
-    width = MIN(render->width, LOVE_WIDTH);
-    height = MIN(render->height, LOVE_HEIGHT);
-
-    for (y = 0; y < height; y++) {
-        bool* line = (bool*)map + y * LOVE_WIDTH;
-
-        for (x = 0; x < width; x++) {
-            lr_sram(render, x, LOVE_Y0 + y, line[x]);
-        }
-    }
-
-    lr_flush(render);
+    int n;
+
+    TRACE_BEGIN("draw");
+    while ((n = fi_load(&dev->input, dev->render)) < 0)
+        ;
+    TRACE_END("draw");
+    if (n > 0)
+        lr_update(dev->render);
 }
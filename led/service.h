@@ -26,11 +26,64 @@ void uni_hal_led_unregister(const char *name);
 	'Brightness 0'(0~15/Up/Down)
 	'Blink 0.5Hz'(0.5Hz/1Hz/2Hz)
 	'Show Time'
+	'Show Love'
 	'Show Wave' (Show Wave 0/90/180/270)
+	'Wave Style Bars' (Bars/Dots/Peak)
+	'Wave Bands 16' (bars per panel, 1 to the panel width)
+	'Wave Range 60 18000' (Hz covered by the bars)
+	'Wave Decay 1' (rows the peak falls per frame)
+	'Wave Rate 30' (redraws per second, 0~100, 0 polls at 2Hz)
 	'Engine Setup' (Setup/Shutdown/Start/Stop)
+	'Effect love' (Effect <name> [args], see uni_led_effect.h)
+	'Effect image /data/clip.pgm 10 Floyd' (PBM/PGM image or sequence, [fps] [Threshold [level]/Floyd/Ordered] [Invert])
+	'Effect Load /path/effect.so'
+	'Effect Event xxx' (Event/Pause/Resume/Stop)
+	'Playlist Add clock 30 Wipe 800' (<effect> <seconds> [Cut/Wipe/Dissolve/Slide <ms>] [args])
+	'Playlist Start' (Start/Stop/Clear)
+	'Stream Pipe /tmp/led.fifo' (Pipe/Socket/Shm <path>, Stream Stop, see uni_led_stream.h)
+	'Spectrum FFT' (FFT/Goertzel/Filter)
+	'Spectrum Size 512' (64~8192, power of 2)
+	'Spectrum Rate 44100' (sample rate of the fed PCM)
+	'Realtime Fifo 50 Cpu 1 Lock' (Fifo [1~99]/Other, Cpu 1/0-1/0,2, Lock; env LED_RT applies at register)
+	'Realtime Stats' (prints and resets the wakeup latency of the device thread)
+	'Trace Dump /tmp/led.json' (Chrome/Perfetto trace, built with -DLED_TRACE)
 */
 int uni_hal_led_ctrl(const char *name, const char *cmd);
 
+/*
+Daemon mode: one process owns the panels, others share them.
+	const char *names[] = { "hbs1632.0", "hbs1632.1" };
+	uni_hal_led_daemon(names, 2);	// blocks until uni_hal_led_daemon_stop()
+
+Any other process using this library while the daemon runs becomes a
+client on its first call: register only checks the device exists,
+ctrl queues the command in shared memory and returns at once (command
+errors are reported by the daemon), feed_pcm analyses locally and
+publishes the bands to the daemon. Only one process may feed PCM.
+If the daemon exits, client calls fail until a new daemon is up, then
+clients re-attach to it on their next call.
+The shared memory is only open to the daemon's user, and 'Effect Load'
+and 'Trace Dump' are not accepted from clients.
+*/
+int uni_hal_led_daemon(const char *names[], int nr);
+/* async-signal-safe */
+void uni_hal_led_daemon_stop(void);
+
+/*
+@format: sample format of buf
+@channels: interleaved channels, downmixed to mono before analysis
+@frames: samples per channel in buf, any size
+*/
+enum uni_hal_led_format {
+	UNI_HAL_LED_S8,
+	UNI_HAL_LED_S16,
+	UNI_HAL_LED_S32,
+	UNI_HAL_LED_F32,
+};
+
+int uni_hal_led_feed_pcm(const void *buf, int frames, int format, int channels);
+
+/* same as uni_hal_led_feed_pcm(buf, size, UNI_HAL_LED_S8, 1) */
 int uni_hal_led_feed_buffer(const char *buf, int size);
 
 #ifdef __cplusplus
@@ -0,0 +1,576 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include "utils.h"
+#include "spectrum.h"
+#include "dsp.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#ifdef FIXED_POINT
+#define Q15_ONE     32767
+#define Q12_ONE     4096
+
+// alpha max plus beta min, alpha = 15/16, beta = 15/32, 误差 < 6.25%
+static ws_amp_t mag_approx(kiss_fft_cpx *y)
+{
+    int32_t re = abs(y->r);
+    int32_t im = abs(y->i);
+    int32_t mx = MAX(re, im);
+    int32_t mn = MIN(re, im);
+
+    return (15 * (mx + (mn >> 1))) >> 4;
+}
+#endif
+
+// kiss_fftr 配置 (旋转因子表) 按 nfft 缓存, 多个上下文共用
+// 引用计数归零后不释放, 下次切回同样的大小直接取用, 满了才淘汰没人用的
+#define PLAN_MAX    8
+
+typedef struct ws_plan {
+    int nfft;
+    int refs;
+    kiss_fftr_cfg cfg;
+} ws_plan;
+
+static ws_plan plans[PLAN_MAX];
+static pthread_mutex_t plan_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static kiss_fftr_cfg plan_get(int nfft)
+{
+    kiss_fftr_cfg cfg;
+    ws_plan* free_slot = NULL;
+    int i;
+
+    pthread_mutex_lock(&plan_lock);
+    for (i = 0; i < PLAN_MAX; i++) {
+        if (plans[i].cfg && plans[i].nfft == nfft) {
+            plans[i].refs++;
+            cfg = plans[i].cfg;
+            pthread_mutex_unlock(&plan_lock);
+            return cfg;
+        }
+        if (!free_slot && (!plans[i].cfg || !plans[i].refs))
+            free_slot = &plans[i];
+    }
+
+    cfg = kiss_fftr_alloc(nfft, 0, NULL, NULL);
+    // 缓存满且都在用时不进缓存, plan_put 时直接释放
+    if (cfg && free_slot) {
+        if (free_slot->cfg)
+            kiss_fftr_free(free_slot->cfg);
+        free_slot->nfft = nfft;
+        free_slot->refs = 1;
+        free_slot->cfg = cfg;
+    }
+    pthread_mutex_unlock(&plan_lock);
+
+    return cfg;
+}
+
+static void plan_put(kiss_fftr_cfg cfg)
+{
+    int i;
+
+    pthread_mutex_lock(&plan_lock);
+    for (i = 0; i < PLAN_MAX; i++) {
+        if (plans[i].cfg == cfg) {
+            plans[i].refs--;
+            pthread_mutex_unlock(&plan_lock);
+            return;
+        }
+    }
+    pthread_mutex_unlock(&plan_lock);
+
+    kiss_fftr_free(cfg);
+}
+
+void ws_plan_flush(void)
+{
+    int i;
+
+    pthread_mutex_lock(&plan_lock);
+    for (i = 0; i < PLAN_MAX; i++) {
+        if (plans[i].cfg && !plans[i].refs) {
+            kiss_fftr_free(plans[i].cfg);
+            plans[i].cfg = NULL;
+        }
+    }
+    pthread_mutex_unlock(&plan_lock);
+}
+
+static void init_window(wave_spectrum* ws, ws_window_t window)
+{
+    int i, n = ws->nfft;
+    double a, w, wsum = 0;
+
+    for (i = 0; i < n; i++) {
+        a = 2 * M_PI * i / n;
+
+        switch (window) {
+        case WS_WINDOW_HANN:
+            w = 0.5 - 0.5 * cos(a);
+            break;
+        case WS_WINDOW_BLACKMAN:
+            w = 0.42 - 0.5 * cos(a) + 0.08 * cos(2 * a);
+            break;
+        default:
+            w = 1.0;
+            break;
+        }
+
+#ifdef FIXED_POINT
+        ws->window[i] = (kiss_fft_scalar)MIN(Q15_ONE, (int)(w * 32768 + 0.5));
+#else
+        ws->window[i] = w;
+#endif
+        wsum += w;
+    }
+
+#ifdef FIXED_POINT
+    // 定点 kiss_fftr 的输出已经除过 nfft
+    ws->gain = (int32_t)(2.0 * n / wsum * Q12_ONE + 0.5);
+#else
+    ws->gain = 2.0 / wsum;
+#endif
+}
+
+static void analyse(wave_spectrum* ws)
+{
+    int i, pos, last = ws->nbins - 1;
+
+    // wpos 指向最旧的样本
+    pos = ws->wpos;
+    for (i = 0; i < ws->nfft; i++) {
+#ifdef FIXED_POINT
+        ws->tin[i] = ((int32_t)ws->ring[pos] * ws->window[i]) >> 15;
+#else
+        ws->tin[i] = ws->ring[pos] * ws->window[i];
+#endif
+        pos = (pos + 1) & (ws->nfft - 1);
+    }
+
+    kiss_fftr(ws->state, ws->tin, ws->fout);
+
+    // amp[0] = np.abs(mag[0])/fftSize
+    // amp[endIndex] = np.abs(mag[endIndex])/fftSize
+    // amp[1:endIndex] = np.abs(mag[1:endIndex])*temp
+    // 加窗后用窗函数之和代替 fftSize
+#ifdef FIXED_POINT
+    ws->amps[0] = (mag_approx(&ws->fout[0]) * ws->gain) >> 13;
+    ws->amps[last] = (mag_approx(&ws->fout[last]) * ws->gain) >> 13;
+    for (i = 1; i < last; i++) {
+        ws->amps[i] = (mag_approx(&ws->fout[i]) * ws->gain) >> 12;
+    }
+#else
+    dsp_mag_db((const float*)ws->fout, ws->nbins, ws->gain, ws->amps, NULL);
+    ws->amps[0] /= 2;
+    ws->amps[last] /= 2;
+#endif
+}
+
+int ws_frame_bytes(int format, int channels)
+{
+    switch (format) {
+    case UNI_HAL_LED_S8:
+        return channels;
+    case UNI_HAL_LED_S16:
+        return 2 * channels;
+    case UNI_HAL_LED_S32:
+    case UNI_HAL_LED_F32:
+        return 4 * channels;
+    default:
+        return 0;
+    }
+}
+
+void ws_convert(const void* in, int n, int format, int channels,
+                kiss_fft_scalar* out)
+{
+#ifdef FIXED_POINT
+    int i, c;
+
+    for (i = 0; i < n; i++) {
+        int32_t acc = 0;
+
+        for (c = 0; c < channels; c++) {
+            int k = i * channels + c;
+
+            switch (format) {
+            case UNI_HAL_LED_S8:
+                acc += ((const int8_t*)in)[k] * 256;
+                break;
+            case UNI_HAL_LED_S16:
+                acc += ((const int16_t*)in)[k];
+                break;
+            case UNI_HAL_LED_S32:
+                acc += ((const int32_t*)in)[k] >> 16;
+                break;
+            default:
+                acc += (int32_t)CLIP(((const float*)in)[k] * 32768, -32768.0f, 32767.0f);
+                break;
+            }
+        }
+
+        out[i] = acc / channels;
+    }
+#else
+    float scale = 1.0f / channels;
+
+    switch (format) {
+    case UNI_HAL_LED_S8:
+        dsp_mix_s8(in, n, channels, scale, out);
+        break;
+    case UNI_HAL_LED_S16:
+        dsp_mix_s16(in, n, channels, scale / 256, out);
+        break;
+    case UNI_HAL_LED_S32:
+        dsp_mix_s32(in, n, channels, scale / 16777216, out);
+        break;
+    default:
+        dsp_mix_f32(in, n, channels, scale * 128, out);
+        break;
+    }
+#endif
+}
+
+// 每相 16 个抽头
+#define TAPS_PER_PHASE  16
+
+// 窗函数法设计低通: 截止在新奈奎斯特频率的 90%, Blackman 窗, 直流增益 1
+static void init_decimator(wave_spectrum* ws)
+{
+    int i, n = ws->ntaps;
+    double fc = 0.45 / ws->prescale;
+    double x, h[n], sum = 0;
+
+    for (i = 0; i < n; i++) {
+        x = i - (n - 1) / 2.0;
+        h[i] = x == 0 ? 2 * fc : sin(2 * M_PI * fc * x) / (M_PI * x);
+        h[i] *= 0.42 - 0.5 * cos(2 * M_PI * i / (n - 1))
+                    + 0.08 * cos(4 * M_PI * i / (n - 1));
+        sum += h[i];
+    }
+
+    // 卷积要反序, 这里直接存反序后的系数, 和 hist 顺序对齐点乘
+    for (i = 0; i < n; i++) {
+#ifdef FIXED_POINT
+        ws->taps[n - 1 - i] = (kiss_fft_scalar)floor(h[i] / sum * 32768 + 0.5);
+#else
+        ws->taps[n - 1 - i] = h[i] / sum;
+#endif
+    }
+}
+
+static kiss_fft_scalar decimate(wave_spectrum* ws)
+{
+    const kiss_fft_scalar* x = ws->hist + ws->hpos;
+#ifdef FIXED_POINT
+    int64_t acc = 0;
+    int i;
+
+    for (i = 0; i < ws->ntaps; i++)
+        acc += (int32_t)ws->taps[i] * x[i];
+
+    return (kiss_fft_scalar)CLIP(acc >> 15, -32768, 32767);
+#else
+    return dsp_dot(ws->taps, x, ws->ntaps);
+#endif
+}
+
+static void ring_advance(wave_spectrum* ws, int n)
+{
+    ws->wpos = (ws->wpos + n) & (ws->nfft - 1);
+    ws->filled = MIN(ws->nfft, ws->filled + n);
+    ws->pending += n;
+}
+
+int ws_feed(wave_spectrum* ws, const void* buf, int frames, int format, int channels)
+{
+    const char* p = buf;
+    int stride = ws_frame_bytes(format, channels);
+    int skip, n, i;
+
+    if (!ws || !buf || frames <= 0 || channels <= 0 || !stride)
+        return 0;
+
+    // 只有最后 nfft * prescale 帧 (加上 FIR 的历史) 会留在环里, 前面的只计数
+    skip = frames - ws->nfft * ws->prescale - ws->ntaps;
+    if (skip > 0) {
+        skip -= skip % ws->prescale;
+        ws->pending += skip / ws->prescale;
+        p += skip * stride;
+        frames -= skip;
+    }
+
+    while (frames > 0) {
+        if (ws->prescale > 1) {
+            // 先转到 tin (analyse 时才会用到), 再过抽取滤波器
+            n = MIN(frames, ws->nfft);
+            ws_convert(p, n, format, channels, ws->tin);
+
+            for (i = 0; i < n; i++) {
+                ws->hpos = ws->hpos + 1 < ws->ntaps ? ws->hpos + 1 : 0;
+                ws->hist[ws->hpos + ws->ntaps - 1] = ws->tin[i];
+                if (ws->hpos > 0)
+                    ws->hist[ws->hpos - 1] = ws->tin[i];
+
+                if (++ws->phase < ws->prescale)
+                    continue;
+
+                ws->ring[ws->wpos] = decimate(ws);
+                ring_advance(ws, 1);
+                ws->phase = 0;
+            }
+        }
+        else {
+            // 直接写进环形缓冲, 不多一次拷贝
+            n = MIN(frames, ws->nfft - ws->wpos);
+            ws_convert(p, n, format, channels, ws->ring + ws->wpos);
+            ring_advance(ws, n);
+        }
+
+        p += n * stride;
+        frames -= n;
+    }
+
+    // 一次喂入跨过多个 hop 时只算最新一帧, 旧帧反正会被覆盖
+    if (ws->filled < ws->nfft || ws->pending < ws->hop)
+        return 0;
+
+    ws->pending %= ws->hop;
+    analyse(ws);
+
+    return 1;
+}
+
+wave_spectrum* ws_create(int nfft, int hop, int prescale, ws_window_t window)
+{
+    wave_spectrum* ws;
+
+    if (nfft <= 0 || (nfft & (nfft - 1)) || hop <= 0 || hop > nfft) {
+        fprintf(stderr, "error: [WS] create invalid param %d/%d\n", nfft, hop);
+        return NULL;
+    }
+
+    ws = malloc(sizeof(*ws));
+    if (!ws) {
+        fprintf(stderr, "error: [WS] create malloc\n");
+        return NULL;
+    }
+    memset(ws, 0, sizeof(*ws));
+
+    ws->nfft = nfft;
+    ws->nbins = nfft / 2 + 1;
+    ws->hop = hop;
+    ws->prescale = prescale > 1 ? prescale : 1;
+    ws->ntaps = ws->prescale > 1 ? ws->prescale * TAPS_PER_PHASE : 0;
+
+    ws->state = plan_get(nfft);
+    ws->ring = calloc(nfft, sizeof(kiss_fft_scalar));
+    ws->window = malloc(nfft * sizeof(kiss_fft_scalar));
+    ws->tin = malloc(nfft * sizeof(kiss_fft_scalar));
+    ws->fout = malloc(ws->nbins * sizeof(kiss_fft_cpx));
+    ws->amps = calloc(ws->nbins, sizeof(ws_amp_t));
+    if (ws->ntaps) {
+        ws->taps = malloc(ws->ntaps * sizeof(kiss_fft_scalar));
+        ws->hist = calloc(ws->ntaps * 2, sizeof(kiss_fft_scalar));
+        if (!ws->taps || !ws->hist)
+            ws->ntaps = -1;
+    }
+    if (!ws->state || !ws->ring || !ws->window
+        || !ws->tin || !ws->fout || !ws->amps || ws->ntaps < 0) {
+        fprintf(stderr, "error: [WS] create alloc %d\n", nfft);
+        ws_destroy(ws);
+        return NULL;
+    }
+
+    init_window(ws, window);
+    if (ws->ntaps)
+        init_decimator(ws);
+    return ws;
+}
+
+void ws_destroy(wave_spectrum* ws)
+{
+    if (ws) {
+        if (ws->state)
+            plan_put(ws->state);
+        free(ws->ring);
+        free(ws->window);
+        free(ws->tin);
+        free(ws->fout);
+        free(ws->amps);
+        free(ws->taps);
+        free(ws->hist);
+        free(ws);
+    }
+}
+
+static float overlap(float lo, float hi, int bin)
+{
+    float a = MAX(lo, bin - 0.5f);
+    float b = MIN(hi, bin + 0.5f);
+
+    return b > a ? b - a : 0;
+}
+
+float bm_centre(int band, int nr_bands, float fmin, float fmax)
+{
+    return fmin * pow(fmax / fmin, (band + 0.5) / nr_bands);
+}
+
+band_map* bm_create(int rate, int nfft, int nr_bands, float fmin, float fmax)
+{
+    band_map* bm;
+    float edges[BANDS_MAX + 1];
+    float step, sum, scale;
+    int i, k, nbins, total;
+
+    nbins = nfft / 2 + 1;
+    fmax = MIN(fmax, rate / 2.0f);
+    if (rate <= 0 || nfft <= 0 || nr_bands <= 0 || nr_bands > BANDS_MAX
+        || fmin <= 0 || fmin >= fmax) {
+        fprintf(stderr, "error: [BM] create invalid param\n");
+        return NULL;
+    }
+
+    bm = malloc(sizeof(*bm));
+    if (!bm) {
+        fprintf(stderr, "error: [BM] create malloc\n");
+        return NULL;
+    }
+    memset(bm, 0, sizeof(*bm));
+    bm->nr_bands = nr_bands;
+
+    // 频段边界按对数等分, 换算成 bin 坐标
+    step = pow(fmax / fmin, 1.0 / nr_bands);
+    for (i = 0; i <= nr_bands; i++)
+        edges[i] = fmin * pow(step, i) * nfft / rate;
+
+    // 跳过直流 bin 0
+    total = 0;
+    for (i = 0; i < nr_bands; i++) {
+        bm->lo[i] = CLIP((int)floorf(edges[i] + 0.5f), 1, nbins - 1);
+        bm->nr[i] = CLIP((int)floorf(edges[i + 1] + 0.5f), 1, nbins - 1)
+                        - bm->lo[i] + 1;
+        bm->offset[i] = total;
+        total += bm->nr[i];
+    }
+
+    bm->weights = malloc(total * sizeof(ws_amp_t));
+    if (!bm->weights) {
+        fprintf(stderr, "error: [BM] create malloc weights\n");
+        free(bm);
+        return NULL;
+    }
+
+    for (i = 0; i < nr_bands; i++) {
+        ws_amp_t* w = bm->weights + bm->offset[i];
+
+        sum = 0;
+        for (k = 0; k < bm->nr[i]; k++)
+            sum += overlap(edges[i], edges[i + 1], bm->lo[i] + k);
+
+        // 低频段比一个 bin 还窄时退化成插值, 权重和补到 1
+        scale = sum < 1.0f ? (sum > 0 ? 1.0f / sum : 0) : 1.0f;
+        for (k = 0; k < bm->nr[i]; k++) {
+            float wk = sum > 0 ? overlap(edges[i], edges[i + 1], bm->lo[i] + k)
+                                    * scale : 1.0f / bm->nr[i];
+#ifdef FIXED_POINT
+            w[k] = (ws_amp_t)(wk * 32768 + 0.5f);
+#else
+            w[k] = wk;
+#endif
+        }
+    }
+
+    return bm;
+}
+
+void bm_destroy(band_map* bm)
+{
+    if (bm) {
+        free(bm->weights);
+        free(bm);
+    }
+}
+
+void bm_reduce(const band_map* bm, const ws_amp_t* amps, ws_amp_t* bands)
+{
+    int i, k;
+
+    for (i = 0; i < bm->nr_bands; i++) {
+        const ws_amp_t* w = bm->weights + bm->offset[i];
+        const ws_amp_t* a = amps + bm->lo[i];
+#ifdef FIXED_POINT
+        uint64_t acc = 0;
+
+        // (a^2 >> 15) * w 保持 Q30, 64 位累加不会溢出
+        for (k = 0; k < bm->nr[i]; k++)
+            acc += (((uint64_t)((int64_t)a[k] * a[k])) >> 15) * (uint32_t)w[k];
+
+        bands[i] = dsp_isqrt64(acc);
+#else
+        float acc = 0;
+
+        for (k = 0; k < bm->nr[i]; k++)
+            acc += w[k] * a[k] * a[k];
+
+        bands[i] = sqrtf(acc);
+#endif
+    }
+}
+
+spectrum_ctx* sc_create(const spectrum_config* conf)
+{
+    spectrum_ctx* sc;
+    spectrum_config* c;
+
+    sc = malloc(sizeof(*sc));
+    if (!sc) {
+        fprintf(stderr, "error: [SC] create malloc\n");
+        return NULL;
+    }
+    memset(sc, 0, sizeof(*sc));
+
+    c = &sc->conf;
+    *c = *conf;
+    if (c->hop <= 0)
+        c->hop = c->nfft / 2;
+    // 高采样率输入自动抽取到 48KHz 附近, 频率分辨率不随采样率变差
+    if (c->prescale <= 0)
+        c->prescale = c->rate > 48000 ? c->rate / 48000 : 1;
+
+    sc->ws = ws_create(c->nfft, c->hop, c->prescale, c->window);
+    sc->bm = bm_create(c->rate / c->prescale, c->nfft,
+                    c->nr_bands, c->fmin, c->fmax);
+    if (!sc->ws || !sc->bm) {
+        sc_destroy(sc);
+        return NULL;
+    }
+
+    return sc;
+}
+
+void sc_destroy(spectrum_ctx* sc)
+{
+    if (sc) {
+        ws_destroy(sc->ws);
+        bm_destroy(sc->bm);
+        free(sc);
+    }
+}
+
+int sc_feed(spectrum_ctx* sc, const void* buf, int frames, int format, int channels)
+{
+    if (!ws_feed(sc->ws, buf, frames, format, channels))
+        return 0;
+
+    bm_reduce(sc->bm, sc->ws->amps, sc->bands);
+    return 1;
+}
@@ -0,0 +1,124 @@
+#ifndef _SPECTRUM_H_
+#define _SPECTRUM_H_
+
+#include <stdint.h>
+#include "kiss_fftr.h"
+#include "service.h"
+
+// 定点路径跟随 kissfft 的 FIXED_POINT, 要链接同样配置编译的 libkissfft
+// 定点时幅度为 Q15, 1.0 对应满幅 (char 128)
+#ifdef FIXED_POINT
+typedef int32_t ws_amp_t;
+#else
+typedef float ws_amp_t;
+#endif
+
+typedef enum ws_window {
+    WS_WINDOW_NONE,
+    WS_WINDOW_HANN,
+    WS_WINDOW_BLACKMAN,
+} ws_window_t;
+
+typedef struct wave_spectrum {
+    kiss_fftr_cfg state;
+    int nfft;
+    int nbins;
+    int hop;
+
+    // 最近 nfft 个样本的环形缓冲, nfft 为 2 的幂
+    kiss_fft_scalar* ring;
+    int wpos;
+    int filled;
+    int pending;
+
+    // 预分频: 抽取 FIR, 每 prescale 个输入只算一个输出
+    // hist 存两份 (双倍长度), 最近 ntaps 个样本总是连续的
+    int prescale;
+    int ntaps;
+    int phase;
+    int hpos;
+    kiss_fft_scalar* taps;
+    kiss_fft_scalar* hist;
+
+    // 预先计算的窗函数, 及幅度归一化系数 2 * nfft / sum(window)
+    kiss_fft_scalar* window;
+#ifdef FIXED_POINT
+    int32_t gain;       // Q12
+#else
+    float gain;
+#endif
+
+    kiss_fft_scalar* tin;
+    kiss_fft_cpx* fout;
+    ws_amp_t* amps;
+} wave_spectrum;
+
+#define BANDS_MAX   64
+// 服务共享分析的频段布局: [BAND_FMIN, BAND_FMAX] 按对数分 SHARED_BANDS 段
+// 各设备的柱由 led_view 从这里再映射, 宿主机的 latency 也按它取测试频率
+#define SHARED_BANDS    32
+#define BAND_FMIN       60
+#define BAND_FMAX       18000
+
+// 对数分段的频段映射, 每段覆盖 [lo, lo + nr) 的 bin, 边缘按重叠比例加权
+typedef struct band_map {
+    int nr_bands;
+    int lo[BANDS_MAX];
+    int nr[BANDS_MAX];
+    int offset[BANDS_MAX];
+    ws_amp_t* weights;  // 定点时为 Q15
+} band_map;
+
+// 频谱上下文: 一组运行时参数 + 对应的 wave_spectrum 和 band_map
+// hop 为 0 时取 nfft / 2, prescale 为 0 时按 rate 自动选
+typedef struct spectrum_config {
+    int rate;
+    int nfft;
+    int hop;
+    int prescale;
+    int nr_bands;
+    float fmin;
+    float fmax;
+    ws_window_t window;
+} spectrum_config;
+
+typedef struct spectrum_ctx {
+    spectrum_config conf;
+    wave_spectrum* ws;
+    band_map* bm;
+    ws_amp_t bands[BANDS_MAX];
+} spectrum_ctx;
+
+// prescale 为抽取倍数 (1 不抽取), 96/192KHz 输入可用 2/4 降到 48KHz
+// FFT 配置取自按 nfft 的缓存, 相同大小的上下文共用, 重建也不重新分配
+wave_spectrum* ws_create(int nfft, int hop, int prescale, ws_window_t window);
+void ws_destroy(wave_spectrum* ws);
+
+// 释放缓存里没有上下文在用的 FFT 配置
+void ws_plan_flush(void);
+
+// 每帧字节数, 不支持的格式返回 0
+int ws_frame_bytes(int format, int channels);
+
+// 转换 + 解交错 + 混成单声道, 幅度统一到 S8 的刻度 (定点时为 Q15)
+void ws_convert(const void* in, int n, int format, int channels, kiss_fft_scalar* out);
+
+// 任意长度的样本块, format 为 enum uni_hal_led_format, 多声道取平均
+// 返回 1 表示 amps 已更新为最新一帧
+int ws_feed(wave_spectrum* ws, const void* buf, int frames, int format, int channels);
+
+band_map* bm_create(int rate, int nfft, int nr_bands, float fmin, float fmax);
+void bm_destroy(band_map* bm);
+// 对数等分后第 band 段的几何中心, Goertzel 跟踪的就是这些频率
+float bm_centre(int band, int nr_bands, float fmin, float fmax);
+
+// bands[i] = sqrt(sum(w * amps^2)), 即频段内的能量折算成幅度
+void bm_reduce(const band_map* bm, const ws_amp_t* amps, ws_amp_t* bands);
+
+spectrum_ctx* sc_create(const spectrum_config* conf);
+void sc_destroy(spectrum_ctx* sc);
+
+// 返回 1 表示 bands 已更新
+int sc_feed(spectrum_ctx* sc, const void* buf, int frames, int format, int channels);
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef HAL_INC_UNI_LED_STREAM_H_
+#define HAL_INC_UNI_LED_STREAM_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+Raw frame streaming, for content rendered in another process.
+Start a stream on a device with one of
+	uni_hal_led_ctrl("hbs1632", "Stream Pipe /tmp/led.fifo");	created if missing
+	uni_hal_led_ctrl("hbs1632", "Stream Socket /tmp/led.sock");	AF_UNIX datagrams
+	uni_hal_led_ctrl("hbs1632", "Stream Shm /led_frames");		created by the producer
+and stop it with 'Stream Stop' or by starting any other scene.
+
+Every frame is a header followed by height * stride bytes, one datagram
+per frame on the socket. Width and height must match the device.
+MONO rows use the struct led_frame layout: bit (x % 8) of byte x / 8 is
+led x. GRAY is one byte per led, lit from 128 up.
+
+Frames that cannot be shown in time are dropped oldest first.
+*/
+#define LED_STREAM_MAGIC	0x314d464c	/* "LFM1" */
+
+enum led_stream_format {
+	LED_STREAM_MONO = 1,
+	LED_STREAM_GRAY = 8,
+};
+
+struct led_stream_header {
+	unsigned int magic;
+	unsigned short width;
+	unsigned short height;
+	unsigned short format;	/* enum led_stream_format, bits per led */
+	unsigned short stride;	/* bytes per row */
+	unsigned int seq;	/* free for the producer */
+};
+
+/*
+Shared memory: struct led_stream_shm, then @slots slots of @slot_size
+bytes, each a header plus payload. To publish, fill slot (head % slots)
+and then increment head. A slot the reader is still on may be
+overwritten once the producer is a full ring ahead; such frames are
+discarded after the fact.
+*/
+struct led_stream_shm {
+	unsigned int magic;
+	unsigned int slots;
+	unsigned int slot_size;
+	volatile unsigned int head;
+};
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -1,9 +1,37 @@
 #include <stdbool.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <assert.h>
+#include <math.h>
+#include <time.h>
+#include <signal.h>
+#include <sched.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <fcntl.h>
 #include "render.h"
 #include "service.h"
+#include "spectrum.h"
+#include "dsp.h"
+#include "tracker.h"
+#include "filterbank.h"
+#include "view.h"
+#include "player.h"
+#include "playlist.h"
+#include "trace.h"
+#include "clock.h"
+#include "daemon.h"
+#include "stream.h"
+#include "input.h"
+#include "image.h"
+#include "realtime.h"
+#include "../hbs1632/hbs1632-flush.h"
+#include "utils.h"
 
 #define LED_NAME "hbs1632.0"
 
@@ -112,6 +140,1459 @@ static void test_rander(int argc, char *argv[])
     lr_destroy(lr);
 }
 
+#define SP_NFFT     512
+#define SP_RATE     44100
+#define SP_BANDS    16
+
+#ifdef FIXED_POINT
+#define AMP_TO_CHAR(x)  ((x) / 256.0)
+#else
+#define AMP_TO_CHAR(x)  (x)
+#endif
+
+static double elapsed_ns(struct timespec* t0, struct timespec* t1)
+{
+    return (t1->tv_sec - t0->tv_sec) * 1e9 + (t1->tv_nsec - t0->tv_nsec);
+}
+
+// 双精度 DFT 作为参考, 与 ws_create(.., WS_WINDOW_HANN) 同样归一化
+static void reference_amps(const char* buf, double* amps)
+{
+    double w, wsum = 0, re, im, a;
+    int i, k;
+
+    for (i = 0; i < SP_NFFT; i++)
+        wsum += 0.5 - 0.5 * cos(2 * M_PI * i / SP_NFFT);
+
+    for (k = 0; k <= SP_NFFT / 2; k++) {
+        re = im = 0;
+        for (i = 0; i < SP_NFFT; i++) {
+            w = 0.5 - 0.5 * cos(2 * M_PI * i / SP_NFFT);
+            a = -2 * M_PI * k * i / SP_NFFT;
+            re += buf[i] * w * cos(a);
+            im += buf[i] * w * sin(a);
+        }
+        amps[k] = hypot(re, im) * ((k == 0 || k == SP_NFFT / 2) ? 1 : 2) / wsum;
+    }
+}
+
+static void test_spectrum(int argc, char *argv[])
+{
+    static const float tones[] = { 100, 440, 1000, 3000, 8000, 15000 };
+    char buf[SP_NFFT];
+    double ref[SP_NFFT / 2 + 1], err, max_bin = 0, max_band = 0;
+    ws_amp_t bands[SP_BANDS];
+    wave_spectrum* ws;
+    band_map* bm;
+    struct timespec t0, t1;
+    int loops = argc > 2 ? atoi(argv[2]) : 1000;
+    int t, i, k;
+
+    ws = ws_create(SP_NFFT, SP_NFFT, 1, WS_WINDOW_HANN);
+    bm = bm_create(SP_RATE, SP_NFFT, SP_BANDS, 60, 18000);
+    assert(ws && bm);
+
+    // 精度: 各路径与双精度参考的最大误差, 以满幅 128 为单位
+    for (t = 0; t < sizeof(tones) / sizeof(tones[0]); t++) {
+        for (i = 0; i < SP_NFFT; i++)
+            buf[i] = (char)(100 * sin(2 * M_PI * tones[t] * i / SP_RATE)
+                            + 20 * sin(2 * M_PI * 5 * tones[t] * i / SP_RATE));
+
+        assert(ws_feed(ws, buf, SP_NFFT, UNI_HAL_LED_S8, 1) == 1);
+        reference_amps(buf, ref);
+
+        for (k = 0; k <= SP_NFFT / 2; k++) {
+            err = fabs(AMP_TO_CHAR(ws->amps[k]) - ref[k]) / 128;
+            max_bin = err > max_bin ? err : max_bin;
+        }
+
+        bm_reduce(bm, ws->amps, bands);
+        for (i = 0; i < SP_BANDS; i++) {
+            double acc = 0;
+
+            for (k = 0; k < bm->nr[i]; k++) {
+#ifdef FIXED_POINT
+                double w = bm->weights[bm->offset[i] + k] / 32768.0;
+#else
+                double w = bm->weights[bm->offset[i] + k];
+#endif
+                acc += w * ref[bm->lo[i] + k] * ref[bm->lo[i] + k];
+            }
+
+            err = fabs(AMP_TO_CHAR(bands[i]) - sqrt(acc)) / 128;
+            max_band = err > max_band ? err : max_band;
+        }
+    }
+
+    printf("spectrum: max bin error %.4f, max band error %.4f (full scale)\n",
+            max_bin, max_band);
+    assert(max_bin < 0.08 && max_band < 0.08);
+
+    // 同一段信号换成 S16 立体声分块喂入 / F32 单声道, 结果应与 S8 一致
+    {
+        int16_t s16[SP_NFFT * 2];
+        float f32[SP_NFFT];
+        ws_amp_t s8_amps[SP_NFFT / 2 + 1];
+        int got = 0;
+
+        memcpy(s8_amps, ws->amps, sizeof(s8_amps));
+        for (i = 0; i < SP_NFFT; i++) {
+            s16[2 * i] = s16[2 * i + 1] = buf[i] * 256;
+            f32[i] = buf[i] / 128.0f;
+        }
+
+        for (i = 0; i < SP_NFFT; i += 100)
+            got += ws_feed(ws, s16 + 2 * i, MIN(100, SP_NFFT - i), UNI_HAL_LED_S16, 2);
+        assert(got == 1);
+        for (k = 0; k <= SP_NFFT / 2; k++)
+            assert(fabs(AMP_TO_CHAR(ws->amps[k] - s8_amps[k])) < 0.1);
+
+        assert(ws_feed(ws, f32, SP_NFFT, UNI_HAL_LED_F32, 1) == 1);
+        for (k = 0; k <= SP_NFFT / 2; k++)
+            assert(fabs(AMP_TO_CHAR(ws->amps[k] - s8_amps[k])) < 0.1);
+    }
+
+    // 96KHz 输入 2 倍抽取: 1.5KHz 保留, 40KHz 不能混叠到 8KHz
+    {
+        int16_t s16[SP_NFFT * 2 + 64];
+        wave_spectrum* dws = ws_create(SP_NFFT, SP_NFFT, 2, WS_WINDOW_HANN);
+        int n = sizeof(s16) / sizeof(s16[0]);
+        double tone = 0, alias = 0;
+
+        assert(dws);
+        for (i = 0; i < n; i++)
+            s16[i] = 20000 * sin(2 * M_PI * 1500 * i / 96000.0)
+                    + 10000 * sin(2 * M_PI * 40000 * i / 96000.0);
+        assert(ws_feed(dws, s16, n, UNI_HAL_LED_S16, 1) == 1);
+
+        for (k = 15; k <= 17; k++)
+            tone = MAX(tone, AMP_TO_CHAR(dws->amps[k]));
+        for (k = 83; k <= 88; k++)
+            alias = MAX(alias, AMP_TO_CHAR(dws->amps[k]));
+
+        printf("spectrum: decimate x2 tone %.2f, alias %.3f\n", tone, alias);
+        assert(fabs(tone - 20000 / 256.0) < 2 && alias < 0.5);
+        ws_destroy(dws);
+    }
+
+    // 上下文: 不同大小并存, 相同大小共用 FFT 配置, 重建时从缓存取
+    {
+        spectrum_config conf = { SP_RATE, 1024, 0, 0, SP_BANDS, 60, 18000, WS_WINDOW_HANN };
+        spectrum_ctx *a, *b, *c;
+        kiss_fftr_cfg cfg;
+
+        a = sc_create(&conf);
+        conf.nfft = SP_NFFT;
+        b = sc_create(&conf);
+        conf.rate = 96000;
+        c = sc_create(&conf);
+        assert(a && b && c);
+        assert(b->ws->state == ws->state && c->ws->state == ws->state);
+        assert(a->ws->state != ws->state && c->conf.prescale == 2);
+
+        cfg = a->ws->state;
+        sc_destroy(a);
+        conf.nfft = 1024;
+        a = sc_create(&conf);
+        assert(a && a->ws->state == cfg);
+
+        assert(sc_feed(b, buf, SP_NFFT, UNI_HAL_LED_S8, 1) == 1);
+        for (i = 0; i < SP_BANDS; i++)
+            assert(fabs(AMP_TO_CHAR(b->bands[i] - bands[i])) < 0.1);
+
+        sc_destroy(a);
+        sc_destroy(b);
+        sc_destroy(c);
+    }
+
+    // 性能: 每帧 (一次 FFT + 幅度 + 分段) 的平均耗时
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < loops; i++) {
+        ws_feed(ws, buf, SP_NFFT, UNI_HAL_LED_S8, 1);
+        bm_reduce(bm, ws->amps, bands);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    printf("spectrum: %d frames, %.1f us/frame\n", loops,
+            elapsed_ns(&t0, &t1) / 1e3 / loops);
+
+    bm_destroy(bm);
+    ws_destroy(ws);
+}
+
+static void test_dsp(int argc, char *argv[])
+{
+#define DSP_BINS (SP_NFFT / 2 + 1)
+    float cpx[DSP_BINS * 2], mag[DSP_BINS], db[DSP_BINS];
+    float ref_mag[DSP_BINS], ref_db[DSP_BINS];
+    double err, max_mag = 0, max_db = 0, t_fast, t_ref;
+    struct timespec t0, t1;
+    int loops = argc > 2 ? atoi(argv[2]) : 100000;
+    int i;
+
+    // 覆盖 1e-12 到 1e4 的幅度, 以及全零 bin
+    srand(1);
+    for (i = 0; i < DSP_BINS * 2; i++)
+        cpx[i] = (rand() % 2 ? 1 : -1) * pow(10, rand() % 16 - 12) * rand() / RAND_MAX;
+    cpx[0] = cpx[1] = 0;
+
+    dsp_mag_db(cpx, DSP_BINS, 2.0f / SP_NFFT, mag, db);
+    dsp_mag_db_ref(cpx, DSP_BINS, 2.0f / SP_NFFT, ref_mag, ref_db);
+    for (i = 0; i < DSP_BINS; i++) {
+        err = ref_mag[i] > 0 ? fabs(mag[i] - ref_mag[i]) / ref_mag[i] : mag[i];
+        max_mag = err > max_mag ? err : max_mag;
+        err = fabs(db[i] - ref_db[i]);
+        max_db = err > max_db ? err : max_db;
+    }
+
+    printf("dsp: max mag rel error %.2e, max db error %.2e\n", max_mag, max_db);
+    assert(max_mag < 1e-5 && max_db < 1e-3);
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < loops; i++)
+        dsp_mag_db(cpx, DSP_BINS, 2.0f / SP_NFFT, mag, db);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    t_fast = elapsed_ns(&t0, &t1) / loops / DSP_BINS;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < loops; i++)
+        dsp_mag_db_ref(cpx, DSP_BINS, 2.0f / SP_NFFT, ref_mag, ref_db);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    t_ref = elapsed_ns(&t0, &t1) / loops / DSP_BINS;
+
+    printf("dsp: mag+db %.2f ns/bin, libm %.2f ns/bin\n", t_fast, t_ref);
+}
+
+static void test_tracker(int argc, char *argv[])
+{
+    char buf[SP_NFFT];
+    band_tracker* bt;
+    struct timespec t0, t1;
+    double step, f, err, max_err = 0;
+    int loops = argc > 2 ? atoi(argv[2]) : 1000;
+    int b, i;
+
+    bt = bt_create(SP_RATE, SP_NFFT, SP_BANDS, 60, 18000);
+    assert(bt);
+
+    // 频段中心的单音应该只在本段出满幅, 相邻两段以外要压下去
+    step = pow(18000 / 60.0, 1.0 / SP_BANDS);
+    for (b = 0; b < SP_BANDS; b++) {
+        f = 60 * pow(step, b + 0.5);
+        for (i = 0; i < SP_NFFT; i++)
+            buf[i] = (char)(100 * sin(2 * M_PI * f * i / SP_RATE));
+
+        assert(bt_feed(bt, buf, SP_NFFT, UNI_HAL_LED_S8, 1) == 1);
+        err = fabs(AMP_TO_CHAR(bt->bands[b]) - 100) / 128;
+        max_err = err > max_err ? err : max_err;
+        for (i = 0; i < SP_BANDS; i++) {
+            if (abs(i - b) > 2 && f > 500)
+                assert(AMP_TO_CHAR(bt->bands[i]) < 10);
+        }
+    }
+
+    printf("tracker: max centre error %.4f (full scale)\n", max_err);
+    assert(max_err < 0.08);
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < loops; i++)
+        bt_feed(bt, buf, SP_NFFT, UNI_HAL_LED_S8, 1);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    printf("tracker: %d blocks, %.1f us/block\n", loops, elapsed_ns(&t0, &t1) / 1e3 / loops);
+    bt_destroy(bt);
+}
+
+static void test_filter(int argc, char *argv[])
+{
+    char buf[SP_NFFT];
+    filter_bank* fb;
+    struct timespec t0, t1;
+    double step, f, err, max_err = 0;
+    int loops = argc > 2 ? atoi(argv[2]) : 1000;
+    int b, i, n, lag;
+
+    fb = fb_create(SP_RATE, 64, SP_BANDS, 60, 18000, 60);
+    assert(fb);
+
+    // 频段中心的单音稳定后本段接近满幅, 远处的段要压下去
+    step = pow(18000 / 60.0, 1.0 / SP_BANDS);
+    for (b = 0; b < SP_BANDS; b++) {
+        f = 60 * pow(step, b + 0.5);
+        for (n = 0; n < 8; n++) {
+            for (i = 0; i < SP_NFFT; i++)
+                buf[i] = (char)(100 * sin(2 * M_PI * f * (n * SP_NFFT + i) / SP_RATE));
+            assert(fb_feed(fb, buf, SP_NFFT, UNI_HAL_LED_S8, 1) == 1);
+        }
+
+        err = fabs(AMP_TO_CHAR(fb->bands[b]) - 100) / 128;
+        max_err = err > max_err ? err : max_err;
+        for (i = 0; i < SP_BANDS; i++) {
+            if (abs(i - b) > 2 && f > 500)
+                assert(AMP_TO_CHAR(fb->bands[i]) < 20);
+        }
+    }
+
+    // 最低段半周期约 370 样本, 包络在两个峰之间会掉 10% 左右
+    printf("filter: max centre error %.4f (full scale)\n", max_err);
+    assert(max_err < 0.1);
+
+    // 静音后接一个 4kHz 突发, 看第一次发布时对应的段有没有起来
+    memset(buf, 0, sizeof(buf));
+    for (n = 0; n < 200; n++)
+        fb_feed(fb, buf, SP_NFFT, UNI_HAL_LED_S8, 1);
+
+    b = (int)(log(4000 / 60.0) / log(step));
+    for (i = 0; i < SP_NFFT; i++)
+        buf[i] = (char)(100 * sin(2 * M_PI * 4000 * i / SP_RATE));
+    for (lag = 0; lag < SP_NFFT; lag += 16) {
+        fb_feed(fb, buf + lag, 16, UNI_HAL_LED_S8, 1);
+        if (AMP_TO_CHAR(fb->bands[b]) > 50)
+            break;
+    }
+    printf("filter: 4kHz burst visible after %d samples\n", lag + 16);
+    assert(lag < 256);
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < loops; i++)
+        fb_feed(fb, buf, SP_NFFT, UNI_HAL_LED_S8, 1);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    printf("filter: %d blocks, %.1f us/block\n", loops, elapsed_ns(&t0, &t1) / 1e3 / loops);
+    fb_destroy(fb);
+}
+
+// 与 lr_sram 的位布局相反的读取
+static int view_pixel(led_render* lr, int x, int y)
+{
+    static const int bits[] = { 4, 5, 6, 7, 0, 1, 2, 3 };
+
+    return (lr->data[(x + y * lr->width) / 8] >> bits[x % 8]) & 1;
+}
+
+static int view_column(led_render* lr, int x)
+{
+    int y, n = 0;
+
+    for (y = 0; y < lr->height; y++)
+        n += view_pixel(lr, x, y);
+
+    return n;
+}
+
+static void test_view(int argc, char *argv[])
+{
+    static const band_layout layout = { 32, 60, 18000 };
+    unsigned char data[2][32];
+    led_render lr[2];
+    led_view lv[2];
+    ws_amp_t bands[32];
+    int levels[VIEW_COLS_MAX];
+    double step;
+    int i, b, c;
+
+    // 同一份共享频段, 两个设备各自映射
+    for (i = 0; i < 2; i++) {
+        memset(&lr[i], 0, sizeof(lr[i]));
+        lr[i].width = lr[i].height = 16;
+        lr[i].sz_data = 32;
+        lr[i].data = data[i];
+        lv_init(&lv[i], &layout, 16);
+    }
+    assert(lv_ctrl(&lv[1], "Bands 8") == 0);
+    assert(lv_ctrl(&lv[1], "Range 1000 16000") == 0);
+    assert(lv_ctrl(&lv[1], "Style Peak") == 0);
+    assert(lv_ctrl(&lv[1], "Bands 0") < 0 && lv[1].nr_cols == 8);
+    // 比屏宽多的柱画不下
+    assert(lv_ctrl(&lv[1], "Bands 17") < 0 && lv[1].nr_cols == 8);
+    assert(lv_ctrl(&lv[1], "Bands 16") == 0 && lv_ctrl(&lv[1], "Bands 8") == 0);
+    assert(lv_ctrl(&lv[1], "Style Foo") < 0);
+    assert(lv_ctrl(&lv[1], "Rate 30") == 0 && lv[1].fps == 30);
+    assert(lv_ctrl(&lv[1], "Rate 101") < 0 && lv[1].fps == 30);
+
+    // 每根柱覆盖的共享频段连续且不重叠
+    for (i = 0; i < 2; i++) {
+        for (c = 1; c < lv[i].nr_cols; c++)
+            assert(lv[i].lo[c] >= lv[i].lo[c - 1] + lv[i].nr[c - 1] - 1);
+    }
+
+    // 4KHz 单音, 幅度 96 -> 6 行
+    step = pow(18000 / 60.0, 1.0 / 32);
+    b = (int)(log(4000 / 60.0) / log(step));
+    memset(bands, 0, sizeof(bands));
+#ifdef FIXED_POINT
+    bands[b] = 96 << 8;
+#else
+    bands[b] = 96;
+#endif
+
+    for (i = 0; i < 2; i++) {
+        int hit = -1;
+
+        lv_levels(&lv[i], bands, levels);
+        for (c = 0; c < lv[i].nr_cols; c++) {
+            if (levels[c]) {
+                assert(hit < 0 && levels[c] == 6);
+                hit = c;
+            }
+        }
+        assert(hit >= 0 && b >= lv[i].lo[hit] && b < lv[i].lo[hit] + lv[i].nr[hit]);
+
+        lv_draw(&lv[i], &lr[i], levels);
+        c = hit * (16 / lv[i].nr_cols);
+        assert(view_column(&lr[i], c) == 6 && view_pixel(&lr[i], c, 15));
+        printf("view %d: %d bars, 4KHz -> bar %d\n", i, lv[i].nr_cols, hit);
+    }
+
+    // 声音停掉: 实时柱归零, Peak 风格的顶点按 decay 每帧掉一行
+    memset(bands, 0, sizeof(bands));
+    lv_levels(&lv[1], bands, levels);
+    lv_draw(&lv[1], &lr[1], levels);
+    for (c = 0; c < 16; c++) {
+        assert(view_column(&lr[1], c) <= 1);
+        if (view_column(&lr[1], c))
+            assert(view_pixel(&lr[1], c, 16 - 5));
+    }
+}
+
+// 逐点做的参考: 输入 (x, y) 顺时针转 degree 再水平镜像
+static void orient_ref(led_render* lr, unsigned char* ref)
+{
+    led_render o = *lr;
+    int w = lr->width - 1, h = lr->height - 1;
+    int x, y, ox, oy;
+
+    o.data = ref;
+    memset(ref, 0, lr->sz_data);
+    for (y = 0; y <= h; y++) {
+        for (x = 0; x <= w; x++) {
+            if (!view_pixel(lr, x, y))
+                continue;
+
+            switch (lr->degree) {
+            case 90:  ox = w - y; oy = x; break;
+            case 180: ox = w - x; oy = h - y; break;
+            case 270: ox = y; oy = h - x; break;
+            default:  ox = x; oy = y; break;
+            }
+            lr_sram(&o, lr->mirror ? w - ox : ox, oy, 1);
+        }
+    }
+}
+
+static void test_orient(int argc, char *argv[])
+{
+    static const int sizes[] = { 16, 8, 32 };
+    unsigned char data[128], out[128], ref[128];
+    led_render lr;
+    struct timespec t0, t1;
+    int loops = argc > 2 ? atoi(argv[2]) : 100000;
+    int n, d, m, i;
+
+    // 16x16 走整屏字运算, 其他大小走 8x8 分块, 都和逐点结果比较
+    for (n = 0; n < sizeof(sizes) / sizeof(sizes[0]); n++) {
+        memset(&lr, 0, sizeof(lr));
+        lr.width = lr.height = sizes[n];
+        lr.sz_data = sizes[n] * sizes[n] / 8;
+        lr.data = data;
+        lr.out = out;
+        for (i = 0; i < lr.sz_data; i++)
+            data[i] = rand();
+
+        for (d = 0; d < 360; d += 90) {
+            for (m = 0; m < 2; m++) {
+                assert(lr_orient(&lr, d, m) == 0);
+                orient_ref(&lr, ref);
+                assert(memcmp(lr_output(&lr), ref, lr.sz_data) == 0);
+            }
+        }
+    }
+
+    // 非方屏只能 180 和镜像
+    lr.width = 32;
+    lr.height = 8;
+    lr.sz_data = 32;
+    assert(lr_orient(&lr, 90, false) < 0);
+    assert(lr_orient(&lr, 180, true) == 0);
+    orient_ref(&lr, ref);
+    assert(memcmp(lr_output(&lr), ref, lr.sz_data) == 0);
+
+    lr.width = lr.height = 16;
+    lr_orient(&lr, 90, true);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < loops; i++) {
+        data[i & 31] ^= lr_output(&lr)[(i + 1) & 31];
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    printf("orient: 16x16 rotate+mirror %.1f ns/frame\n", elapsed_ns(&t0, &t1) / loops);
+
+    // 增量输出: 只写变化的字节, 地址按变换后的位置
+    {
+        unsigned char sent[32];
+        char line[64];
+        FILE* f = tmpfile();
+
+        assert(f);
+        memset(data, 0, 32);
+        memset(sent, 0, 32);
+        lr.sent = sent;
+        lr.f_pattern = f;
+        lr_orient(&lr, 0, false);
+
+        assert(lr_update(&lr) == 0);
+        lr_sram(&lr, 3, 15, 1);
+        lr_sram(&lr, 2, 15, 1);
+        assert(lr_update(&lr) == 1);
+        assert(lr_update(&lr) == 0);
+
+        lr_orient(&lr, 180, false);
+        assert(lr_update(&lr) == 2);
+
+        rewind(f);
+        assert(fgets(line, sizeof(line), f));
+        // (2,15) (3,15) 在第 30 字节 (地址 0x3c), 转 180 度后是 (12,0) (13,0), 在第 1 字节
+        assert(strcmp(line, "3cc002033c00") == 0);
+        fclose(f);
+    }
+}
+
+static void* slow_init(int width, int height, const char* args)
+{
+    static int spin;
+
+    spin = args ? atoi(args) : 0;
+    return &spin;
+}
+
+// 每帧忙等 spin 微秒, 再把第 frame 列点亮
+static int slow_render(void* ctx, struct led_frame* frame,
+                    const struct led_effect_input* in)
+{
+    struct timespec t0, t1;
+    int spin = *(int*)ctx;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    do {
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+    } while (elapsed_ns(&t0, &t1) < spin * 1000.0);
+
+    memset(frame->bits, 0, frame->stride * frame->height);
+    frame->bits[in->frame % frame->width / 8] |= 1 << (in->frame % 8);
+    return 1;
+}
+
+static const struct led_effect_ops slow_ops = {
+    .abi = LED_EFFECT_ABI,
+    .name = "slow",
+    .fps = 100,
+    .budget_us = 100,
+    .init = slow_init,
+    .render = slow_render,
+};
+
+static void test_effect(int argc, char *argv[])
+{
+    static const struct led_effect_ops bad_ops = { .abi = LED_EFFECT_ABI + 1, .name = "bad" };
+    struct led_effect_ops stop_ops = slow_ops;
+    effect_player ep;
+    unsigned char data[32];
+    led_render lr;
+    int64_t now;
+    int x, y, n;
+
+    memset(&ep, 0, sizeof(ep));
+    assert(uni_hal_led_effect_register(&bad_ops) < 0);
+    // 控制字不能当效果名
+    stop_ops.name = "Stop";
+    assert(uni_hal_led_effect_register(&stop_ops) < 0 && !ep_find("Stop"));
+    assert(uni_hal_led_effect_register(&slow_ops) == 0);
+    assert(ep_find("love") && ep_find("slow") && !ep_find("bad"));
+
+    // 内置的 love 只画一次, 载入显存后和原来 show_love 的位置一致
+    assert(ep_start(&ep, "love", 16, 16, NULL) == 0);
+    now = ep_now();
+    assert(ep_frame(&ep, now, NULL, 0) == 1);
+    assert(ep_frame(&ep, now + 1000000000LL, NULL, 0) == 0);
+    assert(ep_next(&ep, now, 500) == now + 500);
+
+    memset(&lr, 0, sizeof(lr));
+    lr.width = lr.height = 16;
+    lr.sz_data = 32;
+    lr.data = data;
+    lr_load(&lr, ep.fb.bits, ep.fb.stride);
+    for (y = 0, n = 0; y < 16; y++) {
+        for (x = 0; x < 16; x++)
+            n += view_pixel(&lr, x, y);
+    }
+    assert(view_pixel(&lr, 2, 2) && !view_pixel(&lr, 0, 2) && view_pixel(&lr, 7, 13));
+    assert(n == 106);
+
+    // 100fps 的效果, 预算之内按 10ms 一帧排
+    assert(ep_start(&ep, "slow", 16, 16, NULL) == 0);
+    assert(ep.period_ns == 10000000LL);
+    now = ep.next_ns;
+    assert(ep_frame(&ep, now, NULL, 0) == 1);
+    assert(ep_frame(&ep, now + 5000000LL, NULL, 0) == 0);
+    assert(ep_next(&ep, now, 1000000000LL) == now + 10000000LL);
+
+    // 实测 5ms 一帧, 远超预算: 帧周期拉到 4 倍耗时
+    assert(ep_start(&ep, "slow", 16, 16, "5000") == 0);
+    for (n = 0; n < 4; n++)
+        ep_frame(&ep, ep.next_ns, NULL, 0);
+    printf("effect: 5ms render -> period %.1f ms\n", ep.period_ns / 1e6);
+    assert(ep.period_ns >= 4 * 5000000LL);
+
+    ep_stop(&ep);
+    assert(!ep.ops && ep_frame(&ep, ep_now(), NULL, 0) == 0);
+}
+
+static int fill_render(void* ctx, struct led_frame* frame,
+                    const struct led_effect_input* in)
+{
+    memset(frame->bits, *(int*)ctx, frame->stride * frame->height);
+    return 1;
+}
+
+static void* fill_init(int width, int height, const char* args)
+{
+    static int on = 0xff, off = 0;
+
+    return args && strcmp(args, "off") == 0 ? &off : &on;
+}
+
+static const struct led_effect_ops fill_ops = {
+    .abi = LED_EFFECT_ABI,
+    .name = "fill",
+    .init = fill_init,
+    .render = fill_render,
+};
+
+static int frame_pixels(const uint32_t* out, int x0, int x1)
+{
+    const unsigned char* p = (const unsigned char*)out;
+    int x, y, n = 0;
+
+    for (y = 0; y < 16; y++) {
+        for (x = x0; x < x1; x++)
+            n += (p[y * 2 + x / 8] >> (x % 8)) & 1;
+    }
+
+    return n;
+}
+
+static void test_playlist(int argc, char *argv[])
+{
+    static const char* trans[] = { "Wipe", "Dissolve", "Slide" };
+    playlist* pl = malloc(sizeof(*pl));
+    int64_t t0 = 1000000000LL, ms = 1000000LL;
+    char spec[64], args[PL_ARGS_SIZE + 1], line[PL_ARGS_SIZE + 32];
+    pl_entry e;
+    int i, k, n, last;
+
+    assert(pl);
+    assert(uni_hal_led_effect_register(&fill_ops) == 0);
+
+    pl_init(pl, 16, 16);
+    assert(pl_add(pl, "nothing 1") < 0 && pl_add(pl, "fill 0") < 0);
+    assert(pl_add(pl, "fill 1 Wipe -100") < 0);
+
+    // 不是转场名的 "<词> <数>" 留作参数
+    assert(pl_parse("image 30 /tmp/a.pgm 10", &e) == 0 && e.transition == PL_CUT
+           && e.duration_ms == 30000 && strcmp(e.args, "/tmp/a.pgm 10") == 0);
+    assert(pl_parse("fill 1 Fade 100", &e) == 0 && strcmp(e.args, "Fade 100") == 0);
+    assert(pl_parse("fill 1 Slide 500 off", &e) == 0 && e.transition == PL_SLIDE
+           && e.transition_ms == 500 && strcmp(e.args, "off") == 0);
+
+    // 参数整段保留 (图片路径可以很长), 放不下的拒绝而不是截断
+    memset(args, 'a', sizeof(args));
+    args[IM_PATH_SIZE] = 0;
+    snprintf(line, sizeof(line), "fill 1 Wipe 100 /tmp/%s 20 Floyd", args);
+    assert(pl_parse(line, &e) == 0 && strcmp(e.args + 5 + IM_PATH_SIZE, " 20 Floyd") == 0);
+    args[IM_PATH_SIZE] = 'a';
+    args[PL_ARGS_SIZE] = 0;
+    snprintf(line, sizeof(line), "fill 1 %s", args);
+    assert(pl_parse(line, &e) < 0);
+
+    for (i = 0; i < 3; i++) {
+        pl_clear(pl);
+        assert(pl_add(pl, "fill 1") == 0);
+        snprintf(spec, sizeof(spec), "fill 1 %s 800 off", trans[i]);
+        assert(pl_add(pl, spec) == 0 && pl->entries[1].transition_ms == 800);
+        assert(pl_start(pl, t0) == 0);
+
+        assert(pl_frame(pl, t0, NULL, 0) == 1);
+        assert(frame_pixels(pl->out, 0, 16) == 256);
+        assert(pl_next(pl, t0, 1000 * ms) == t0 + 200 * ms);
+
+        // 过渡期间亮点数单调减少, 到一半时大约剩一半
+        last = 256;
+        for (k = 200; k < 1000; k += 10) {
+            pl_frame(pl, t0 + k * ms, NULL, 0);
+            n = frame_pixels(pl->out, 0, 16);
+            assert(n <= last);
+            last = n;
+            if (k == 590) {
+                assert(n == 128);
+                // 擦除从左边盖过来, 推入是旧场景往左移出去
+                if (i == 0)
+                    assert(frame_pixels(pl->out, 8, 16) == 128);
+                if (i == 2)
+                    assert(frame_pixels(pl->out, 0, 8) == 128);
+            }
+        }
+
+        pl_frame(pl, t0 + 1000 * ms, NULL, 0);
+        assert(pl->cur == 1 && !pl->trans_ns && frame_pixels(pl->out, 0, 16) == 0);
+
+        // 第一项没有过渡, 当前项从过渡开始算满 1 秒后直接切
+        assert(pl_next(pl, t0 + 1000 * ms, 5000 * ms) == t0 + 1200 * ms);
+        pl_frame(pl, t0 + 1200 * ms, NULL, 0);
+        pl_frame(pl, t0 + 1201 * ms, NULL, 0);
+        assert(pl->cur == 0 && frame_pixels(pl->out, 0, 16) == 256);
+        printf("playlist: %s ok\n", trans[i]);
+    }
+
+    pl_stop(pl);
+    free(pl);
+}
+
+// 需要 -DLED_TRACE 编译, 测每个事件的开销并导出到 argv[3]
+static void test_trace(int argc, char *argv[])
+{
+#ifdef LED_TRACE
+    struct timespec t0, t1;
+    int loops = argc > 2 ? atoi(argv[2]) : 1000000;
+    const char* path = argc > 3 ? argv[3] : "trace.json";
+    char name[] = "find";
+    int64_t from, to;
+    double ns;
+    int i, n;
+
+    // 第一次打点分配本线程的缓冲, 不计入
+    TRACE_MARK("start");
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < loops; i++) {
+        TRACE_BEGIN("span");
+        TRACE_END("span");
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    ns = elapsed_ns(&t0, &t1) / loops / 2;
+
+    n = tr_dump(path);
+    printf("trace: %.1f ns/event, %d events -> %s\n", ns, n, path);
+    assert(n == (loops * 2 + 1 < TRACE_EVENTS ? loops * 2 + 1 : TRACE_EVENTS));
+
+    // 按名字和时间段找事件, 名字比内容不比指针
+    TRACE_MARK("find");
+    TRACE_MARK("find");
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    from = tr_find(name, 'i', 0, UINT64_MAX, 0);
+    to = tr_find("find", 'i', 0, UINT64_MAX, 1);
+    assert(from > 0 && to > from && to <= t0.tv_sec * 1000000000ULL + t0.tv_nsec);
+    assert(tr_find("find", 'i', from + 1, UINT64_MAX, 0) == to);
+    assert(tr_find("find", 'i', 0, from - 1, 0) == 0 && tr_find("find", 'B', 0, UINT64_MAX, 0) == 0);
+#else
+    printf("trace: built without LED_TRACE\n");
+    assert(tr_find("publish", 'i', 0, UINT64_MAX, 0) < 0);
+#endif
+}
+
+static int sink_writes;
+
+static void count_writes(const led_render* lr, const unsigned char* frame, int nr_bytes)
+{
+    sink_writes++;
+}
+
+// 虚拟时钟下跑整个服务, 写出的帧数是确定的, 跑 hours 小时的播放列表只要几秒
+static void test_clock(int argc, char *argv[])
+{
+    const int64_t sec = 1000000000LL;
+    int hours = argc > 2 ? atoi(argv[2]) : 1;
+    struct timespec t0, t1;
+    int n;
+
+    // 2026-01-01 00:00:00 UTC
+    setenv("TZ", "UTC", 1);
+    tzset();
+    lc_virtual(1767225600LL * sec);
+    assert(lc_time() == 1767225600);
+
+    lr_set_sink(count_writes);
+    assert(uni_hal_led_register(LR_NULL_NODE) == 0);
+    lc_advance(0);
+
+    // 空闲时 2Hz 整帧刷新
+    n = sink_writes;
+    assert(lc_advance(10 * sec) == LC_VIRTUAL_BASE + 10 * sec);
+    printf("clock: idle 10s -> %d writes\n", sink_writes - n);
+    assert(sink_writes - n == 20);
+
+    // 'Wave Rate' 按固定节拍
+    uni_hal_led_ctrl(LR_NULL_NODE, "Wave Rate 25");
+    lc_advance(sec);
+    n = sink_writes;
+    lc_advance(10 * sec);
+    printf("clock: 25 fps 10s -> %d writes\n", sink_writes - n);
+    assert(sink_writes - n == 250);
+
+    // 时钟每个整秒走一次, 但只有秒条多亮一个点 (每 3.75 秒) 和分钟变化时才有字节要写
+    uni_hal_led_ctrl(LR_NULL_NODE, "Show Time");
+    lc_advance(sec);
+    n = sink_writes;
+    lc_advance(60 * sec);
+    printf("clock: show time 60s -> %d writes\n", sink_writes - n);
+    assert(sink_writes - n == 16);
+    assert(lc_time() == 1767225600 + 10 + 1 + 10 + 1 + 60);
+
+    // clock 效果用同一个表盘, 也按整秒增量画, 写的次数和时钟场景一样
+    uni_hal_led_ctrl(LR_NULL_NODE, "Effect clock");
+    lc_advance(sec);
+    n = sink_writes;
+    lc_advance(60 * sec);
+    printf("clock: clock effect 60s -> %d writes\n", sink_writes - n);
+    assert(sink_writes - n == 16);
+    uni_hal_led_ctrl(LR_NULL_NODE, "Effect Stop");
+
+    uni_hal_led_ctrl(LR_NULL_NODE, "Playlist Add bars 60 Wipe 800");
+    uni_hal_led_ctrl(LR_NULL_NODE, "Playlist Add clock 60 Dissolve 500");
+    uni_hal_led_ctrl(LR_NULL_NODE, "Playlist Start");
+    n = sink_writes;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    lc_advance(hours * 3600 * sec);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    printf("clock: playlist %d h -> %d writes in %.2f s\n", hours,
+            sink_writes - n, elapsed_ns(&t0, &t1) / 1e9);
+
+    // 注销会等旧线程退出, 马上重新注册的设备只有新线程在写
+    uni_hal_led_unregister(LR_NULL_NODE);
+    assert(uni_hal_led_register(LR_NULL_NODE) == 0);
+    uni_hal_led_ctrl(LR_NULL_NODE, "Wave Rate 25");
+    lc_advance(sec);
+    n = sink_writes;
+    lc_advance(10 * sec);
+    assert(sink_writes - n == 250);
+
+    uni_hal_led_unregister(LR_NULL_NODE);
+    lc_advance(sec);
+    lr_set_sink(NULL);
+}
+
+static void daemon_signal(int sig)
+{
+    uni_hal_led_daemon_stop();
+}
+
+// 子进程当守护进程, 等它的共享区出来
+static pid_t daemon_fork(const char* names[], ld_shared** ld)
+{
+    pid_t pid;
+    int i;
+
+    pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        signal(SIGTERM, daemon_signal);
+        exit(uni_hal_led_daemon(names, 1) < 0 ? 1 : 0);
+    }
+
+    for (i = 0, *ld = NULL; i < 200 && !(*ld = ld_attach(0)); i++)
+        usleep(10000);
+    assert(*ld);
+
+    return pid;
+}
+
+// 守护进程按顺序执行, 再写一条命令等它被取走, 之前的就都执行完了
+static void daemon_sync(ld_shared* ld)
+{
+    int i;
+
+    assert(uni_hal_led_ctrl(LR_NULL_NODE, "Wave Decay 1") == 0);
+    for (i = 0; i < 200 && ld->tail != ld->head; i++)
+        usleep(10000);
+    assert(ld->tail == ld->head);
+}
+
+// 每次喂 128 个样本喂 16 次, 返回发布了几次快照
+static int daemon_publishes(volatile unsigned int* seq, const short* pcm)
+{
+    unsigned int seq0 = *seq;
+    int i;
+
+    for (i = 0; i < 16; i++)
+        uni_hal_led_feed_pcm(pcm + i % 8 * 128, 128, UNI_HAL_LED_S16, 1);
+
+    return (*seq - seq0) / 2;
+}
+
+// 子进程当守护进程, 本进程当客户端: 命令只是写一格共享环
+static void test_daemon(int argc, char *argv[])
+{
+    const char* names[] = { LR_NULL_NODE };
+    int loops = argc > 2 ? atoi(argv[2]) : 10000;
+    volatile unsigned int* seq;
+    struct timespec t0, t1;
+    short pcm[1024];
+    unsigned int seq0;
+    ld_shared* ld = NULL;
+    struct stat st;
+    int i, full = 0, status;
+    pid_t pid;
+
+    // 守护进程就绪前第一次调用接口会定成本地模式, 先等共享区出来
+    pid = daemon_fork(names, &ld);
+    // 只有同一用户能写命令环
+    assert(stat("/dev/shm" LD_SHM_NAME, &st) == 0 && (st.st_mode & 0777) == LD_SHM_MODE);
+
+    assert(uni_hal_led_register("nothing") < 0);
+    assert(uni_hal_led_register(LR_NULL_NODE) == 0);
+    assert(uni_hal_led_ctrl("nothing", "Fully On") < 0);
+
+    // 环空的时候单条命令的开销
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < LD_CMD_SLOTS / 2; i++)
+        assert(uni_hal_led_ctrl(LR_NULL_NODE, "Wave Decay 1") == 0);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    printf("daemon: %.0f ns/cmd into an empty ring\n", elapsed_ns(&t0, &t1) / (LD_CMD_SLOTS / 2));
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < loops; i++) {
+        // 环满说明守护进程跟不上, 让一下再写
+        while (uni_hal_led_ctrl(LR_NULL_NODE, "Wave Decay 1") == -4) {
+            full++;
+            sched_yield();
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    printf("daemon: %d cmds, %.0f ns/cmd, ring full %d times\n", loops,
+            elapsed_ns(&t0, &t1) / loops, full);
+
+    // 本进程分析, 结果写进共享区里的快照, 快照以 seqlock 的序号开头
+    seq = (volatile unsigned int*)ld_extra(ld);
+    seq0 = *seq;
+    for (i = 0; i < 1024; i++)
+        pcm[i] = 10000 * sin(2 * M_PI * 1000 * i / 44100);
+    for (i = 0; i < 8; i++)
+        uni_hal_led_feed_pcm(pcm, 1024, UNI_HAL_LED_S16, 1);
+    assert(*seq != seq0 && !(*seq & 1));
+
+    // 'Spectrum ...' 由守护进程执行, 分析参数在共享区里, 本进程的分析跟着换:
+    // Goertzel 每 256 个样本出一次, 滤波器组每 64 个, 1024 点的 FFT 半帧重叠, 每 512 个
+    assert(uni_hal_led_ctrl(LR_NULL_NODE, "Spectrum Goertzel") == 0);
+    daemon_sync(ld);
+    assert(daemon_publishes(seq, pcm) == 8);
+    assert(uni_hal_led_ctrl(LR_NULL_NODE, "Spectrum Filter") == 0);
+    daemon_sync(ld);
+    assert(daemon_publishes(seq, pcm) == 16);
+    assert(uni_hal_led_ctrl(LR_NULL_NODE, "Spectrum FFT") == 0);
+    assert(uni_hal_led_ctrl(LR_NULL_NODE, "Spectrum Size 1024") == 0);
+    daemon_sync(ld);
+    // FFT 重建后要先攒满一帧
+    daemon_publishes(seq, pcm);
+    assert(daemon_publishes(seq, pcm) == 4);
+
+    kill(pid, SIGTERM);
+    assert(waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    ld_detach(ld);
+    assert(!ld_attach(0));
+
+    // 守护进程不在时命令报错, 不再写进没人读的旧环; 重启后客户端接到新的共享区上
+    assert(uni_hal_led_ctrl(LR_NULL_NODE, "Wave Decay 1") < 0);
+    pid = daemon_fork(names, &ld);
+    assert(uni_hal_led_register(LR_NULL_NODE) == 0);
+    seq0 = ld->tail;
+    assert(uni_hal_led_ctrl(LR_NULL_NODE, "Wave Decay 1") == 0);
+    daemon_sync(ld);
+    assert(ld->tail - seq0 == 2);
+
+    kill(pid, SIGTERM);
+    assert(waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    ld_detach(ld);
+    printf("daemon: ok\n");
+}
+
+#define STREAM_SOCK "/tmp/led_test.sock"
+#define STREAM_FIFO "/tmp/led_test.fifo"
+#define STREAM_SHM  "/led_test"
+#define STREAM_SLOTS 4
+
+static volatile int stream_lit = -1;
+
+static void stream_sink(const led_render* lr, const unsigned char* frame, int nr_bytes)
+{
+    int i, lit = 0;
+
+    for (i = 0; i < lr->sz_data; i++)
+        lit += __builtin_popcount(frame[i]);
+    stream_lit = lit;
+    sink_writes++;
+}
+
+// 16x16 单色帧, 前 lit 个灯亮, 亮点数就是帧的编号
+static int stream_frame(unsigned char* buf, int lit, int width)
+{
+    struct led_stream_header* h = (struct led_stream_header*)buf;
+    unsigned char* bits = buf + sizeof(*h);
+    int i;
+
+    h->magic = LED_STREAM_MAGIC;
+    h->width = width;
+    h->height = 16;
+    h->format = LED_STREAM_MONO;
+    h->stride = 2;
+    h->seq = lit;
+    memset(bits, 0, 32);
+    for (i = 0; i < lit; i++)
+        bits[i / 8] |= 1 << (i % 8);
+
+    return sizeof(*h) + 32;
+}
+
+static bool stream_wait(int lit)
+{
+    int i;
+
+    for (i = 0; i < 200 && stream_lit != lit; i++)
+        usleep(5000);
+
+    return stream_lit == lit;
+}
+
+// 三种传输各送几帧, 坏帧不上屏, 生产者太快时丢旧帧但最后一帧一定显示
+static void test_stream(int argc, char *argv[])
+{
+    int loops = argc > 2 ? atoi(argv[2]) : 200;
+    unsigned char buf[sizeof(struct led_stream_header) + 256];
+    struct led_stream_header* h = (struct led_stream_header*)buf;
+    struct led_stream_shm* shm;
+    struct sockaddr_un addr;
+    struct stat st;
+    size_t size;
+    int fd, n, i;
+
+    lr_set_sink(stream_sink);
+    assert(uni_hal_led_register(LR_NULL_NODE) == 0);
+    assert(uni_hal_led_ctrl(LR_NULL_NODE, "Stream Tcp 1234") < 0);
+    assert(uni_hal_led_ctrl(LR_NULL_NODE, "Stream Shm no_slash") < 0);
+
+    // 套接字: 一个数据报一帧
+    assert(uni_hal_led_ctrl(LR_NULL_NODE, "Stream Socket " STREAM_SOCK) == 0);
+    fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, STREAM_SOCK);
+    n = stream_frame(buf, 10, 16);
+    assert(sendto(fd, buf, n, 0, (struct sockaddr*)&addr, sizeof(addr)) == n);
+    assert(stream_wait(10));
+
+    // 尺寸不对, 截断, 负载过长都丢掉
+    n = stream_frame(buf, 11, 8);
+    sendto(fd, buf, n, 0, (struct sockaddr*)&addr, sizeof(addr));
+    n = stream_frame(buf, 12, 16);
+    sendto(fd, buf, n - 1, 0, (struct sockaddr*)&addr, sizeof(addr));
+    sendto(fd, buf, n + 1, 0, (struct sockaddr*)&addr, sizeof(addr));
+    // 灰度 128 起算亮
+    h->format = LED_STREAM_GRAY;
+    h->stride = 16;
+    memset(buf + sizeof(*h), 0, 256);
+    memset(buf + sizeof(*h), 128, 30);
+    buf[sizeof(*h) + 30] = 127;
+    n = sizeof(*h) + 256;
+    assert(sendto(fd, buf, n, 0, (struct sockaddr*)&addr, sizeof(addr)) == n);
+    assert(stream_wait(30));
+    close(fd);
+
+    // 管道: 先送一段垃圾, 要能重新对上 magic; 已有的宽权限管道会收窄到只给自己
+    unlink(STREAM_FIFO);
+    assert(mkfifo(STREAM_FIFO, 0666) == 0);
+    assert(uni_hal_led_ctrl(LR_NULL_NODE, "Stream Pipe " STREAM_FIFO) == 0);
+    assert(stat(STREAM_FIFO, &st) == 0 && (st.st_mode & 0777) == FI_FIFO_MODE);
+    assert(access(STREAM_SOCK, F_OK) < 0);
+    fd = open(STREAM_FIFO, O_WRONLY);
+    assert(fd >= 0);
+    assert(write(fd, "LFM\x00\x01", 5) == 5);
+    n = stream_frame(buf, 40, 16);
+    assert(write(fd, buf, n) == n);
+    assert(stream_wait(40));
+    close(fd);
+
+    // 共享内存: 生产者一口气写 loops 帧, 设备线程跟不上的丢掉
+    size = sizeof(*shm) + STREAM_SLOTS * sizeof(buf);
+    fd = shm_open(STREAM_SHM, O_RDWR | O_CREAT, 0666);
+    assert(fd >= 0 && ftruncate(fd, size) == 0);
+    shm = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    assert(shm != MAP_FAILED);
+    shm->magic = LED_STREAM_MAGIC;
+    shm->slots = STREAM_SLOTS;
+    shm->slot_size = sizeof(buf);
+    shm->head = 0;
+    assert(uni_hal_led_ctrl(LR_NULL_NODE, "Stream Shm " STREAM_SHM) == 0);
+
+    n = sink_writes;
+    for (i = 1; i <= loops; i++) {
+        stream_frame((unsigned char*)(shm + 1) + (shm->head % STREAM_SLOTS) * sizeof(buf),
+                1 + i % 255, 16);
+        __sync_synchronize();
+        shm->head++;
+    }
+    assert(stream_wait(1 + loops % 255));
+    printf("stream: shm %d frames -> %d shown\n", loops, sink_writes - n);
+
+    // 打开后生产者改了布局也只按打开时的读, 不会越界
+    shm->slots = 1 << 20;
+    shm->slot_size = 1 << 20;
+    stream_frame((unsigned char*)(shm + 1) + (shm->head % STREAM_SLOTS) * sizeof(buf), 7, 16);
+    __sync_synchronize();
+    shm->head++;
+    assert(stream_wait(7));
+
+    // 切到别的场景就停
+    assert(uni_hal_led_ctrl(LR_NULL_NODE, "Fully Off") == 0);
+    n = sink_writes;
+    stream_frame((unsigned char*)(shm + 1) + (shm->head % STREAM_SLOTS) * sizeof(buf), 5, 16);
+    shm->head++;
+    usleep(50000);
+    assert(stream_lit == 0);
+
+    uni_hal_led_unregister(LR_NULL_NODE);
+    munmap(shm, size);
+    shm_unlink(STREAM_SHM);
+    unlink(STREAM_FIFO);
+    lr_set_sink(NULL);
+    printf("stream: ok\n");
+}
+
+#define IMAGE_CLIP  "/tmp/led_test.pgm"
+#define IMAGE_W     320
+#define IMAGE_H     240
+
+static int image_lit(const unsigned char* bits, int bytes)
+{
+    int i, lit = 0;
+
+    for (i = 0; i < bytes; i++)
+        lit += __builtin_popcount(bits[i]);
+
+    return lit;
+}
+
+static im_clip* image_file(const char* path, const char* data)
+{
+    FILE* f = fopen(path, "wb");
+
+    assert(f);
+    fwrite(data, strlen(data), 1, f);
+    fclose(f);
+
+    return im_open(path, 16, 16, IM_THRESHOLD, 128, false);
+}
+
+// 缩放/抖动的正确性, 各种 netpbm 格式, 320x240 序列首次转换和重放的耗时
+static void test_image(int argc, char *argv[])
+{
+    int frames = argc > 2 ? atoi(argv[2]) : 60;
+    static unsigned char src[IMAGE_W * IMAGE_H];
+    static uint32_t acc[IMAGE_W], ref[IMAGE_W];
+    unsigned char small[16 * 16], bits[32];
+    struct timespec t0, t1;
+    double t_first, t_replay;
+    im_clip *clip, *cached;
+    FILE* f;
+    int i, x, y, n, lit;
+
+    // 向量化累加和标量逐项一致, 包括不满 16 的尾巴
+    for (i = 0; i < IMAGE_W; i++)
+        src[i] = rand();
+    for (n = 1; n <= IMAGE_W; n += 37) {
+        for (i = 1; i <= IM_TARGET_MAX; i += 7) {
+            memset(acc, 0, sizeof(acc));
+            memset(ref, 0, sizeof(ref));
+            im_accumulate(src, n, i, acc);
+            im_accumulate(src + 3, n, i, acc);
+            im_accumulate_ref(src, n, i, ref);
+            im_accumulate_ref(src + 3, n, i, ref);
+            assert(memcmp(acc, ref, sizeof(acc)) == 0);
+        }
+    }
+
+    // 均匀灰度缩放后不变, 整数倍和非整数倍都是
+    memset(src, 100, sizeof(src));
+    im_downscale(src, IMAGE_W, IMAGE_H, IMAGE_W, small, 16, 16, acc);
+    for (i = 0; i < 256; i++)
+        assert(small[i] == 100);
+    im_downscale(src, 100, 75, IMAGE_W, small, 16, 16, acc);
+    for (i = 0; i < 256; i++)
+        assert(small[i] == 100);
+
+    // 左黑右白
+    for (y = 0; y < IMAGE_H; y++)
+        for (x = 0; x < IMAGE_W; x++)
+            src[y * IMAGE_W + x] = x < IMAGE_W / 2 ? 0 : 255;
+    im_downscale(src, IMAGE_W, IMAGE_H, IMAGE_W, small, 16, 16, acc);
+    for (i = 0; i < 256; i++)
+        assert(small[i] == (i % 16 < 8 ? 0 : 255));
+    // 非整数倍时边上的源像素按交叠比例分给两个输出: 3 -> 2
+    src[0] = 0;
+    src[1] = 100;
+    src[2] = 255;
+    im_downscale(src, 3, 1, 3, small, 2, 1, acc);
+    assert(small[0] == 33 && small[1] == 203);
+
+    // 抖动: Bayer 4x4 下 64 正好亮 1/4, 误差扩散的平均亮度接近灰度
+    memset(small, 64, sizeof(small));
+    im_dither(small, 16, 16, IM_ORDERED, 0, bits, 2);
+    assert(image_lit(bits, 32) == 64);
+    im_dither(small, 16, 16, IM_THRESHOLD, 64, bits, 2);
+    assert(image_lit(bits, 32) == 256);
+    im_dither(small, 16, 16, IM_THRESHOLD, 65, bits, 2);
+    assert(image_lit(bits, 32) == 0);
+    memset(small, 128, sizeof(small));
+    im_dither(small, 16, 16, IM_FLOYD, 0, bits, 2);
+    lit = image_lit(bits, 32);
+    assert(lit >= 120 && lit <= 136);
+    printf("image: floyd 128 -> %d/256 lit\n", lit);
+
+    // 纯文本 PBM (1 为黑) 带注释, 数字之间可以没有空白
+    clip = image_file("/tmp/led_test.pbm", "P1\n# test\n2 2\n10\n0 1\n");
+    assert(clip && clip->nr_frames == 1);
+    assert(im_frame(clip, 0, bits, 2) == 0);
+    // 16x16 里右上和左下两个 8x8 亮
+    assert(image_lit(bits, 32) == 128 && bits[0] == 0 && bits[1] == 0xff);
+    im_close(clip);
+
+    clip = image_file("/tmp/led_test.pgm", "P2 2 1 15 15 0\n");
+    assert(clip && im_frame(clip, 0, bits, 2) == 0);
+    assert(bits[0] == 0xff && bits[1] == 0);
+    im_close(clip);
+    assert(!image_file("/tmp/led_test.pgm", "P3 1 1 255\n"));
+    assert(!image_file("/tmp/led_test.pgm", "P5 1 1 255\n"));
+
+    // 一帧一个文件: 只认一个 %d / %0Nd, %% 是字面的 %, 路径不当格式串用
+    f = fopen("/tmp/led_test_%_01.pgm", "w");
+    assert(f && fputs("P2 1 1 15 15\n", f) >= 0 && fclose(f) == 0);
+    f = fopen("/tmp/led_test_%_02.pgm", "w");
+    assert(f && fputs("P2 1 1 15 0\n", f) >= 0 && fclose(f) == 0);
+    clip = im_open("/tmp/led_test_%%_%02d.pgm", 16, 16, IM_THRESHOLD, 128, false);
+    assert(clip && clip->first == 1 && clip->nr_frames == 2);
+    assert(im_frame(clip, 1, bits, 2) == 0 && image_lit(bits, 32) == 0);
+    im_close(clip);
+    assert(!im_open("/tmp/led_test_a%s%s%s%s%s%s%s%s", 16, 16, IM_THRESHOLD, 128, false));
+    assert(!im_open("/tmp/led_test_%d_%d.pgm", 16, 16, IM_THRESHOLD, 128, false));
+    assert(!im_open("/tmp/led_test_%5d.pgm", 16, 16, IM_THRESHOLD, 128, false));
+    assert(!im_open("/tmp/led_test_%00d.pgm", 16, 16, IM_THRESHOLD, 128, false));
+    assert(!im_open("/tmp/led_test_%%.pgm", 16, 16, IM_THRESHOLD, 128, false));
+    assert(!im_open("/tmp/led_test_%", 16, 16, IM_THRESHOLD, 128, false));
+    unlink("/tmp/led_test_%_01.pgm");
+    unlink("/tmp/led_test_%_02.pgm");
+
+    // 一个文件里连着 frames 幅 raw PGM, 一条亮竖线从左扫到右
+    f = fopen(IMAGE_CLIP, "wb");
+    assert(f);
+    for (i = 0; i < frames; i++) {
+        fprintf(f, "P5\n%d %d\n255\n", IMAGE_W, IMAGE_H);
+        for (y = 0; y < IMAGE_H; y++)
+            for (x = 0; x < IMAGE_W; x++)
+                src[y * IMAGE_W + x] = x / 20 == i % 16 ? 255 : 0;
+        fwrite(src, sizeof(src), 1, f);
+    }
+    fclose(f);
+
+    clip = im_open(IMAGE_CLIP, 16, 16, IM_FLOYD, 128, false);
+    assert(clip && clip->nr_frames == frames);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < frames; i++) {
+        assert(im_frame(clip, i, bits, 2) == 0);
+        assert(image_lit(bits, 32) == 16 && (bits[(i % 16) / 8] & 1 << (i % 8)));
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    t_first = elapsed_ns(&t0, &t1) / frames;
+    im_close(clip);
+
+    // 同一个片段再打开直接用缓存, 换了参数要重新转
+    cached = clip;
+    assert(im_open(IMAGE_CLIP, 16, 16, IM_FLOYD, 128, false) == clip);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < frames; i++)
+        im_frame(clip, i, bits, 2);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    t_replay = elapsed_ns(&t0, &t1) / frames;
+    im_close(clip);
+    printf("image: %dx%d -> 16x16, %.1f us/frame first, %.2f us/frame replay\n",
+            IMAGE_W, IMAGE_H, t_first / 1e3, t_replay / 1e3);
+
+    clip = im_open(IMAGE_CLIP, 16, 16, IM_ORDERED, 128, false);
+    assert(clip && clip != cached);
+    im_close(clip);
+
+    // 作为效果放
+    lr_set_sink(count_writes);
+    assert(uni_hal_led_register(LR_NULL_NODE) == 0);
+    n = sink_writes;
+    assert(uni_hal_led_ctrl(LR_NULL_NODE, "Effect image " IMAGE_CLIP " 20 Ordered") == 0);
+    usleep(500000);
+    printf("image: effect 0.5s @ 20 fps -> %d writes\n", sink_writes - n);
+    assert(sink_writes - n >= 5);
+    uni_hal_led_unregister(LR_NULL_NODE);
+    lr_set_sink(NULL);
+
+    unlink(IMAGE_CLIP);
+    unlink("/tmp/led_test.pbm");
+    printf("image: ok\n");
+}
+
+static volatile bool rt_stop;
+
+static void* rt_load(void* arg)
+{
+    volatile unsigned int spin = 0;
+
+    while (!rt_stop)
+        spin++;
+
+    return NULL;
+}
+
+// 本线程按 1ms 节拍绝对定时睡眠, 统计醒来晚了多少
+static void rt_measure(const char* name, const char* spec, int loops)
+{
+    struct timespec ts;
+    rt_profile rt;
+    rt_stats st;
+    int64_t next, now;
+    int i;
+
+    assert(rt_parse(spec, &rt) == 0);
+    if (rt_apply(pthread_self(), &rt) < 0) {
+        printf("realtime: %s skipped\n", name);
+        return;
+    }
+
+    memset(&st, 0, sizeof(st));
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    next = ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    for (i = 0; i < loops; i++) {
+        next += 1000000;
+        ts.tv_sec = next / 1000000000LL;
+        ts.tv_nsec = next % 1000000000LL;
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        now = ts.tv_sec * 1000000000LL + ts.tv_nsec;
+        rt_record(&st, now - next);
+    }
+    rt_print(name, &st);
+}
+
+// 配置解析, 满载时 SCHED_OTHER 和 SCHED_FIFO 的唤醒抖动, 以及服务里的统计命令
+static void test_realtime(int argc, char *argv[])
+{
+    int loops = argc > 2 ? atoi(argv[2]) : 2000;
+    int nr = argc > 3 ? atoi(argv[3]) : 2 * sysconf(_SC_NPROCESSORS_ONLN);
+    pthread_t* loads;
+    rt_profile rt;
+    rt_stats st;
+    int i, n;
+
+    assert(rt_parse("Fifo 50 Cpu 0-1 Lock", &rt) == 0);
+    assert(rt.policy == SCHED_FIFO && rt.priority == 50 && rt.cpus == 3 && rt.lock);
+    assert(rt_parse("Cpu 0,2 Fifo", &rt) == 0);
+    assert(rt.policy == SCHED_FIFO && rt.priority == 1 && rt.cpus == 5 && !rt.lock);
+    assert(rt_parse("", &rt) == 0 && rt.policy == SCHED_OTHER && !rt.cpus);
+    assert(rt_parse("Fifo 100", &rt) < 0);
+    assert(rt_parse("Cpu", &rt) < 0 && rt_parse("Cpu 2-1", &rt) < 0);
+    assert(rt_parse("Idle", &rt) < 0);
+
+    // 桶的上界: 3us 落在 [2, 4), p50 取到 4us, 但不超过最大值
+    memset(&st, 0, sizeof(st));
+    rt_record(&st, 500);
+    rt_record(&st, 3000);
+    rt_record(&st, 3500);
+    assert(st.buckets[0] == 1 && st.buckets[2] == 2);
+    assert(rt_percentile(&st, 0.5) == 3500 && rt_percentile(&st, 0.1) == 1000);
+
+    // 两处共用一页: 一处放开后这页仍然锁着
+    n = rt_locked_pages();
+    assert(rt_lock(&rt, sizeof(rt)) == 0 && rt_lock(&st, sizeof(st)) == 0);
+    assert(rt_locked_pages() > n);
+    rt_unlock(&rt, sizeof(rt));
+    assert(rt_locked_pages() > n);
+    rt_unlock(&st, sizeof(st));
+    assert(rt_locked_pages() == n);
+
+    loads = calloc(nr, sizeof(*loads));
+    assert(loads);
+    for (i = 0; i < nr; i++)
+        pthread_create(&loads[i], NULL, rt_load, NULL);
+
+    printf("realtime: %d wakeups at 1 kHz under %d spinning threads\n", loops, nr);
+    rt_measure("other", "Other", loops);
+    rt_measure("fifo 50", "Fifo 50", loops);
+    rt_measure("fifo 50 cpu 0", "Fifo 50 Cpu 0", loops);
+    rt_parse("Other", &rt);
+    rt_apply(pthread_self(), &rt);
+
+    // 服务里的设备线程
+    assert(uni_hal_led_register(LR_NULL_NODE) == 0);
+    assert(uni_hal_led_ctrl(LR_NULL_NODE, "Wave Rate 100") == 0);
+    assert(uni_hal_led_ctrl(LR_NULL_NODE, "Realtime Stats") == 0);
+    assert(uni_hal_led_ctrl(LR_NULL_NODE, "Realtime Fifo 0") < 0);
+    assert(uni_hal_led_ctrl(LR_NULL_NODE, "Realtime Fifo 50 Lock") == 0);
+    usleep(loops * 1000);
+    assert(uni_hal_led_ctrl(LR_NULL_NODE, "Realtime Stats") == 0);
+    uni_hal_led_unregister(LR_NULL_NODE);
+
+    rt_stop = true;
+    for (i = 0; i < nr; i++)
+        pthread_join(loads[i], NULL);
+    free(loads);
+    printf("realtime: ok\n");
+}
+
+// hbs1632 驱动的局部刷新: 只发和影子不同的段, 相隔不远的段合并
+static void test_hbs1632(int argc, char *argv[])
+{
+    u8 shadow[32] = { 0 }, mem[32] = { 0 }, buf[HBS1632_RAM_SIZE + 1];
+    struct hbs1632_span spans[HBS1632_SPANS_MAX];
+    int i, n;
+
+    assert(hbs1632_diff(shadow, mem, 32, spans, HBS1632_SPANS_MAX) == 0);
+
+    // 一列 16 个点是相邻两个字节, 连地址一共 4 字节, 整帧要 34
+    mem[6] = 0xff;
+    mem[7] = 0x01;
+    n = hbs1632_diff(shadow, mem, 32, spans, HBS1632_SPANS_MAX);
+    assert(n == 1 && spans[0].addr == 6 && spans[0].len == 2);
+    assert(hbs1632_wire_bytes(spans, n) == 4);
+    assert(hbs1632_encode(mem, &spans[0], buf) == 3);
+    assert(buf[0] == 6 && buf[1] == 0xff && buf[2] == 0x01);
+
+    // 隔两个不变的字节时带上它们, 隔三个就另起一段
+    mem[10] = 1;
+    mem[14] = 1;
+    n = hbs1632_diff(shadow, mem, 32, spans, HBS1632_SPANS_MAX);
+    assert(n == 2 && spans[0].len == 5 && spans[1].addr == 14 && spans[1].len == 1);
+    assert(hbs1632_wire_bytes(spans, n) == 10);
+
+    // 段数用完后最后一段延伸到底
+    memset(mem, 0, sizeof(mem));
+    for (i = 0; i < 32; i += 4)
+        mem[i] = 1;
+    mem[31] = 1;
+    n = hbs1632_diff(shadow, mem, 32, spans, 4);
+    assert(n == 4 && spans[3].addr == 12 && spans[3].len == 20);
+
+    // 全变时和原来整帧写一样
+    memset(mem, 0xff, sizeof(mem));
+    n = hbs1632_diff(shadow, mem, 32, spans, HBS1632_SPANS_MAX);
+    assert(n == 1 && spans[0].addr == 0 && spans[0].len == 32);
+    assert(hbs1632_wire_bytes(spans, n) == 34);
+
+    printf("hbs1632: ok\n");
+}
+
 int main(int argc, char* argv[])
 {
     int type = argc > 1 ? atoi(argv[1]) : 0;
@@ -123,6 +1604,51 @@ int main(int argc, char* argv[])
     case 2:
         test_service(argc, argv);
         break;
+    case 3:
+        test_spectrum(argc, argv);
+        break;
+    case 4:
+        test_dsp(argc, argv);
+        break;
+    case 5:
+        test_tracker(argc, argv);
+        break;
+    case 6:
+        test_filter(argc, argv);
+        break;
+    case 7:
+        test_view(argc, argv);
+        break;
+    case 8:
+        test_orient(argc, argv);
+        break;
+    case 9:
+        test_effect(argc, argv);
+        break;
+    case 10:
+        test_playlist(argc, argv);
+        break;
+    case 11:
+        test_trace(argc, argv);
+        break;
+    case 12:
+        test_clock(argc, argv);
+        break;
+    case 13:
+        test_daemon(argc, argv);
+        break;
+    case 14:
+        test_stream(argc, argv);
+        break;
+    case 15:
+        test_image(argc, argv);
+        break;
+    case 16:
+        test_realtime(argc, argv);
+        break;
+    case 17:
+        test_hbs1632(argc, argv);
+        break;
     default:
         break;
     }
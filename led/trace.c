@@ -0,0 +1,133 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/syscall.h>
+#include "trace.h"
+
+#ifdef LED_TRACE
+
+typedef struct trace_ring {
+    struct trace_ring* next;
+    int tid;
+    volatile unsigned int head;     // 已写入的总数, 下标取低位
+    trace_event events[TRACE_EVENTS];
+} trace_ring;
+
+// 所有线程的缓冲挂在一条只增不减的链表上, 线程退出后事件仍可导出
+static trace_ring* volatile rings;
+static __thread trace_ring* ring;
+
+static trace_ring* ring_create(void)
+{
+    trace_ring* r;
+
+    r = calloc(1, sizeof(*r));
+    if (!r) {
+        fprintf(stderr, "error: [TR] calloc ring\n");
+        return NULL;
+    }
+    r->tid = (int)syscall(SYS_gettid);
+
+    do {
+        r->next = rings;
+    } while (!__sync_bool_compare_and_swap(&rings, r->next, r));
+
+    return r;
+}
+
+void tr_event(const char* name, char ph)
+{
+    trace_ring* r = ring;
+    trace_event* e;
+    struct timespec ts;
+
+    if (!r) {
+        r = ring = ring_create();
+        if (!r)
+            return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    e = &r->events[r->head & (TRACE_EVENTS - 1)];
+    e->ts = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    e->name = name;
+    e->ph = ph;
+    // 只有本线程写, 编译器屏障保证事件写完才推进 head
+    __asm__ __volatile__("" ::: "memory");
+    r->head++;
+}
+
+int tr_dump(const char* path)
+{
+    trace_ring* r;
+    unsigned int i, head, n = 0;
+    FILE* f;
+    int pid = getpid();
+
+    f = fopen(path, "w");
+    if (!f) {
+        fprintf(stderr, "error: [TR] open %s\n", path);
+        return -1;
+    }
+
+    fprintf(f, "{\"traceEvents\":[");
+    for (r = rings; r; r = r->next) {
+        head = r->head;
+        __sync_synchronize();
+        i = head > TRACE_EVENTS ? head - TRACE_EVENTS : 0;
+        for (; i != head; i++) {
+            const trace_event* e = &r->events[i & (TRACE_EVENTS - 1)];
+
+            // ts 单位是 us, 保留小数到 ns
+            fprintf(f, "%s\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%llu.%03u,\"pid\":%d,\"tid\":%d%s}",
+                    n ? "," : "", e->name, e->ph,
+                    (unsigned long long)(e->ts / 1000), (unsigned int)(e->ts % 1000),
+                    pid, r->tid, e->ph == 'i' ? ",\"s\":\"t\"" : "");
+            n++;
+        }
+    }
+    fprintf(f, "\n]}\n");
+    fclose(f);
+
+    return n;
+}
+
+int64_t tr_find(const char* name, char ph, uint64_t from, uint64_t to, int last)
+{
+    trace_ring* r;
+    unsigned int i, head;
+    uint64_t found = 0;
+
+    for (r = rings; r; r = r->next) {
+        head = r->head;
+        __sync_synchronize();
+        i = head > TRACE_EVENTS ? head - TRACE_EVENTS : 0;
+        for (; i != head; i++) {
+            const trace_event* e = &r->events[i & (TRACE_EVENTS - 1)];
+
+            if (e->ph != ph || e->ts < from || e->ts > to || strcmp(e->name, name))
+                continue;
+            if (!found || (last ? e->ts > found : e->ts < found))
+                found = e->ts;
+        }
+    }
+
+    return found;
+}
+
+#else
+
+int64_t tr_find(const char* name, char ph, uint64_t from, uint64_t to, int last)
+{
+    return -1;
+}
+
+int tr_dump(const char* path)
+{
+    fprintf(stderr, "error: [TR] built without LED_TRACE, %s not written\n", path);
+    return -1;
+}
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <stdint.h>
+
+// 热路径埋点, 编译时加 -DLED_TRACE 才生效, 否则宏展开为空, 没有任何开销
+// 每个线程第一次打点时分配自己的环形缓冲, 只有本线程写, 不加锁
+// 写满后覆盖最旧的事件, tr_dump 导出为 Chrome trace / Perfetto 能打开的 JSON
+// name 只保存指针, 必须是字符串常量
+#define TRACE_EVENTS    4096
+
+typedef struct trace_event {
+    uint64_t ts;            // CLOCK_MONOTONIC, ns
+    const char* name;
+    char ph;                // 'B' 开始, 'E' 结束, 'i' 瞬时
+} trace_event;
+
+#ifdef LED_TRACE
+void tr_event(const char* name, char ph);
+
+#define TRACE_BEGIN(name)   tr_event(name, 'B')
+#define TRACE_END(name)     tr_event(name, 'E')
+#define TRACE_MARK(name)    tr_event(name, 'i')
+#else
+#define TRACE_BEGIN(name)   do { } while (0)
+#define TRACE_END(name)     do { } while (0)
+#define TRACE_MARK(name)    do { } while (0)
+#endif
+
+// 导出所有线程的事件, 返回写出的事件数; 未打开 LED_TRACE 时返回 -1
+// 导出时各线程仍可继续打点, 正被覆盖的最旧几条可能错乱, 最好在停下后导出
+int tr_dump(const char* path);
+
+// 所有线程里名字为 name, 类型为 ph, 时刻落在 [from, to] 内的第一条 (last 非 0 时最后一条)
+// 事件的时刻, 没有返回 0; 未打开 LED_TRACE 时返回 -1. 延迟工具用它拆分各阶段的耗时
+int64_t tr_find(const char* name, char ph, uint64_t from, uint64_t to, int last);
+
+#endif
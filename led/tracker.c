@@ -0,0 +1,158 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "utils.h"
+#include "tracker.h"
+#include "dsp.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// 一次转换的样本数
+#define CHUNK_SIZE  256
+
+// |X|^2 = s1^2 + s2^2 - c * s1 * s2, 换成幅度后清零状态
+// 与加窗 FFT 一样按 2 / sum(window) 归一化
+static void finish_block(band_tracker* bt)
+{
+    int k;
+
+    for (k = 0; k < bt->nr_bands; k++) {
+#ifdef FIXED_POINT
+        int64_t a = bt->s1[k], b = bt->s2[k];
+        int64_t p = a * a + b * b - ((bt->coef[k] * a >> 14) * b);
+
+        bt->bands[k] = (ws_amp_t)(((int64_t)dsp_isqrt64(p > 0 ? p : 0) * bt->gain) >> 24);
+#else
+        float a = bt->s1[k], b = bt->s2[k];
+        float p = a * a + b * b - bt->coef[k] * a * b;
+
+        bt->bands[k] = sqrtf(p > 0 ? p : 0) * bt->gain;
+#endif
+        bt->s1[k] = 0;
+        bt->s2[k] = 0;
+    }
+}
+
+static void run(band_tracker* bt, kiss_fft_scalar* x, int n)
+{
+    int i;
+
+#ifdef FIXED_POINT
+    int k;
+
+    for (i = 0; i < n; i++) {
+        int32_t v = ((int32_t)x[i] * bt->window[bt->pos + i]) >> 15;
+
+        for (k = 0; k < bt->nr_bands; k++) {
+            int32_t s = v + (int32_t)(((int64_t)bt->coef[k] * bt->s1[k]) >> 14) - bt->s2[k];
+
+            bt->s2[k] = bt->s1[k];
+            bt->s1[k] = s;
+        }
+    }
+#else
+    for (i = 0; i < n; i++)
+        x[i] *= bt->window[bt->pos + i];
+
+    dsp_goertzel(x, n, bt->coef, bt->s1, bt->s2, bt->nr_bands);
+#endif
+}
+
+int bt_feed(band_tracker* bt, const void* buf, int frames, int format, int channels)
+{
+    const char* p = buf;
+    int stride = ws_frame_bytes(format, channels);
+    int n, updated = 0;
+
+    if (!bt || !buf || frames <= 0 || channels <= 0 || !stride)
+        return 0;
+
+    while (frames > 0) {
+        // 不跨块边界, 每块结束时结算
+        n = MIN(frames, MIN(CHUNK_SIZE, bt->block - bt->pos));
+        ws_convert(p, n, format, channels, bt->scratch);
+        run(bt, bt->scratch, n);
+
+        bt->pos += n;
+        if (bt->pos == bt->block) {
+            finish_block(bt);
+            bt->pos = 0;
+            updated = 1;
+        }
+
+        p += n * stride;
+        frames -= n;
+    }
+
+    return updated;
+}
+
+band_tracker* bt_create(int rate, int block, int nr_bands, float fmin, float fmax)
+{
+    band_tracker* bt;
+    double f, w, wsum = 0;
+    int i;
+
+    fmax = MIN(fmax, rate / 2.0f);
+    if (rate <= 0 || block <= 0 || nr_bands <= 0 || nr_bands > BANDS_MAX
+        || fmin <= 0 || fmin >= fmax) {
+        fprintf(stderr, "error: [BT] create invalid param\n");
+        return NULL;
+    }
+
+    bt = malloc(sizeof(*bt));
+    if (!bt) {
+        fprintf(stderr, "error: [BT] create malloc\n");
+        return NULL;
+    }
+    memset(bt, 0, sizeof(*bt));
+
+    bt->nr_bands = nr_bands;
+    bt->block = block;
+    bt->window = malloc(block * sizeof(kiss_fft_scalar));
+    bt->scratch = malloc(CHUNK_SIZE * sizeof(kiss_fft_scalar));
+    if (!bt->window || !bt->scratch) {
+        fprintf(stderr, "error: [BT] create alloc %d\n", block);
+        bt_destroy(bt);
+        return NULL;
+    }
+
+    for (i = 0; i < nr_bands; i++) {
+        f = bm_centre(i, nr_bands, fmin, fmax);
+#ifdef FIXED_POINT
+        bt->coef[i] = (int32_t)floor(2 * cos(2 * M_PI * f / rate) * 16384 + 0.5);
+#else
+        bt->coef[i] = 2 * cos(2 * M_PI * f / rate);
+#endif
+    }
+
+    for (i = 0; i < block; i++) {
+        w = 0.5 - 0.5 * cos(2 * M_PI * i / block);
+#ifdef FIXED_POINT
+        bt->window[i] = (kiss_fft_scalar)MIN(32767, (int)(w * 32768 + 0.5));
+#else
+        bt->window[i] = w;
+#endif
+        wsum += w;
+    }
+
+#ifdef FIXED_POINT
+    bt->gain = (int32_t)(2.0 / wsum * (1 << 24) + 0.5);
+#else
+    bt->gain = 2.0 / wsum;
+#endif
+
+    return bt;
+}
+
+void bt_destroy(band_tracker* bt)
+{
+    if (bt) {
+        free(bt->window);
+        free(bt->scratch);
+        free(bt);
+    }
+}
@@ -0,0 +1,37 @@
+#ifndef _TRACKER_H_
+#define _TRACKER_H_
+
+#include "spectrum.h"
+
+// 逐块 Goertzel 频段跟踪: 只算各频段中心频率, 不做完整 FFT
+// 中心频率取 [fmin, fmax] 对数等分后各段的几何中心, 与 band_map 一致
+// 每 block 个样本 (加 Hann 窗) 出一次结果, 输出刻度与 bm_reduce 相同
+typedef struct band_tracker {
+    int nr_bands;
+    int block;
+    int pos;
+
+#ifdef FIXED_POINT
+    int32_t coef[BANDS_MAX];    // Q14, 2 * cos(w)
+    int32_t s1[BANDS_MAX];
+    int32_t s2[BANDS_MAX];
+    int32_t gain;               // Q24
+#else
+    float coef[BANDS_MAX];
+    float s1[BANDS_MAX];
+    float s2[BANDS_MAX];
+    float gain;
+#endif
+
+    kiss_fft_scalar* window;
+    kiss_fft_scalar* scratch;
+    ws_amp_t bands[BANDS_MAX];
+} band_tracker;
+
+band_tracker* bt_create(int rate, int block, int nr_bands, float fmin, float fmax);
+void bt_destroy(band_tracker* bt);
+
+// 返回 1 表示 bands 已更新
+int bt_feed(band_tracker* bt, const void* buf, int frames, int format, int channels);
+
+#endif
@@ -0,0 +1,168 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "utils.h"
+#include "view.h"
+#include "dsp.h"
+
+// 满幅 (S8 128) 对应 8 行
+#define LV_SCALE    16
+
+void lv_init(led_view* lv, const band_layout* src, int width)
+{
+    memset(lv, 0, sizeof(*lv));
+    lv->src = src;
+    lv->width = MIN(width, VIEW_COLS_MAX);
+    lv->scale = LV_SCALE;
+    lv->decay = 1;
+    lv->style = LV_STYLE_BARS;
+    lv_map(lv, lv->width, src->fmin, src->fmax);
+}
+
+int lv_map(led_view* lv, int nr_cols, float fmin, float fmax)
+{
+    const band_layout* src = lv->src;
+    int lo[VIEW_COLS_MAX], nr[VIEW_COLS_MAX];
+    double sstep, vstep, pos;
+    int c, hi;
+
+    if (nr_cols <= 0 || nr_cols > lv->width || fmin <= 0 || fmin >= fmax) {
+        fprintf(stderr, "error: [LV] map invalid param %d\n", nr_cols);
+        return -1;
+    }
+
+    // 共享频段 i 的中心在 log(f / fmin) / log(sstep) = i + 0.5
+    // 柱 c 取中心落在 [edge(c), edge(c + 1)) 内的共享频段, 一个都没有时取最近的
+    sstep = log(src->fmax / src->fmin);
+    vstep = log(fmax / fmin) / nr_cols;
+    for (c = 0; c < nr_cols; c++) {
+        pos = (log(fmin / src->fmin) + vstep * c) / sstep * src->nr_bands;
+        lo[c] = CLIP((int)ceil(pos - 0.5), 0, src->nr_bands);
+        pos = (log(fmin / src->fmin) + vstep * (c + 1)) / sstep * src->nr_bands;
+        hi = CLIP((int)ceil(pos - 0.5), 0, src->nr_bands);
+
+        if (hi <= lo[c]) {
+            pos = (log(fmin / src->fmin) + vstep * (c + 0.5)) / sstep * src->nr_bands;
+            lo[c] = CLIP((int)floor(pos), 0, src->nr_bands - 1);
+            hi = lo[c] + 1;
+        }
+        nr[c] = hi - lo[c];
+    }
+
+    lv->nr_cols = nr_cols;
+    lv->fmin = fmin;
+    lv->fmax = fmax;
+    memcpy(lv->lo, lo, sizeof(lo));
+    memcpy(lv->nr, nr, sizeof(nr));
+    memset(lv->held, 0, sizeof(lv->held));
+
+    return 0;
+}
+
+int lv_ctrl(led_view* lv, const char* cmd)
+{
+    int n = -1;
+    float lo = 0, hi = 0;
+
+    if (strncmp(cmd, "Style ", 6) == 0) {
+        if (strcmp(cmd+6, "Bars") == 0)
+            lv->style = LV_STYLE_BARS;
+        else if (strcmp(cmd+6, "Dots") == 0)
+            lv->style = LV_STYLE_DOTS;
+        else if (strcmp(cmd+6, "Peak") == 0)
+            lv->style = LV_STYLE_PEAK;
+        else
+            return -1;
+        return 0;
+    }
+    else if (strncmp(cmd, "Bands ", 6) == 0) {
+        sscanf(cmd+6, "%d", &n);
+        return lv_map(lv, n, lv->fmin, lv->fmax);
+    }
+    else if (strncmp(cmd, "Range ", 6) == 0) {
+        if (sscanf(cmd+6, "%f %f", &lo, &hi) != 2)
+            return -1;
+        return lv_map(lv, lv->nr_cols, lo, hi);
+    }
+    else if (strncmp(cmd, "Decay ", 6) == 0) {
+        sscanf(cmd+6, "%d", &n);
+        if (n <= 0)
+            return -1;
+        lv->decay = n;
+        return 0;
+    }
+    else if (strncmp(cmd, "Rate ", 5) == 0) {
+        sscanf(cmd+5, "%d", &n);
+        if (n < 0 || n > VIEW_FPS_MAX)
+            return -1;
+        lv->fps = n;
+        return 0;
+    }
+
+    return -1;
+}
+
+int lv_levels(const led_view* lv, const ws_amp_t* bands, int* levels)
+{
+    int c, k;
+
+    for (c = 0; c < lv->nr_cols; c++) {
+        const ws_amp_t* b = bands + lv->lo[c];
+#ifdef FIXED_POINT
+        uint64_t acc = 0;
+
+        for (k = 0; k < lv->nr[c]; k++)
+            acc += (int64_t)b[k] * b[k];
+        // Q15 -> S8 刻度再除 256
+        levels[c] = (dsp_isqrt64(acc) >> 8) / lv->scale;
+#else
+        float acc = 0;
+
+        for (k = 0; k < lv->nr[c]; k++)
+            acc += b[k] * b[k];
+        levels[c] = (int)(sqrtf(acc) / lv->scale);
+#endif
+    }
+
+    return lv->nr_cols;
+}
+
+void lv_draw(led_view* lv, led_render* render, const int* levels)
+{
+    int cw = render->width / lv->nr_cols;
+    int x, y, c, hit, top, on;
+
+    for (x = 0; x < render->width; x++) {
+        c = x / MAX(cw, 1);
+        if (c >= lv->nr_cols) {
+            for (y = 0; y < render->height; y++)
+                lr_sram(render, x, y, 0);
+            continue;
+        }
+
+        // 每根柱的第一列更新一次顶点
+        hit = CLIP(levels[c], 0, render->height - 1);
+        if (x % MAX(cw, 1) == 0)
+            lv->held[c] = hit > lv->held[c] ? hit : MAX(0, lv->held[c] - lv->decay);
+        top = lv->held[c];
+
+        // 从底部 (y = height - 1) 往上长
+        for (y = 0; y < render->height; y++) {
+            int row = render->height - y;
+
+            switch (lv->style) {
+            case LV_STYLE_DOTS:
+                on = top > 0 && row == top;
+                break;
+            case LV_STYLE_PEAK:
+                on = row <= hit || (top > 0 && row == top);
+                break;
+            default:
+                on = row <= hit;
+                break;
+            }
+            lr_sram(render, x, y, on);
+        }
+    }
+}
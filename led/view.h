@@ -0,0 +1,57 @@
+#ifndef _VIEW_H_
+#define _VIEW_H_
+
+#include "render.h"
+#include "spectrum.h"
+
+#define VIEW_COLS_MAX   32
+#define VIEW_FPS_MAX    100
+
+typedef enum lv_style {
+    LV_STYLE_BARS,      // 实时柱
+    LV_STYLE_DOTS,      // 只画缓落的顶点
+    LV_STYLE_PEAK,      // 实时柱 + 缓落的顶点
+} lv_style_t;
+
+// 共享分析结果的布局: nr_bands 段对数等分 [fmin, fmax]
+typedef struct band_layout {
+    int nr_bands;
+    float fmin;
+    float fmax;
+} band_layout;
+
+// 设备自己的显示方式, 共享频段在这里再映射成 nr_cols 根柱
+// 只由设备线程和持有设备锁的 session_exec 访问
+typedef struct led_view {
+    const band_layout* src;
+    int width;          // 屏宽, 柱数不能超过它
+
+    int nr_cols;
+    float fmin;
+    float fmax;
+    int lo[VIEW_COLS_MAX];
+    int nr[VIEW_COLS_MAX];
+
+    int scale;          // 每行对应的幅度, S8 刻度
+    int decay;          // 顶点每帧下落的行数
+    lv_style_t style;
+    int fps;            // 刷新率, 0 表示跟设备线程的空闲轮询
+
+    int held[VIEW_COLS_MAX];
+} led_view;
+
+void lv_init(led_view* lv, const band_layout* src, int width);
+
+// 柱数 (1 到屏宽) 和频段范围, 失败时 lv 不变
+int lv_map(led_view* lv, int nr_cols, float fmin, float fmax);
+
+// "Style Bars" (Bars/Dots/Peak), "Bands 16", "Range 60 18000", "Decay 1", "Rate 30"
+int lv_ctrl(led_view* lv, const char* cmd);
+
+// 共享频段 -> 每根柱的行数, 返回柱数
+int lv_levels(const led_view* lv, const ws_amp_t* bands, int* levels);
+
+// 更新顶点并写进 render 的显存 (不刷新), levels 为 nr_cols 个行数
+void lv_draw(led_view* lv, led_render* render, const int* levels);
+
+#endif